@@ -6,6 +6,10 @@
 #include <cstdlib>
 #include <cstdint>
 #include <algorithm>
+#include <vector>
+#include <stdexcept>
+#include <thread>
+#include <system_error>
 #include "bst.h"
 
 struct KeyError { };
@@ -14,6 +18,13 @@ struct KeyError { };
 * A special kind of node for an AVL tree, which adds the balance as a data member, plus
 * other additional helper functions. You do NOT need to implement any functionality or
 * add additional data members or helper functions.
+*
+* Building with -DAVL_COMPACT_NODES drops the balance_ member and keeps the balance in
+* the spare low bits of the parent pointer instead, so an AVLNode is no bigger than a
+* plain Node. The fix-up code briefly stores +/-2, so the tag holds balance + 2.
+*
+* Building with -DAVL_ORDER_STATISTICS adds the size of the subtree rooted at each
+* node, which AVLTree keeps up to date for rank and select queries.
 */
 template <typename Key, typename Value>
 class AVLNode : public Node<Key, Value>
@@ -21,7 +32,9 @@ class AVLNode : public Node<Key, Value>
 public:
     // Constructor/destructor.
     AVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
-    virtual ~AVLNode();
+    template<typename... ItemArgs>
+    AVLNode(AVLNode<Key, Value>* parent, ItemArgs&&... itemArgs);
+    ~AVLNode();
 
     // Getter/setter for the node's height.
     int8_t getBalance () const;
@@ -29,14 +42,27 @@ public:
     void updateBalance(int8_t diff);
 
     // Getters for parent, left, and right. These need to be redefined since they
-    // return pointers to AVLNodes - not plain Nodes. See the Node class in bst.h
-    // for more information.
-    virtual AVLNode<Key, Value>* getParent() const override;
-    virtual AVLNode<Key, Value>* getLeft() const override;
-    virtual AVLNode<Key, Value>* getRight() const override;
+    // return pointers to AVLNodes - not plain Nodes. They hide (rather than
+    // override) the Node versions; see the Node class in bst.h for more information.
+    AVLNode<Key, Value>* getParent() const;
+    AVLNode<Key, Value>* getLeft() const;
+    AVLNode<Key, Value>* getRight() const;
+
+#ifdef AVL_ORDER_STATISTICS
+    // Getter/setter for the number of nodes in this node's subtree.
+    std::size_t getSize() const;
+    void setSize(std::size_t size);
+    void updateSize();
+    static std::size_t sizeOf(const AVLNode<Key, Value>* node);
+#endif
 
 protected:
+#ifndef AVL_COMPACT_NODES
     int8_t balance_;    // effectively a signed char
+#endif
+#ifdef AVL_ORDER_STATISTICS
+    std::size_t size_;
+#endif
 };
 
 /*
@@ -49,11 +75,54 @@ protected:
 * An explicit constructor to initialize the elements by calling the base class constructor
 */
 template<class Key, class Value>
+#ifndef AVL_COMPACT_NODES
 AVLNode<Key, Value>::AVLNode(const Key& key, const Value& value, AVLNode<Key, Value> *parent) :
     Node<Key, Value>(key, value, parent), balance_(0)
 {
+#ifdef AVL_ORDER_STATISTICS
+    size_ = 1;
+#endif
+
+}
+#else
+AVLNode<Key, Value>::AVLNode(const Key& key, const Value& value, AVLNode<Key, Value> *parent) :
+    Node<Key, Value>(key, value, parent)
+{
+    static_assert(alignof(Node<Key, Value>) > Node<Key, Value>::parentTagMask,
+                  "AVL_COMPACT_NODES needs 8-byte aligned nodes");
+    setBalance(0);
+#ifdef AVL_ORDER_STATISTICS
+    size_ = 1;
+#endif
+}
+#endif
+
+/**
+* Constructs the item in place from itemArgs; see the matching Node constructor.
+*/
+template<class Key, class Value>
+template<typename... ItemArgs>
+#ifndef AVL_COMPACT_NODES
+AVLNode<Key, Value>::AVLNode(AVLNode<Key, Value>* parent, ItemArgs&&... itemArgs) :
+    Node<Key, Value>(parent, std::forward<ItemArgs>(itemArgs)...), balance_(0)
+{
+#ifdef AVL_ORDER_STATISTICS
+    size_ = 1;
+#endif
 
 }
+#else
+AVLNode<Key, Value>::AVLNode(AVLNode<Key, Value>* parent, ItemArgs&&... itemArgs) :
+    Node<Key, Value>(parent, std::forward<ItemArgs>(itemArgs)...)
+{
+    static_assert(alignof(Node<Key, Value>) > Node<Key, Value>::parentTagMask,
+                  "AVL_COMPACT_NODES needs 8-byte aligned nodes");
+    setBalance(0);
+#ifdef AVL_ORDER_STATISTICS
+    size_ = 1;
+#endif
+}
+#endif
 
 /**
 * A destructor which does nothing.
@@ -70,7 +139,11 @@ AVLNode<Key, Value>::~AVLNode()
 template<class Key, class Value>
 int8_t AVLNode<Key, Value>::getBalance() const
 {
+#ifndef AVL_COMPACT_NODES
     return balance_;
+#else
+    return static_cast<int8_t>(static_cast<int>(this->getParentTag()) - 2);
+#endif
 }
 
 /**
@@ -79,7 +152,11 @@ int8_t AVLNode<Key, Value>::getBalance() const
 template<class Key, class Value>
 void AVLNode<Key, Value>::setBalance(int8_t balance)
 {
+#ifndef AVL_COMPACT_NODES
     balance_ = balance;
+#else
+    this->setParentTag(static_cast<unsigned>(balance + 2));
+#endif
 }
 
 /**
@@ -88,21 +165,59 @@ void AVLNode<Key, Value>::setBalance(int8_t balance)
 template<class Key, class Value>
 void AVLNode<Key, Value>::updateBalance(int8_t diff)
 {
-    balance_ += diff;
+    setBalance(getBalance() + diff);
+}
+
+#ifdef AVL_ORDER_STATISTICS
+/**
+* A getter for the number of nodes in the subtree rooted at this node.
+*/
+template<class Key, class Value>
+std::size_t AVLNode<Key, Value>::getSize() const
+{
+    return size_;
+}
+
+/**
+* A setter for the subtree size of a AVLNode.
+*/
+template<class Key, class Value>
+void AVLNode<Key, Value>::setSize(std::size_t size)
+{
+    size_ = size;
+}
+
+/**
+* Recomputes the subtree size from the children's, after a rotation.
+*/
+template<class Key, class Value>
+void AVLNode<Key, Value>::updateSize()
+{
+    size_ = sizeOf(getLeft()) + sizeOf(getRight()) + 1;
+}
+
+/**
+* The subtree size of node, or 0 for an empty subtree.
+*/
+template<class Key, class Value>
+std::size_t AVLNode<Key, Value>::sizeOf(const AVLNode<Key, Value>* node)
+{
+    return (node == NULL) ? 0 : node -> size_;
 }
+#endif
 
 /**
-* An overridden function for getting the parent since a static_cast is necessary to make sure
-* that our node is a AVLNode.
+* A redefined getter for the parent since a static_cast is necessary to make sure
+* that our node is a AVLNode. Every link of an AVLTree points at an AVLNode.
 */
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLNode<Key, Value>::getParent() const
 {
-    return static_cast<AVLNode<Key, Value>*>(this->parent_);
+    return static_cast<AVLNode<Key, Value>*>(Node<Key, Value>::getParent());
 }
 
 /**
-* Overridden for the same reasons as above.
+* Redefined for the same reasons as above.
 */
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLNode<Key, Value>::getLeft() const
@@ -111,7 +226,7 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getLeft() const
 }
 
 /**
-* Overridden for the same reasons as above.
+* Redefined for the same reasons as above.
 */
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
@@ -127,72 +242,327 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
 */
 
 
-template <class Key, class Value>
-class AVLTree : public BinarySearchTree<Key, Value>
+template <class Key, class Value, class Compare = std::less<Key> >
+class AVLTree : public BinarySearchTree<Key, Value, Compare>
 {
 public:
+    AVLTree();
+    explicit AVLTree(const Compare& comp);
+    template<typename ForwardIterator>
+    AVLTree(ForwardIterator first, ForwardIterator last, bool isSorted = true,
+            const Compare& comp = Compare());
+    template<typename ForwardIterator>
+    void assign(ForwardIterator first, ForwardIterator last, bool isSorted = true);
     virtual void insert (const std::pair<const Key, Value> &new_item); // TODO
     virtual void remove(const Key& key);  // TODO
+
+    // The other inserts make their nodes through makeNode and link them
+    // through adoptNode, so the BinarySearchTree versions serve as they are.
+    typedef typename BinarySearchTree<Key, Value, Compare>::iterator iterator;
+    using BinarySearchTree<Key, Value, Compare>::insert;
+    virtual void erase_range(const Key& lo, const Key& hi);
+
+    // split moves every key not less than key into right, dropping what
+    // right held. join(pivot, right) appends pivot and then all of right,
+    // whose keys must order after this tree's, leaving right empty. Nodes
+    // are relinked rather than copied; the trees keep each other's node
+    // storage alive as needed.
+    void split(const Key& key, AVLTree& right);
+    void join(const std::pair<const Key, Value>& pivot, AVLTree& right);
+    void join(AVLTree& right);
+
+    // Set operations on the keys, built on split and join. They take
+    // other's nodes and leave it empty; unite keeps other's value where
+    // both trees hold a key. Large trees are worked on by several threads,
+    // so comparisons must not throw.
+    void unite(AVLTree& other);
+    void intersect(AVLTree& other);
+    void subtract(AVLTree& other);
+
+    // Batched updates: the batch is sorted once and merged into the tree
+    // in one ascending pass, relinking the whole tree at once when the
+    // batch is large. The last value given for a repeated key wins.
+    template<typename ForwardIterator>
+    void insert_batch(ForwardIterator first, ForwardIterator last);
+    template<typename ForwardIterator>
+    void remove_batch(ForwardIterator first, ForwardIterator last);
+
+#ifdef AVL_ORDER_STATISTICS
+    // Order statistics over the subtree sizes. Positions count from 0 in
+    // key order, and end() sits at position size().
+    std::size_t size() const;
+    std::size_t rank(const Key& key) const;
+    iterator select(std::size_t k) const;
+    std::size_t position(iterator it) const;
+    iterator advance(iterator it, std::ptrdiff_t n) const;
+    std::ptrdiff_t distance(iterator first, iterator last) const;
+    std::size_t count_range(const Key& lo, const Key& hi) const;
+#endif
 protected:
     virtual void nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2);
 
     // Add helper functions here
     void insertFix(AVLNode<Key,Value>* p, AVLNode<Key,Value>* n);
+    void insertRebalance(AVLNode<Key,Value>* newNode);
     void rotateRight(AVLNode<Key,Value>* n1);
     void rotateLeft(AVLNode<Key,Value>* n1);
     void removeFix(AVLNode<Key,Value>* n, int diff);
+    virtual void unlinkNode(Node<Key,Value>* node);
+    virtual void adoptNode(Node<Key,Value>* node, Node<Key,Value>* parent, bool isLeft);
+    virtual Node<Key,Value>* makeNode(Node<Key,Value>* parent, ItemMaker<Key,Value>& item);
+    virtual const std::type_info& nodeKind() const;
+    // batches of at least 1/rebuildShare of the tree relink it
+    static const std::size_t rebuildShare = 64;
+    bool preferRebuild(std::size_t batchSize) const;
+    AVLNode<Key,Value>* linkBalanced(AVLNode<Key,Value>** nodes, std::size_t count, AVLNode<Key,Value>* parent,
+                                     int& height);
+#ifdef AVL_ORDER_STATISTICS
+    void resizePath(AVLNode<Key,Value>* n, int diff);
+#endif
+
+    // Split and join work on detached subtrees, whose top node has no
+    // parent, and leave root_ for the caller to set. Nodes only store
+    // balances, so subtree heights are passed along with them.
+    static int subtreeHeight(AVLNode<Key,Value>* n);
+    bool rebalance(AVLNode<Key,Value>* n, AVLNode<Key,Value>*& top);
+    bool growFix(AVLNode<Key,Value>* n);
+    AVLNode<Key,Value>* join(AVLNode<Key,Value>* left, int leftHeight, AVLNode<Key,Value>* pivot,
+                             AVLNode<Key,Value>* right, int rightHeight, int& height);
+    AVLNode<Key,Value>* concat(AVLNode<Key,Value>* left, int leftHeight,
+                               AVLNode<Key,Value>* right, int rightHeight, int& height);
+    void splitAt(AVLNode<Key,Value>* top, AVLNode<Key,Value>* x, bool keepX,
+                 AVLNode<Key,Value>*& left, int& leftHeight,
+                 AVLNode<Key,Value>*& right, int& rightHeight);
+    AVLNode<Key,Value>* splitKey(AVLNode<Key,Value>* top, const Key& key,
+                                 AVLNode<Key,Value>*& left, int& leftHeight,
+                                 AVLNode<Key,Value>*& right, int& rightHeight);
+
+    // Recursive halves of the set operations. forks counts how many more
+    // levels may hand one side to a new thread; nodes to free are
+    // collected in discard, since the pool is not thread safe.
+    typedef std::vector<AVLNode<Key,Value>*> NodeList;
+    static const int parallelHeight = 14;
+    static int forkLevels();
+    AVLNode<Key,Value>* uniteNodes(AVLNode<Key,Value>* a, int aHeight, AVLNode<Key,Value>* b, int bHeight,
+                                   int& height, int forks, NodeList& discard);
+    AVLNode<Key,Value>* intersectNodes(AVLNode<Key,Value>* a, AVLNode<Key,Value>* b, int bHeight,
+                                       int& height, int forks, NodeList& discard);
+    AVLNode<Key,Value>* subtractNodes(AVLNode<Key,Value>* a, int aHeight, AVLNode<Key,Value>* b, int bHeight,
+                                      int& height, int forks, NodeList& discard);
+    AVLNode<Key,Value>* subtractKeys(AVLNode<Key,Value>* a, int aHeight, const Key* keys, std::size_t count,
+                                     int& height, int forks, NodeList& discard);
+    std::size_t freeNodes(NodeList& discard);
+    template<typename ForwardIterator>
+    AVLNode<Key,Value>* buildBalanced(ForwardIterator& it, ForwardIterator last, std::size_t count,
+                                      AVLNode<Key,Value>* parent, int& height);
 
 
 };
 
+/**
+* Default constructor, which sizes the node pool for AVLNodes.
+*/
+template<class Key, class Value, class Compare>
+AVLTree<Key, Value, Compare>::AVLTree() :
+    BinarySearchTree<Key, Value, Compare>(sizeof(AVLNode<Key, Value>), alignof(AVLNode<Key, Value>))
+{
+
+}
+
+/**
+* Constructor for a tree ordered by the given comparison object.
+*/
+template<class Key, class Value, class Compare>
+AVLTree<Key, Value, Compare>::AVLTree(const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(sizeof(AVLNode<Key, Value>), alignof(AVLNode<Key, Value>), comp)
+{
+
+}
+
+/**
+* Builds a tree from a range of key/value pairs in linear time; see assign().
+*/
+template<class Key, class Value, class Compare>
+template<typename ForwardIterator>
+AVLTree<Key, Value, Compare>::AVLTree(ForwardIterator first, ForwardIterator last, bool isSorted,
+                                      const Compare& comp) :
+    AVLTree(comp)
+{
+    assign(first, last, isSorted);
+}
+
+/**
+* Replaces the contents of the tree with the key/value pairs in
+* [first, last), which must not point into this tree.
+*
+* If isSorted is true the range is expected in ascending key order and
+* the tree is built in O(n) with no rotations: each subtree is rooted at
+* the middle of its slice, so the result is perfectly balanced. A range
+* that turns out not to be sorted, or isSorted == false, is copied and
+* sorted first, O(n log n). As with insert(), the last value given for a
+* repeated key wins.
+*/
+template<class Key, class Value, class Compare>
+template<typename ForwardIterator>
+void AVLTree<Key, Value, Compare>::assign(ForwardIterator first, ForwardIterator last, bool isSorted)
+{
+    // count the distinct keys, checking the order on the way
+    std::size_t count = 0;
+    for (ForwardIterator it = first, prev = first; isSorted && it != last; prev = it, ++it){
+        if (it == first || this -> keyLess(prev -> first, it -> first)){
+            ++count;
+        } else if (this -> keyLess(it -> first, prev -> first)){
+            isSorted = false;
+        }
+    }
+
+    if (!isSorted){
+        // a stable sort keeps repeated keys in input order, so the
+        // last one still wins
+        std::vector<std::pair<Key, Value> > items(first, last);
+        std::stable_sort(items.begin(), items.end(),
+            [this](const std::pair<Key, Value>& a, const std::pair<Key, Value>& b) {
+                return this -> keyLess(a.first, b.first);
+            });
+        assign(items.begin(), items.end(), true);
+        return;
+    }
+
+    this -> clear();
+    int height = 0;
+    ForwardIterator it = first;
+    this -> root_ = buildBalanced(it, last, count, NULL, height);
+    this -> count_ = count;
+    this -> refreshEnds();
+}
+
+/**
+* Builds a perfectly balanced subtree from the next count distinct keys
+* at it, advancing it past them. height is set to the subtree's height,
+* so each node's balance is just the difference of its children's.
+*/
+template<class Key, class Value, class Compare>
+template<typename ForwardIterator>
+AVLNode<Key,Value>* AVLTree<Key, Value, Compare>::buildBalanced(ForwardIterator& it, ForwardIterator last,
+                                                       std::size_t count, AVLNode<Key,Value>* parent,
+                                                       int& height)
+{
+    if (count == 0){
+        height = 0;
+        return NULL;
+    }
+
+    // the right half gets the extra key, so balances are 0 or +1
+    std::size_t leftCount = (count - 1) / 2;
+    int leftHeight = 0;
+    int rightHeight = 0;
+    AVLNode<Key, Value>* left = buildBalanced(it, last, leftCount, NULL, leftHeight);
+
+    // take the last of a run of equal keys
+    ForwardIterator item = it;
+    for (++it; it != last && !this -> keyLess(item -> first, it -> first); ++it){
+        item = it;
+    }
+
+    AVLNode<Key, Value>* node = NULL;
+    AVLNode<Key, Value>* right = NULL;
+    try {
+        node = this -> template createNode<AVLNode<Key, Value> >(item -> first, item -> second, parent);
+        right = buildBalanced(it, last, count - 1 - leftCount, node, rightHeight);
+    } catch (...) {
+        this -> recursiveClear(left);
+        if (node != NULL){
+            this -> destroyNode(node);
+        }
+        throw;
+    }
+
+    node -> setLeft(left);
+    if (left != NULL){
+        left -> setParent(node);
+    }
+    node -> setRight(right);
+    node -> setBalance(static_cast<int8_t>(rightHeight - leftHeight));
+#ifdef AVL_ORDER_STATISTICS
+    node -> setSize(count);
+#endif
+    height = std::max(leftHeight, rightHeight) + 1;
+    return node;
+}
+
 /*
  * Recall: If key is already in the tree, you should 
  * overwrite the current value with the updated value.
  */
-template<class Key, class Value>
-void AVLTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::insert (const std::pair<const Key, Value> &new_item)
 {
     // TODO
-    AVLNode<Key, Value>* temp = static_cast<AVLNode<Key, Value>*>(this -> root_);
-
-    // beginning node should be root, so its parent should be null
-    AVLNode<Key, Value>* tempParent = NULL;
+    // traverse through tree until insertion point is found
+    Node<Key, Value>* tempParent = NULL;
+    bool isLeft = false;
+    AVLNode<Key, Value>* temp = static_cast<AVLNode<Key, Value>*>(this -> findInsertPoint(new_item.first, tempParent, isLeft));
 
-    // traverse through list until insertion point is found
-    while (temp != NULL){
-        tempParent = temp;
-        
-        // key already exists, replace value
-        if (new_item.first == temp -> getKey()){
-            temp -> setValue(new_item.second); 
-            return;                  
-        }
-        else if (new_item.first < temp -> getKey()){
-            temp = temp -> getLeft();
-        } 
-        else {
-            temp = temp -> getRight();     
-        }
+    // key already exists, replace value
+    if (temp != NULL){
+        temp -> setValue(new_item.second);
+        return;
     }
 
     // create new node with key/value from the argument
-    AVLNode<Key, Value>* newNode = new AVLNode<Key, Value>(new_item.first, new_item.second, tempParent);
-    newNode -> setBalance(0);
+    AVLNode<Key, Value>* newNode = this -> template createNode<AVLNode<Key, Value> >(
+        new_item.first, new_item.second, static_cast<AVLNode<Key, Value>*>(tempParent));
+    this -> linkNode(newNode, tempParent, isLeft);
 
-    // tree is empty, set new node as root
-    if (tempParent == NULL){
-        this -> root_ = newNode;
-        return;
+    insertRebalance(newNode);
+}
 
-    // add node as child of parent (check which side) 
-    } else if (new_item.first < tempParent -> getKey()){
-        tempParent -> setLeft(newNode);
-        // newNode -> setParent(tempParent);
-    } else {
-        tempParent -> setRight(newNode);
-        // newNode -> setParent(tempParent);
+/**
+* Makes an AVLNode around item, for the inserts BinarySearchTree shares.
+*/
+template<class Key, class Value, class Compare>
+Node<Key,Value>* AVLTree<Key, Value, Compare>::makeNode(Node<Key,Value>* parent, ItemMaker<Key,Value>& item)
+{
+    return this -> template createNode<AVLNode<Key, Value> >(static_cast<AVLNode<Key, Value>*>(parent), item);
+}
 
-    }
+/**
+* AVLTree's nodes are AVLNodes, whatever their layout.
+*/
+template<class Key, class Value, class Compare>
+const std::type_info& AVLTree<Key, Value, Compare>::nodeKind() const
+{
+    return typeid(AVLNode<Key, Value>);
+}
+
+/**
+* Links a node moved from another tree, or just made by makeNode, as a
+* fresh leaf and rebalances.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::adoptNode(Node<Key,Value>* node, Node<Key,Value>* parent, bool isLeft)
+{
+    AVLNode<Key, Value>* leaf = static_cast<AVLNode<Key, Value>*>(node);
+    leaf -> setBalance(0);
+#ifdef AVL_ORDER_STATISTICS
+    leaf -> setSize(1);
+#endif
+    BinarySearchTree<Key, Value, Compare>::adoptNode(leaf, parent, isLeft);
+    insertRebalance(leaf);
+}
+
+/**
+* Updates the balances above a freshly linked leaf and restores the
+* AVL property.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::insertRebalance(AVLNode<Key,Value>* newNode)
+{
+#ifdef AVL_ORDER_STATISTICS
+    // every subtree on the path gained a node; the rotations below then
+    // only have to fix up the nodes they move
+    resizePath(newNode -> getParent(), 1);
+#endif
 
     // updating balances based off of new node
     if (newNode -> getParent() != NULL){
@@ -212,93 +582,103 @@ void AVLTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
     }
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::insertFix(AVLNode<Key,Value>* p, AVLNode<Key,Value>* n)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::insertFix(AVLNode<Key,Value>* p, AVLNode<Key,Value>* n)
 {
     // TODO
-    if (p == NULL || p -> getParent() == NULL){
-        return;
-    }
+    // walks up from p while the subtree heights keep growing; a loop
+    // rather than a recursion, so the call stack stays flat
+    while (true){
+        if (p == NULL || p -> getParent() == NULL){
+            return;
+        }
 
-    // g = grandparent
-    AVLNode<Key, Value>* g = p -> getParent();
+        // g = grandparent
+        AVLNode<Key, Value>* g = p -> getParent();
     
-    // follows pseudocode on slides for insert fix
-    // parent is left child of grandparent
-    if (p == g -> getLeft()){
-        g -> updateBalance(-1);  
+        // follows pseudocode on slides for insert fix
+        // parent is left child of grandparent
+        if (p == g -> getLeft()){
+            g -> updateBalance(-1);  
         
-        if (g -> getBalance() == 0){
-            // no change needed
-            return;
-        } else if (g -> getBalance() == -1){
-            insertFix(g, p);
-        } else if (g -> getBalance() == -2){
-            // zigzigleft
-            if (n == p -> getLeft() /*&& p == g -> getLeft()*/){
-                rotateRight(g);
-                p -> setBalance(0);
-                g -> setBalance(0);
-            // zigzagleft
-            } else /*if (n -> getBalance() == 1)*/{
-                rotateLeft(p);
-                rotateRight(g);
-                // adjusts balances as needed after rotations
-                if (n -> getBalance() == -1){
-                    p -> setBalance(0);
-                    g -> setBalance(1);
-                    n -> setBalance(0);
-                } else if (n -> getBalance() == 0){
+            if (g -> getBalance() == 0){
+                // no change needed
+                return;
+            } else if (g -> getBalance() == -1){
+                // the subtree at g grew; carry on one level up
+                n = p;
+                p = g;
+                continue;
+            } else if (g -> getBalance() == -2){
+                // zigzigleft
+                if (n == p -> getLeft() /*&& p == g -> getLeft()*/){
+                    rotateRight(g);
                     p -> setBalance(0);
                     g -> setBalance(0);
-                    n -> setBalance(0);
-                } else if (n -> getBalance() == 1){
-                    p -> setBalance(-1);
-                    g -> setBalance(0);
-                    n -> setBalance(0);
+                // zigzagleft
+                } else /*if (n -> getBalance() == 1)*/{
+                    rotateLeft(p);
+                    rotateRight(g);
+                    // adjusts balances as needed after rotations
+                    if (n -> getBalance() == -1){
+                        p -> setBalance(0);
+                        g -> setBalance(1);
+                        n -> setBalance(0);
+                    } else if (n -> getBalance() == 0){
+                        p -> setBalance(0);
+                        g -> setBalance(0);
+                        n -> setBalance(0);
+                    } else if (n -> getBalance() == 1){
+                        p -> setBalance(-1);
+                        g -> setBalance(0);
+                        n -> setBalance(0);
+                    }
                 }
-            }
-        } 
-    // parent is right child of grandparent
-    } else if (p == g -> getRight()){
-        g -> updateBalance(1);
-        // nothing to balance, so return
-        if (g -> getBalance() == 0){
-            return;
-        } else if (g -> getBalance() == 1){
-            insertFix(g, p);
-        } else if (g -> getBalance() == 2){
-            // zig zig right
-            if (n == p -> getRight() /*&& p == g -> getRight()*/){
-                rotateLeft(g);
-                p -> setBalance(0);
-                g -> setBalance(0);
-            // zig zag right
-            } else /*if (n -> getBalance() == -1)*/{
-                rotateRight(p);
-                rotateLeft(g);
-                // adjust balances as needed after rotations
-                if (n -> getBalance() == 1){
-                    p -> setBalance(0);
-                    g -> setBalance(-1);
-                    n -> setBalance(0);
-                } else if (n -> getBalance() == 0){
+            } 
+        // parent is right child of grandparent
+        } else if (p == g -> getRight()){
+            g -> updateBalance(1);
+            // nothing to balance, so return
+            if (g -> getBalance() == 0){
+                return;
+            } else if (g -> getBalance() == 1){
+                // the subtree at g grew; carry on one level up
+                n = p;
+                p = g;
+                continue;
+            } else if (g -> getBalance() == 2){
+                // zig zig right
+                if (n == p -> getRight() /*&& p == g -> getRight()*/){
+                    rotateLeft(g);
                     p -> setBalance(0);
                     g -> setBalance(0);
-                    n -> setBalance(0);
-                } else if (n -> getBalance() == -1){
-                    p -> setBalance(1);
-                    g -> setBalance(0);
-                    n -> setBalance(0);
+                // zig zag right
+                } else /*if (n -> getBalance() == -1)*/{
+                    rotateRight(p);
+                    rotateLeft(g);
+                    // adjust balances as needed after rotations
+                    if (n -> getBalance() == 1){
+                        p -> setBalance(0);
+                        g -> setBalance(-1);
+                        n -> setBalance(0);
+                    } else if (n -> getBalance() == 0){
+                        p -> setBalance(0);
+                        g -> setBalance(0);
+                        n -> setBalance(0);
+                    } else if (n -> getBalance() == -1){
+                        p -> setBalance(1);
+                        g -> setBalance(0);
+                        n -> setBalance(0);
+                    }
                 }
-            }
-        } 
+            } 
+        }
+        return;
     }
 }
 
-// perform right rotation on given node
-template<class Key, class Value>
-void AVLTree<Key, Value>::rotateRight(AVLNode<Key,Value>* n1){
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::rotateRight(AVLNode<Key,Value>* n1){
     
     // new parent of node n1 will be the current left child of n1 
     AVLNode<Key, Value>* p = n1 -> getLeft();
@@ -315,8 +695,10 @@ void AVLTree<Key, Value>::rotateRight(AVLNode<Key,Value>* n1){
         p -> setParent(n1 -> getParent());
 
         if (n1 -> getParent() == NULL){
-            // update root
-            this -> root_ = p;
+            // update root, unless n1 tops a detached subtree
+            if (this -> root_ == n1){
+                this -> root_ = p;
+            }
         // update n1's parent's child pointers
         } else if (n1 == (n1 -> getParent()) -> getLeft()) {
             (n1 -> getParent()) -> setLeft(p);
@@ -326,14 +708,18 @@ void AVLTree<Key, Value>::rotateRight(AVLNode<Key,Value>* n1){
         
         n1 -> setParent(p);
         p -> setRight(n1);
+#ifdef AVL_ORDER_STATISTICS
+        p -> setSize(n1 -> getSize());
+        n1 -> updateSize();
+#endif
 
     } else {
         return;
     }
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::rotateLeft(AVLNode<Key,Value>* n1){
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::rotateLeft(AVLNode<Key,Value>* n1){
     
     // new parent of node n1 will be the current right child of n1 
     AVLNode<Key, Value>* p = n1 -> getRight();
@@ -350,8 +736,10 @@ void AVLTree<Key, Value>::rotateLeft(AVLNode<Key,Value>* n1){
         p -> setParent(n1 -> getParent());
 
         if (n1 -> getParent() == NULL){
-            // update root
-            this -> root_ = p;
+            // update root, unless n1 tops a detached subtree
+            if (this -> root_ == n1){
+                this -> root_ = p;
+            }
 
         // update n1's parent's child pointers
         } else if (n1 == (n1 -> getParent()) -> getRight()) {
@@ -361,6 +749,10 @@ void AVLTree<Key, Value>::rotateLeft(AVLNode<Key,Value>* n1){
         }
         p -> setLeft(n1);
         n1 -> setParent(p);
+#ifdef AVL_ORDER_STATISTICS
+        p -> setSize(n1 -> getSize());
+        n1 -> updateSize();
+#endif
 
     } else {
         return;
@@ -371,16 +763,28 @@ void AVLTree<Key, Value>::rotateLeft(AVLNode<Key,Value>* n1){
  * Recall: The writeup specifies that if a node has 2 children you
  * should swap with the predecessor and then remove.
  */
-template<class Key, class Value>
-void AVLTree<Key, Value>::remove(const Key& key)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::remove(const Key& key)
 {
     // TODO
-    int diff = 0;
-
-    AVLNode<Key, Value>* badNode = static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key, Value>::internalFind(key));
+    AVLNode<Key, Value>* badNode = static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key, Value, Compare>::internalFind(key));
     if (badNode == NULL) {
         return;
     }
+    this -> removeNode(badNode);
+}
+
+/**
+* Unlinks badNode, then restores the AVL property above it. The caller
+* frees badNode or hands it on.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::unlinkNode(Node<Key,Value>* node)
+{
+    AVLNode<Key, Value>* badNode = static_cast<AVLNode<Key, Value>*>(node);
+    this -> trackUnlink(badNode);
+
+    int diff = 0;
     // delete badNode;
     AVLNode<Key, Value>* p = badNode -> getParent();
 
@@ -449,7 +853,9 @@ void AVLTree<Key, Value>::remove(const Key& key)
         }
     }
 
-    delete badNode; // free memory
+#ifdef AVL_ORDER_STATISTICS
+    resizePath(p, -1);
+#endif
 
     // balance tree
     if (p != NULL){
@@ -457,128 +863,1244 @@ void AVLTree<Key, Value>::remove(const Key& key)
     }
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::removeFix(AVLNode<Key,Value>* n, int diff){
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::removeFix(AVLNode<Key,Value>* n, int diff){
     
-    // base case
-    if (n == NULL){
-        return;
-    }
+    // walks up from n for as long as the subtree height keeps shrinking;
+    // each level that used to be a recursive call is one more pass here
+    while (n != NULL){
+        // for the next level up
+        int ndiff = 0;
+        AVLNode<Key, Value>* p = n -> getParent();
+
+        // check if node is left or right child to know what adjustment to diff
+        if (p != NULL){
+            if (n == (n -> getParent()) -> getLeft()){
+                ndiff = 1;
+            } else {
+                ndiff = -1;
+            }
+        }
 
-    // for recursive calls
-    int ndiff = 0;
-    AVLNode<Key, Value>* p = n -> getParent();
+        // diff gotten from remove()
+        n -> setBalance(n -> getBalance() + diff);
 
-    // check if node is left or right child to know what adjustment to diff
-    if (p != NULL){
-        if (n == (n -> getParent()) -> getLeft()){
-            ndiff = 1;
-        } else {
-            ndiff = -1;
-        }
-    }
-
-    // diff gotten from remove()
-    n -> setBalance(n -> getBalance() + diff);
-
-    // psuedocode taken from slides
-    // imbalance on left size
-    if (diff == -1){
-        // left heavy
-        if (n -> getBalance() == -2){
-            AVLNode<Key, Value>* c = n -> getLeft();
-            if (c -> getBalance() == -1){
-                rotateRight(n);
-                n -> setBalance(0);
-                c -> setBalance(0);
-                // recurse up the tree (by calling parent)
-                removeFix(p, ndiff);
-            } else if (c -> getBalance() == 0){
-                rotateRight(n);
-                n -> setBalance(-1);
-                c -> setBalance(1);
-            } else if (c -> getBalance() == 1){
-                AVLNode<Key, Value>* g = c -> getRight();
-                rotateLeft(c);
-                rotateRight(n);
-                // adjust balances as needed
-                if (g -> getBalance() == 1){
-                    n -> setBalance(0);
-                    c -> setBalance(-1);
-                    g -> setBalance(0);
-                } else if (g -> getBalance() == 0){
+        // psuedocode taken from slides
+        // imbalance on left size
+        if (diff == -1){
+            // left heavy
+            if (n -> getBalance() == -2){
+                AVLNode<Key, Value>* c = n -> getLeft();
+                if (c -> getBalance() == -1){
+                    rotateRight(n);
                     n -> setBalance(0);
                     c -> setBalance(0);
-                    g -> setBalance(0);
-                } else if (g -> getBalance() == -1){
-                    n -> setBalance(1);
-                    c -> setBalance(0);
-                    g -> setBalance(0);
+                    // continue up the tree at the parent
+                    n = p;
+                    diff = ndiff;
+                    continue;
+                } else if (c -> getBalance() == 0){
+                    rotateRight(n);
+                    n -> setBalance(-1);
+                    c -> setBalance(1);
+                } else if (c -> getBalance() == 1){
+                    AVLNode<Key, Value>* g = c -> getRight();
+                    rotateLeft(c);
+                    rotateRight(n);
+                    // adjust balances as needed
+                    if (g -> getBalance() == 1){
+                        n -> setBalance(0);
+                        c -> setBalance(-1);
+                        g -> setBalance(0);
+                    } else if (g -> getBalance() == 0){
+                        n -> setBalance(0);
+                        c -> setBalance(0);
+                        g -> setBalance(0);
+                    } else if (g -> getBalance() == -1){
+                        n -> setBalance(1);
+                        c -> setBalance(0);
+                        g -> setBalance(0);
+                    }
+                    // continue up the tree at the parent
+                    n = p;
+                    diff = ndiff;
+                    continue;
                 }
-                // recursive up the tree by passing parent
-                removeFix(p, ndiff);
+            } else if (n -> getBalance() == -1){
+                // node is still balanced because <= abs(1)
+                n -> setBalance(-1);
+            } else if (n -> getBalance() == 0){
+                // height shrank, so the parent needs fixing too
+                n = p;
+                diff = ndiff;
+                continue;
             }
-        } else if (n -> getBalance() == -1){
-            // node is still balanced because <= abs(1)
-            n -> setBalance(-1);
-        } else if (n -> getBalance() == 0){
-            // recurse
-            removeFix(p, ndiff);
-        }
-
-    // imbalance on the right side
-    } else if (diff == 1){
-        // right heavy
-        if (n -> getBalance() == 2){
-            AVLNode<Key, Value>* c = n -> getRight();
-            if (c -> getBalance() == 1){
-                rotateLeft(n);
-                n -> setBalance(0);
-                c -> setBalance(0);
-                // recurse up the tree by passing parent
-                removeFix(p, ndiff);
-            } else if (c -> getBalance() == 0){
-                rotateLeft(n);
-                n -> setBalance(1);
-                c -> setBalance(-1);
-            } else if (c -> getBalance() == -1){
-                AVLNode<Key, Value>* g = c -> getLeft();
-                rotateRight(c);
-                rotateLeft(n);
-                // adjust balance_ for nodes as needed
-                if (g -> getBalance() == -1){
-                    n -> setBalance(0);
-                    c -> setBalance(1);
-                    g -> setBalance(0);
-                } else if (g -> getBalance() == 0){
+
+        // imbalance on the right side
+        } else if (diff == 1){
+            // right heavy
+            if (n -> getBalance() == 2){
+                AVLNode<Key, Value>* c = n -> getRight();
+                if (c -> getBalance() == 1){
+                    rotateLeft(n);
                     n -> setBalance(0);
                     c -> setBalance(0);
-                    g -> setBalance(0);
-                } else if (g -> getBalance() == 1){
-                    n -> setBalance(-1);
-                    c -> setBalance(0);
-                    g -> setBalance(0);
+                    // continue up the tree at the parent
+                    n = p;
+                    diff = ndiff;
+                    continue;
+                } else if (c -> getBalance() == 0){
+                    rotateLeft(n);
+                    n -> setBalance(1);
+                    c -> setBalance(-1);
+                } else if (c -> getBalance() == -1){
+                    AVLNode<Key, Value>* g = c -> getLeft();
+                    rotateRight(c);
+                    rotateLeft(n);
+                    // adjust balance_ for nodes as needed
+                    if (g -> getBalance() == -1){
+                        n -> setBalance(0);
+                        c -> setBalance(1);
+                        g -> setBalance(0);
+                    } else if (g -> getBalance() == 0){
+                        n -> setBalance(0);
+                        c -> setBalance(0);
+                        g -> setBalance(0);
+                    } else if (g -> getBalance() == 1){
+                        n -> setBalance(-1);
+                        c -> setBalance(0);
+                        g -> setBalance(0);
+                    }
+                    // continue up the tree at the parent
+                    n = p;
+                    diff = ndiff;
+                    continue;
                 }
-                // recursive call
-                removeFix(p, ndiff);
+            } else if (n -> getBalance() == 1){
+                // node is still balanced bc <= abs(1)
+                n -> setBalance(1);
+            } else if (n -> getBalance() == 0){
+                // height shrank, so the parent needs fixing too
+                n = p;
+                diff = ndiff;
+                continue;
             }
-        } else if (n -> getBalance() == 1){
-            // node is still balanced bc <= abs(1)
-            n -> setBalance(1);
-        } else if (n -> getBalance() == 0){
-            // recurse
-            removeFix(p, ndiff);
         }
+        return;
     }
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
 {
-    BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
+    BinarySearchTree<Key, Value, Compare>::nodeSwap(n1, n2);
     int8_t tempB = n1->getBalance();
     n1->setBalance(n2->getBalance());
     n2->setBalance(tempB);
+#ifdef AVL_ORDER_STATISTICS
+    // sizes belong to positions in the tree, so they trade places too
+    std::size_t tempS = n1->getSize();
+    n1->setSize(n2->getSize());
+    n2->setSize(tempS);
+#endif
+}
+
+#ifdef AVL_ORDER_STATISTICS
+/**
+* Adds diff to the subtree size of n and of each of its ancestors.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::resizePath(AVLNode<Key,Value>* n, int diff)
+{
+    for (; n != NULL; n = n -> getParent()){
+        n -> setSize(n -> getSize() + diff);
+    }
+}
+
+/**
+* Returns the number of items in the tree, in O(1).
+*/
+template<class Key, class Value, class Compare>
+std::size_t AVLTree<Key, Value, Compare>::size() const
+{
+    return AVLNode<Key, Value>::sizeOf(static_cast<AVLNode<Key, Value>*>(this -> root_));
+}
+
+/**
+* Returns how many keys in the tree order before key, whether or not
+* key itself is present.
+*/
+template<class Key, class Value, class Compare>
+std::size_t AVLTree<Key, Value, Compare>::rank(const Key& key) const
+{
+    std::size_t before = 0;
+    AVLNode<Key, Value>* temp = static_cast<AVLNode<Key, Value>*>(this -> root_);
+    while (temp != NULL){
+        if (this -> keyLess(temp -> getKey(), key)){
+            before += AVLNode<Key, Value>::sizeOf(temp -> getLeft()) + 1;
+            temp = temp -> getRight();
+        } else {
+            temp = temp -> getLeft();
+        }
+    }
+    return before;
+}
+
+/**
+* Returns an iterator to the item at position k (the k+1-th smallest
+* key), or end() if k >= size().
+*/
+template<class Key, class Value, class Compare>
+typename AVLTree<Key, Value, Compare>::iterator
+AVLTree<Key, Value, Compare>::select(std::size_t k) const
+{
+    AVLNode<Key, Value>* temp = static_cast<AVLNode<Key, Value>*>(this -> root_);
+    while (temp != NULL){
+        std::size_t leftSize = AVLNode<Key, Value>::sizeOf(temp -> getLeft());
+        if (k < leftSize){
+            temp = temp -> getLeft();
+        } else if (k == leftSize){
+            break;
+        } else {
+            k -= leftSize + 1;
+            temp = temp -> getRight();
+        }
+    }
+    return this -> makeIterator(temp);
+}
+
+/**
+* Returns the position of the item it points at, by walking up to the
+* root and counting everything that orders before it on the way.
+*/
+template<class Key, class Value, class Compare>
+std::size_t AVLTree<Key, Value, Compare>::position(iterator it) const
+{
+    AVLNode<Key, Value>* temp = static_cast<AVLNode<Key, Value>*>(this -> getNode(it));
+    if (temp == NULL){
+        return size();
+    }
+
+    std::size_t before = AVLNode<Key, Value>::sizeOf(temp -> getLeft());
+    for (AVLNode<Key, Value>* p = temp -> getParent(); p != NULL; temp = p, p = p -> getParent()){
+        if (temp == p -> getRight()){
+            before += AVLNode<Key, Value>::sizeOf(p -> getLeft()) + 1;
+        }
+    }
+    return before;
+}
+
+/**
+* Returns the iterator n places after it (before it, for negative n)
+* in O(log n) rather than n increments. Going past either end gives
+* end().
+*/
+template<class Key, class Value, class Compare>
+typename AVLTree<Key, Value, Compare>::iterator
+AVLTree<Key, Value, Compare>::advance(iterator it, std::ptrdiff_t n) const
+{
+    std::ptrdiff_t target = static_cast<std::ptrdiff_t>(position(it)) + n;
+    if (target < 0){
+        return this -> end();
+    }
+    return select(static_cast<std::size_t>(target));
+}
+
+/**
+* Returns how many increments take first to last, which may be negative
+* if last comes first.
+*/
+template<class Key, class Value, class Compare>
+std::ptrdiff_t AVLTree<Key, Value, Compare>::distance(iterator first, iterator last) const
+{
+    return static_cast<std::ptrdiff_t>(position(last)) - static_cast<std::ptrdiff_t>(position(first));
+}
+
+/**
+* Returns how many keys lie in [lo, hi), from two ranks instead of a walk.
+*/
+template<class Key, class Value, class Compare>
+std::size_t AVLTree<Key, Value, Compare>::count_range(const Key& lo, const Key& hi) const
+{
+    if (!this -> keyLess(lo, hi)){
+        return 0;
+    }
+    return rank(hi) - rank(lo);
+}
+#endif
+
+/**
+* Removes every key in [lo, hi) in O(k + log n) for k removed keys: the
+* tree is split around the range, the middle part is freed in one go,
+* and the outer parts are joined back together. Both ends of the range
+* are found before anything is unlinked.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::erase_range(const Key& lo, const Key& hi)
+{
+    if (!this -> keyLess(lo, hi)){
+        return;
+    }
+    AVLNode<Key, Value>* first = static_cast<AVLNode<Key, Value>*>(this -> lowerBoundNode(lo));
+    AVLNode<Key, Value>* last = static_cast<AVLNode<Key, Value>*>(this -> lowerBoundNode(hi));
+    if (first == last){
+        return;
+    }
+
+    AVLNode<Key, Value>* left = NULL;
+    AVLNode<Key, Value>* rest = NULL;
+    AVLNode<Key, Value>* middle = NULL;
+    AVLNode<Key, Value>* right = NULL;
+    int leftHeight = 0;
+    int restHeight = 0;
+    int middleHeight = 0;
+    int rightHeight = 0;
+    AVLNode<Key, Value>* top = static_cast<AVLNode<Key, Value>*>(this -> root_);
+    this -> root_ = NULL;
+    splitAt(top, first, true, left, leftHeight, rest, restHeight);
+    splitAt(rest, last, true, middle, middleHeight, right, rightHeight);
+    std::size_t freed = this -> recursiveClear(middle);
+
+    int height = 0;
+    this -> root_ = concat(left, leftHeight, right, rightHeight, height);
+    if (this -> count_ != this -> unknownSize){
+        this -> count_ -= freed;
+    }
+    this -> refreshEnds();
+}
+
+/**
+* Moves every item with a key not less than key into right; whatever
+* right held before is cleared. Both trees end up holding the node
+* storage, which lives until both have released it. Cutting the tree
+* takes O(log n) and nothing here walks the halves: without subtree
+* sizes (AVL_ORDER_STATISTICS) their counts are left for size().
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::split(const Key& key, AVLTree& right)
+{
+    if (&right == this){
+        return;
+    }
+    right.clear();
+    AVLNode<Key, Value>* top = static_cast<AVLNode<Key, Value>*>(this -> root_);
+    this -> root_ = NULL;
+
+    AVLNode<Key, Value>* left = NULL;
+    AVLNode<Key, Value>* rest = NULL;
+    int leftHeight = 0;
+    int restHeight = 0;
+    AVLNode<Key, Value>* found = splitKey(top, key, left, leftHeight, rest, restHeight);
+    if (found != NULL){
+        int height = 0;
+        rest = join(NULL, 0, found, rest, restHeight, height);
+    }
+    this -> root_ = left;
+    right.root_ = rest;
+    if (rest != NULL){
+        right.pool_.share(this -> pool_);
+    }
+
+    // the sizes of the halves are only known if one is empty, or from
+    // the subtree sizes; otherwise size() counts them when asked
+#ifdef AVL_ORDER_STATISTICS
+    this -> count_ = AVLNode<Key, Value>::sizeOf(left);
+    right.count_ = AVLNode<Key, Value>::sizeOf(rest);
+#else
+    if (rest == NULL){
+        right.count_ = 0;
+    } else if (left == NULL){
+        right.count_ = this -> count_;
+        this -> count_ = 0;
+    } else {
+        right.count_ = this -> unknownSize;
+        this -> count_ = this -> unknownSize;
+    }
+#endif
+    this -> refreshEnds();
+    right.refreshEnds();
+}
+
+/**
+* Appends pivot and then every item of right, leaving right empty. Throws
+* std::invalid_argument if pivot's key does not order after every key in
+* this tree and before every key in right.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::join(const std::pair<const Key, Value>& pivot, AVLTree& right)
+{
+    Node<Key, Value>* last = this -> getLargestNode();
+    Node<Key, Value>* first = right.getSmallestNode();
+    if ((last != NULL && !this -> keyLess(last -> getKey(), pivot.first)) ||
+        (first != NULL && !this -> keyLess(pivot.first, first -> getKey()))){
+        throw std::invalid_argument("Keys out of order");
+    }
+    AVLNode<Key, Value>* node = this -> template createNode<AVLNode<Key, Value> >(pivot.first, pivot.second,
+                                                                              static_cast<AVLNode<Key, Value>*>(NULL));
+    this -> pool_.absorb(right.pool_);
+
+    AVLNode<Key, Value>* left = static_cast<AVLNode<Key, Value>*>(this -> root_);
+    AVLNode<Key, Value>* rest = static_cast<AVLNode<Key, Value>*>(right.root_);
+    std::size_t count = this -> addSizes(this -> addSizes(this -> count_, right.count_), 1);
+    Node<Key, Value>* rightmost = (rest != NULL) ? right.rightmost_ : node;
+    this -> root_ = NULL;
+    right.detachAll();
+    int height = 0;
+    this -> root_ = join(left, subtreeHeight(left), node, rest, subtreeHeight(rest), height);
+    this -> count_ = count;
+    if (left == NULL){
+        this -> leftmost_ = node;
+    }
+    this -> rightmost_ = rightmost;
+}
+
+/**
+* Appends every item of right, leaving right empty. Throws
+* std::invalid_argument unless every key in this tree orders before
+* every key in right.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::join(AVLTree& right)
+{
+    if (&right == this){
+        return;
+    }
+    Node<Key, Value>* last = this -> getLargestNode();
+    Node<Key, Value>* first = right.getSmallestNode();
+    if (last != NULL && first != NULL && !this -> keyLess(last -> getKey(), first -> getKey())){
+        throw std::invalid_argument("Keys out of order");
+    }
+    this -> pool_.absorb(right.pool_);
+
+    AVLNode<Key, Value>* left = static_cast<AVLNode<Key, Value>*>(this -> root_);
+    AVLNode<Key, Value>* rest = static_cast<AVLNode<Key, Value>*>(right.root_);
+    std::size_t count = this -> addSizes(this -> count_, right.count_);
+    Node<Key, Value>* leftmost = (left != NULL) ? this -> leftmost_ : right.leftmost_;
+    Node<Key, Value>* rightmost = (rest != NULL) ? right.rightmost_ : this -> rightmost_;
+    this -> root_ = NULL;
+    right.detachAll();
+    int height = 0;
+    this -> root_ = concat(left, subtreeHeight(left), rest, subtreeHeight(rest), height);
+    this -> count_ = count;
+    this -> leftmost_ = leftmost;
+    this -> rightmost_ = rightmost;
+}
+
+/**
+* Adds every item of other, whose value wins where both trees hold a key,
+* and leaves other empty. Splits this tree around other's root, unites
+* the halves with other's subtrees and joins the results, which takes
+* O(m log(n/m + 1)) for trees of m <= n items.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::unite(AVLTree& other)
+{
+    if (&other == this){
+        return;
+    }
+    this -> pool_.absorb(other.pool_);
+    AVLNode<Key, Value>* a = static_cast<AVLNode<Key, Value>*>(this -> root_);
+    AVLNode<Key, Value>* b = static_cast<AVLNode<Key, Value>*>(other.root_);
+    std::size_t count = this -> addSizes(this -> count_, other.count_);
+    this -> root_ = NULL;
+    other.detachAll();
+
+    NodeList discard;
+    int height = 0;
+    this -> root_ = uniteNodes(a, subtreeHeight(a), b, subtreeHeight(b), height, forkLevels(), discard);
+    std::size_t freed = freeNodes(discard);
+    this -> count_ = (count == this -> unknownSize) ? count : count - freed;
+    this -> refreshEnds();
+}
+
+/**
+* Keeps only the items whose keys other also holds, with this tree's
+* values, and leaves other empty.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::intersect(AVLTree& other)
+{
+    if (&other == this){
+        return;
+    }
+    this -> pool_.absorb(other.pool_);
+    AVLNode<Key, Value>* a = static_cast<AVLNode<Key, Value>*>(this -> root_);
+    AVLNode<Key, Value>* b = static_cast<AVLNode<Key, Value>*>(other.root_);
+    std::size_t count = this -> addSizes(this -> count_, other.count_);
+    this -> root_ = NULL;
+    other.detachAll();
+
+    NodeList discard;
+    int height = 0;
+    this -> root_ = intersectNodes(a, b, subtreeHeight(b), height, forkLevels(), discard);
+    std::size_t freed = freeNodes(discard);
+    this -> count_ = (count == this -> unknownSize) ? count : count - freed;
+    this -> refreshEnds();
+}
+
+/**
+* Removes every item whose key other holds, and leaves other empty.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::subtract(AVLTree& other)
+{
+    if (&other == this){
+        this -> clear();
+        return;
+    }
+    this -> pool_.absorb(other.pool_);
+    AVLNode<Key, Value>* a = static_cast<AVLNode<Key, Value>*>(this -> root_);
+    AVLNode<Key, Value>* b = static_cast<AVLNode<Key, Value>*>(other.root_);
+    std::size_t count = this -> addSizes(this -> count_, other.count_);
+    this -> root_ = NULL;
+    other.detachAll();
+
+    NodeList discard;
+    int height = 0;
+    this -> root_ = subtractNodes(a, subtreeHeight(a), b, subtreeHeight(b), height, forkLevels(), discard);
+    std::size_t freed = freeNodes(discard);
+    this -> count_ = (count == this -> unknownSize) ? count : count - freed;
+    this -> refreshEnds();
+}
+
+/**
+* Inserts every key/value pair of [first, last), overwriting the values
+* of keys already in the tree. The batch is put in key order (a stable
+* sort, skipped if it is already sorted). A batch large next to the tree
+* is merged with the tree's in-order node list and the lot relinked
+* perfectly balanced, in O(n + m) with no rotations. A smaller one is
+* linked into a balanced tree of its own and united with this one, as
+* unite does, in O(m log(n/m + 1)) with one join per batch node.
+*/
+template<class Key, class Value, class Compare>
+template<typename ForwardIterator>
+void AVLTree<Key, Value, Compare>::insert_batch(ForwardIterator first, ForwardIterator last)
+{
+    std::vector<ForwardIterator> items;
+    for (ForwardIterator it = first; it != last; ++it){
+        items.push_back(it);
+    }
+    auto byKey = [this](const ForwardIterator& a, const ForwardIterator& b){
+        return this -> keyLess(a -> first, b -> first);
+    };
+    if (!std::is_sorted(items.begin(), items.end(), byKey)){
+        std::stable_sort(items.begin(), items.end(), byKey);
+    }
+
+    if (preferRebuild(items.size())){
+        // merge the batch with the in-order node list, then relink
+        std::vector<AVLNode<Key, Value>*> nodes;
+        Node<Key, Value>* current = this -> getSmallestNode();
+        std::size_t i = 0;
+        try {
+            while (current != NULL || i < items.size()){
+                bool fromBatch = (i < items.size()) &&
+                                 (current == NULL || !this -> keyLess(current -> getKey(), items[i] -> first));
+                if (!fromBatch){
+                    nodes.push_back(static_cast<AVLNode<Key, Value>*>(current));
+                    current = this -> successor(current);
+                    continue;
+                }
+                // take the last of a run of equal keys
+                std::size_t last = i;
+                while (last + 1 < items.size() && !this -> keyLess(items[last] -> first, items[last + 1] -> first)){
+                    ++last;
+                }
+                if (current != NULL && !this -> keyLess(items[i] -> first, current -> getKey())){
+                    current -> setValue(items[last] -> second);
+                    nodes.push_back(static_cast<AVLNode<Key, Value>*>(current));
+                    current = this -> successor(current);
+                } else {
+                    nodes.push_back(this -> template createNode<AVLNode<Key, Value> >(
+                        items[last] -> first, items[last] -> second, static_cast<AVLNode<Key, Value>*>(NULL)));
+                }
+                i = last + 1;
+            }
+        } catch (...) {
+            // only the new nodes are unlinked
+            for (std::size_t j = 0; j < nodes.size(); ++j){
+                if (nodes[j] -> getParent() == NULL && nodes[j] != this -> root_ &&
+                    nodes[j] -> getLeft() == NULL && nodes[j] -> getRight() == NULL){
+                    this -> destroyNode(nodes[j]);
+                }
+            }
+            throw;
+        }
+        int height = 0;
+        this -> root_ = linkBalanced(nodes.data(), nodes.size(), NULL, height);
+        this -> count_ = nodes.size();
+        this -> refreshEnds();
+        return;
+    }
+
+    // the last of each run of equal keys wins, as above
+    std::vector<AVLNode<Key, Value>*> batch;
+    try {
+        for (std::size_t i = 0; i < items.size(); ++i){
+            if (i + 1 < items.size() && !this -> keyLess(items[i] -> first, items[i + 1] -> first)){
+                continue;
+            }
+            batch.push_back(this -> template createNode<AVLNode<Key, Value> >(
+                items[i] -> first, items[i] -> second, static_cast<AVLNode<Key, Value>*>(NULL)));
+        }
+    } catch (...) {
+        for (std::size_t j = 0; j < batch.size(); ++j){
+            this -> destroyNode(batch[j]);
+        }
+        throw;
+    }
+    int bHeight = 0;
+    AVLNode<Key, Value>* b = linkBalanced(batch.data(), batch.size(), NULL, bHeight);
+    AVLNode<Key, Value>* a = static_cast<AVLNode<Key, Value>*>(this -> root_);
+    std::size_t count = this -> addSizes(this -> count_, batch.size());
+    this -> root_ = NULL;
+
+    NodeList discard;
+    int height = 0;
+    this -> root_ = uniteNodes(a, subtreeHeight(a), b, bHeight, height, forkLevels(), discard);
+    std::size_t freed = freeNodes(discard);
+    this -> count_ = (count == this -> unknownSize) ? count : count - freed;
+    this -> refreshEnds();
+}
+
+/**
+* Removes every key of [first, last) that is in the tree; the keys may
+* come in any order and repeat. Like insert_batch, the keys are sorted,
+* and a large batch is dropped from the in-order node list before the
+* rest is relinked. A smaller one is taken out as subtract does, with
+* the sorted keys standing in for the other tree.
+*/
+template<class Key, class Value, class Compare>
+template<typename ForwardIterator>
+void AVLTree<Key, Value, Compare>::remove_batch(ForwardIterator first, ForwardIterator last)
+{
+    std::vector<Key> keys(first, last);
+    if (!std::is_sorted(keys.begin(), keys.end(), this -> compare_)){
+        std::sort(keys.begin(), keys.end(), this -> compare_);
+    }
+
+    if (preferRebuild(keys.size())){
+        // drop the batch's keys from the in-order node list, then relink
+        std::vector<AVLNode<Key, Value>*> nodes;
+        std::vector<AVLNode<Key, Value>*> removed;
+        std::size_t i = 0;
+        for (Node<Key, Value>* current = this -> getSmallestNode(); current != NULL;
+             current = this -> successor(current)){
+            while (i < keys.size() && this -> keyLess(keys[i], current -> getKey())){
+                ++i;
+            }
+            if (i < keys.size() && !this -> keyLess(current -> getKey(), keys[i])){
+                removed.push_back(static_cast<AVLNode<Key, Value>*>(current));
+            } else {
+                nodes.push_back(static_cast<AVLNode<Key, Value>*>(current));
+            }
+        }
+        int height = 0;
+        this -> root_ = linkBalanced(nodes.data(), nodes.size(), NULL, height);
+        this -> count_ = nodes.size();
+        this -> refreshEnds();
+        for (std::size_t j = 0; j < removed.size(); ++j){
+            this -> destroyNode(removed[j]);
+        }
+        return;
+    }
+
+    keys.erase(std::unique(keys.begin(), keys.end(),
+                           [this](const Key& a, const Key& b){ return !this -> keyLess(a, b); }),
+               keys.end());
+    AVLNode<Key, Value>* a = static_cast<AVLNode<Key, Value>*>(this -> root_);
+    std::size_t count = this -> count_;
+    this -> root_ = NULL;
+
+    NodeList discard;
+    int height = 0;
+    this -> root_ = subtractKeys(a, subtreeHeight(a), keys.data(), keys.size(), height, forkLevels(), discard);
+    std::size_t freed = freeNodes(discard);
+    this -> count_ = (count == this -> unknownSize) ? count : count - freed;
+    this -> refreshEnds();
+}
+
+/**
+* Whether a batch of batchSize keys is better merged by relinking the
+* whole tree, in O(n + m), than by splitting and joining around each
+* batch key. That pays once the batch is more than a few percent of the
+* tree.
+*/
+template<class Key, class Value, class Compare>
+bool AVLTree<Key, Value, Compare>::preferRebuild(std::size_t batchSize) const
+{
+    return batchSize >= this -> size() / rebuildShare;
+}
+
+/**
+* Links the count nodes at nodes, in key order, into a perfectly balanced
+* subtree under parent, as buildBalanced does for new nodes.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key,Value>* AVLTree<Key, Value, Compare>::linkBalanced(AVLNode<Key,Value>** nodes, std::size_t count,
+                                                              AVLNode<Key,Value>* parent, int& height)
+{
+    if (count == 0){
+        height = 0;
+        return NULL;
+    }
+    std::size_t leftCount = (count - 1) / 2;
+    AVLNode<Key, Value>* node = nodes[leftCount];
+    int leftHeight = 0;
+    int rightHeight = 0;
+    AVLNode<Key, Value>* left = linkBalanced(nodes, leftCount, node, leftHeight);
+    AVLNode<Key, Value>* right = linkBalanced(nodes + leftCount + 1, count - 1 - leftCount, node, rightHeight);
+    node -> setParent(parent);
+    node -> setLeft(left);
+    node -> setRight(right);
+    node -> setBalance(static_cast<int8_t>(rightHeight - leftHeight));
+#ifdef AVL_ORDER_STATISTICS
+    node -> setSize(count);
+#endif
+    height = std::max(leftHeight, rightHeight) + 1;
+    return node;
+}
+
+/**
+* Returns the height of the subtree at n (0 if empty), following the
+* taller child down.
+*/
+template<class Key, class Value, class Compare>
+int AVLTree<Key, Value, Compare>::subtreeHeight(AVLNode<Key,Value>* n)
+{
+    int height = 0;
+    while (n != NULL){
+        ++height;
+        n = (n -> getBalance() < 0) ? n -> getLeft() : n -> getRight();
+    }
+    return height;
+}
+
+/**
+* Rotates n, whose balance is +/-2, back into shape and sets top to the
+* new root of its subtree. Returns true if the subtree came out one
+* shorter than it was, which is every case but a single rotation over a
+* child with balance 0.
+*/
+template<class Key, class Value, class Compare>
+bool AVLTree<Key, Value, Compare>::rebalance(AVLNode<Key,Value>* n, AVLNode<Key,Value>*& top)
+{
+    if (n -> getBalance() == 2){
+        AVLNode<Key, Value>* c = n -> getRight();
+        if (c -> getBalance() == -1){
+            AVLNode<Key, Value>* g = c -> getLeft();
+            rotateRight(c);
+            rotateLeft(n);
+            n -> setBalance((g -> getBalance() == 1) ? -1 : 0);
+            c -> setBalance((g -> getBalance() == -1) ? 1 : 0);
+            g -> setBalance(0);
+            top = g;
+            return true;
+        }
+        rotateLeft(n);
+        top = c;
+        if (c -> getBalance() == 0){
+            n -> setBalance(1);
+            c -> setBalance(-1);
+            return false;
+        }
+        n -> setBalance(0);
+        c -> setBalance(0);
+        return true;
+    }
+
+    AVLNode<Key, Value>* c = n -> getLeft();
+    if (c -> getBalance() == 1){
+        AVLNode<Key, Value>* g = c -> getRight();
+        rotateLeft(c);
+        rotateRight(n);
+        n -> setBalance((g -> getBalance() == -1) ? 1 : 0);
+        c -> setBalance((g -> getBalance() == 1) ? -1 : 0);
+        g -> setBalance(0);
+        top = g;
+        return true;
+    }
+    rotateRight(n);
+    top = c;
+    if (c -> getBalance() == 0){
+        n -> setBalance(-1);
+        c -> setBalance(1);
+        return false;
+    }
+    n -> setBalance(0);
+    c -> setBalance(0);
+    return true;
+}
+
+/**
+* Retraces after the subtree at n got one taller, rotating where needed.
+* Unlike insertFix, n may have balance 0. Returns true if the growth
+* reached the top of the tree.
+*/
+template<class Key, class Value, class Compare>
+bool AVLTree<Key, Value, Compare>::growFix(AVLNode<Key,Value>* n)
+{
+    for (AVLNode<Key, Value>* p = n -> getParent(); p != NULL; p = n -> getParent()){
+        p -> updateBalance((n == p -> getLeft()) ? -1 : 1);
+        if (p -> getBalance() == 0){
+            return false;
+        }
+        if (p -> getBalance() == 1 || p -> getBalance() == -1){
+            n = p;
+            continue;
+        }
+        if (rebalance(p, n)){
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+* Joins left, pivot and right, where every key in left orders before
+* pivot's and every key in right after it, into one AVL subtree, and
+* returns its top. pivot is hung off the inner spine of the taller side
+* where the heights meet, and the tree retraced from there, which takes
+* O(|leftHeight - rightHeight| + 1).
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key,Value>* AVLTree<Key, Value, Compare>::join(AVLNode<Key,Value>* left, int leftHeight,
+                                                      AVLNode<Key,Value>* pivot,
+                                                      AVLNode<Key,Value>* right, int rightHeight,
+                                                      int& height)
+{
+    bool intoLeft = leftHeight > rightHeight + 1;
+    bool intoRight = rightHeight > leftHeight + 1;
+    AVLNode<Key, Value>* top = intoLeft ? left : right;
+    int topHeight = intoLeft ? leftHeight : rightHeight;
+    AVLNode<Key, Value>* parent = NULL;
+    if (intoLeft){
+        // walk down the right spine of left to a subtree at most one
+        // taller than right; pivot takes its place
+        while (leftHeight > rightHeight + 1){
+            parent = (parent == NULL) ? top : parent -> getRight();
+            leftHeight -= (parent -> getBalance() < 0) ? 2 : 1;
+        }
+        left = parent -> getRight();
+    } else if (intoRight){
+        while (rightHeight > leftHeight + 1){
+            parent = (parent == NULL) ? top : parent -> getLeft();
+            rightHeight -= (parent -> getBalance() > 0) ? 2 : 1;
+        }
+        right = parent -> getLeft();
+    }
+
+    pivot -> setLeft(left);
+    if (left != NULL){
+        left -> setParent(pivot);
+    }
+    pivot -> setRight(right);
+    if (right != NULL){
+        right -> setParent(pivot);
+    }
+    pivot -> setBalance(static_cast<int8_t>(rightHeight - leftHeight));
+    pivot -> setParent(parent);
+#ifdef AVL_ORDER_STATISTICS
+    pivot -> updateSize();
+#endif
+    if (parent == NULL){
+        height = std::max(leftHeight, rightHeight) + 1;
+        return pivot;
+    }
+
+    if (intoLeft){
+        parent -> setRight(pivot);
+    } else {
+        parent -> setLeft(pivot);
+    }
+#ifdef AVL_ORDER_STATISTICS
+    for (AVLNode<Key, Value>* p = parent; p != NULL; p = p -> getParent()){
+        p -> updateSize();
+    }
+#endif
+
+    // pivot's subtree is one taller than the one it replaced; a rotation
+    // at the top pushes the old top down one level
+    height = topHeight + (growFix(pivot) ? 1 : 0);
+    return (top -> getParent() != NULL) ? top -> getParent() : top;
+}
+
+/**
+* Joins left and right, where every key in left orders before every key
+* in right, using the smallest node of right as the pivot.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key,Value>* AVLTree<Key, Value, Compare>::concat(AVLNode<Key,Value>* left, int leftHeight,
+                                                        AVLNode<Key,Value>* right, int rightHeight,
+                                                        int& height)
+{
+    if (left == NULL){
+        height = rightHeight;
+        return right;
+    }
+    if (right == NULL){
+        height = leftHeight;
+        return left;
+    }
+
+    AVLNode<Key, Value>* first = right;
+    while (first -> getLeft() != NULL){
+        first = first -> getLeft();
+    }
+    AVLNode<Key, Value>* none = NULL;
+    int noneHeight = 0;
+    splitAt(right, first, false, none, noneHeight, right, rightHeight);
+    return join(left, leftHeight, first, right, rightHeight, height);
+}
+
+/**
+* Splits the detached tree at top into the nodes before x and those
+* after it, with x itself heading the right part if keepX is set and
+* left detached otherwise. Everything goes left if x is NULL. Walks up
+* from x, joining each ancestor and its other subtree onto the side it
+* belongs to; the joins add up to O(log n).
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::splitAt(AVLNode<Key,Value>* top, AVLNode<Key,Value>* x, bool keepX,
+                                         AVLNode<Key,Value>*& left, int& leftHeight,
+                                         AVLNode<Key,Value>*& right, int& rightHeight)
+{
+    if (x == NULL){
+        left = top;
+        leftHeight = subtreeHeight(top);
+        right = NULL;
+        rightHeight = 0;
+        return;
+    }
+
+    // x heads the right part; its left subtree is all of the left part so far
+    int height = subtreeHeight(x);
+    AVLNode<Key, Value>* parent = x -> getParent();
+    AVLNode<Key, Value>* xRight = x -> getRight();
+    int xRightHeight = height - ((x -> getBalance() < 0) ? 2 : 1);
+    left = x -> getLeft();
+    leftHeight = height - ((x -> getBalance() > 0) ? 2 : 1);
+    if (left != NULL){
+        left -> setParent(NULL);
+    }
+    if (xRight != NULL){
+        xRight -> setParent(NULL);
+    }
+    if (keepX){
+        right = join(NULL, 0, x, xRight, xRightHeight, rightHeight);
+    } else {
+        right = xRight;
+        rightHeight = xRightHeight;
+        x -> setParent(NULL);
+        x -> setLeft(NULL);
+        x -> setRight(NULL);
+    }
+
+    AVLNode<Key, Value>* child = x;
+    while (parent != NULL){
+        // read everything off parent before join relinks it
+        AVLNode<Key, Value>* next = parent -> getParent();
+        bool fromRight = (child == parent -> getRight());
+        int8_t balance = parent -> getBalance();
+        int parentHeight = height + ((fromRight ? balance >= 0 : balance <= 0) ? 1 : 2);
+        AVLNode<Key, Value>* sibling = fromRight ? parent -> getLeft() : parent -> getRight();
+        int siblingHeight = parentHeight - ((fromRight ? balance <= 0 : balance >= 0) ? 1 : 2);
+        if (sibling != NULL){
+            sibling -> setParent(NULL);
+        }
+
+        if (fromRight){
+            left = join(sibling, siblingHeight, parent, left, leftHeight, leftHeight);
+        } else {
+            right = join(right, rightHeight, parent, sibling, siblingHeight, rightHeight);
+        }
+        child = parent;
+        height = parentHeight;
+        parent = next;
+    }
+}
+
+/**
+* Splits the detached tree at top around key: left gets the keys before
+* it and right the keys after it. The node holding key, if any, is
+* detached and returned.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key,Value>* AVLTree<Key, Value, Compare>::splitKey(AVLNode<Key,Value>* top, const Key& key,
+                                                          AVLNode<Key,Value>*& left, int& leftHeight,
+                                                          AVLNode<Key,Value>*& right, int& rightHeight)
+{
+    // lower bound of key, keeping only the last candidate as in lowerBoundNode
+    AVLNode<Key, Value>* bound = NULL;
+    for (AVLNode<Key, Value>* temp = top; temp != NULL; ){
+        if (this -> keyLess(temp -> getKey(), key)){
+            temp = temp -> getRight();
+        } else {
+            bound = temp;
+            temp = temp -> getLeft();
+        }
+    }
+    bool found = (bound != NULL && !this -> keyLess(key, bound -> getKey()));
+    splitAt(top, bound, !found, left, leftHeight, right, rightHeight);
+    return found ? bound : NULL;
+}
+
+/**
+* How many levels of a set operation may fork: enough for one thread per
+* hardware thread. Building with -DAVL_FORK_THREADS=n plans for n threads
+* instead, so tests reach the parallel path on any machine.
+*/
+template<class Key, class Value, class Compare>
+int AVLTree<Key, Value, Compare>::forkLevels()
+{
+#ifdef AVL_FORK_THREADS
+    unsigned int threads = AVL_FORK_THREADS;
+#else
+    unsigned int threads = std::thread::hardware_concurrency();
+#endif
+    int levels = 0;
+    while ((1u << levels) < threads){
+        ++levels;
+    }
+    return levels;
+}
+
+/**
+* Runs left on a new thread and right on this one if fork is set,
+* falling back to running both here if no thread can be started.
+*/
+template<typename LeftTask, typename RightTask>
+void avlForkJoin(bool fork, LeftTask left, RightTask right)
+{
+    std::thread worker;
+    if (fork){
+        try {
+            worker = std::thread(left);
+        } catch (const std::system_error&){
+            // no thread to be had; do the work here
+        }
+    }
+    if (!worker.joinable()){
+        left();
+    }
+    right();
+    if (worker.joinable()){
+        worker.join();
+    }
+}
+
+/**
+* Unites the detached trees at a and b, with b's items winning ties,
+* and returns the top of the result. b's root becomes the pivot.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key,Value>* AVLTree<Key, Value, Compare>::uniteNodes(AVLNode<Key,Value>* a, int aHeight,
+                                                            AVLNode<Key,Value>* b, int bHeight,
+                                                            int& height, int forks, NodeList& discard)
+{
+    if (a == NULL){
+        height = bHeight;
+        return b;
+    }
+    if (b == NULL){
+        height = aHeight;
+        return a;
+    }
+
+    AVLNode<Key, Value>* bLeft = b -> getLeft();
+    AVLNode<Key, Value>* bRight = b -> getRight();
+    int bLeftHeight = bHeight - ((b -> getBalance() > 0) ? 2 : 1);
+    int bRightHeight = bHeight - ((b -> getBalance() < 0) ? 2 : 1);
+    if (bLeft != NULL){
+        bLeft -> setParent(NULL);
+    }
+    if (bRight != NULL){
+        bRight -> setParent(NULL);
+    }
+
+    AVLNode<Key, Value>* aLeft = NULL;
+    AVLNode<Key, Value>* aRight = NULL;
+    int aLeftHeight = 0;
+    int aRightHeight = 0;
+    AVLNode<Key, Value>* found = splitKey(a, b -> getKey(), aLeft, aLeftHeight, aRight, aRightHeight);
+    if (found != NULL){
+        discard.push_back(found);
+    }
+
+    AVLNode<Key, Value>* left = NULL;
+    AVLNode<Key, Value>* right = NULL;
+    int leftHeight = 0;
+    int rightHeight = 0;
+    NodeList leftDiscard;
+    bool fork = forks > 0 && aLeftHeight >= parallelHeight && bLeftHeight >= parallelHeight;
+    avlForkJoin(fork,
+        [&]{ left = uniteNodes(aLeft, aLeftHeight, bLeft, bLeftHeight, leftHeight, forks - 1, leftDiscard); },
+        [&]{ right = uniteNodes(aRight, aRightHeight, bRight, bRightHeight, rightHeight, forks - 1, discard); });
+    discard.insert(discard.end(), leftDiscard.begin(), leftDiscard.end());
+    return join(left, leftHeight, b, right, rightHeight, height);
+}
+
+/**
+* Intersects the detached trees at a and b, keeping a's items, and
+* returns the top of the result. Every node of b is discarded.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key,Value>* AVLTree<Key, Value, Compare>::intersectNodes(AVLNode<Key,Value>* a,
+                                                                AVLNode<Key,Value>* b, int bHeight,
+                                                                int& height, int forks, NodeList& discard)
+{
+    if (a == NULL || b == NULL){
+        if (a != NULL){
+            discard.push_back(a);
+        }
+        if (b != NULL){
+            discard.push_back(b);
+        }
+        height = 0;
+        return NULL;
+    }
+
+    AVLNode<Key, Value>* bLeft = b -> getLeft();
+    AVLNode<Key, Value>* bRight = b -> getRight();
+    int bLeftHeight = bHeight - ((b -> getBalance() > 0) ? 2 : 1);
+    int bRightHeight = bHeight - ((b -> getBalance() < 0) ? 2 : 1);
+    if (bLeft != NULL){
+        bLeft -> setParent(NULL);
+    }
+    if (bRight != NULL){
+        bRight -> setParent(NULL);
+    }
+    b -> setLeft(NULL);
+    b -> setRight(NULL);
+    discard.push_back(b);
+
+    AVLNode<Key, Value>* aLeft = NULL;
+    AVLNode<Key, Value>* aRight = NULL;
+    int aLeftHeight = 0;
+    int aRightHeight = 0;
+    AVLNode<Key, Value>* found = splitKey(a, b -> getKey(), aLeft, aLeftHeight, aRight, aRightHeight);
+
+    AVLNode<Key, Value>* left = NULL;
+    AVLNode<Key, Value>* right = NULL;
+    int leftHeight = 0;
+    int rightHeight = 0;
+    NodeList leftDiscard;
+    bool fork = forks > 0 && aLeftHeight >= parallelHeight && bLeftHeight >= parallelHeight;
+    avlForkJoin(fork,
+        [&]{ left = intersectNodes(aLeft, bLeft, bLeftHeight, leftHeight, forks - 1, leftDiscard); },
+        [&]{ right = intersectNodes(aRight, bRight, bRightHeight, rightHeight, forks - 1, discard); });
+    discard.insert(discard.end(), leftDiscard.begin(), leftDiscard.end());
+    if (found != NULL){
+        return join(left, leftHeight, found, right, rightHeight, height);
+    }
+    return concat(left, leftHeight, right, rightHeight, height);
+}
+
+/**
+* Removes the keys of the detached tree at b from the one at a and
+* returns the top of the result. Every node of b is discarded.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key,Value>* AVLTree<Key, Value, Compare>::subtractNodes(AVLNode<Key,Value>* a, int aHeight,
+                                                               AVLNode<Key,Value>* b, int bHeight,
+                                                               int& height, int forks, NodeList& discard)
+{
+    if (a == NULL || b == NULL){
+        if (b != NULL){
+            discard.push_back(b);
+        }
+        height = aHeight;
+        return a;
+    }
+
+    AVLNode<Key, Value>* bLeft = b -> getLeft();
+    AVLNode<Key, Value>* bRight = b -> getRight();
+    int bLeftHeight = bHeight - ((b -> getBalance() > 0) ? 2 : 1);
+    int bRightHeight = bHeight - ((b -> getBalance() < 0) ? 2 : 1);
+    if (bLeft != NULL){
+        bLeft -> setParent(NULL);
+    }
+    if (bRight != NULL){
+        bRight -> setParent(NULL);
+    }
+    b -> setLeft(NULL);
+    b -> setRight(NULL);
+    discard.push_back(b);
+
+    AVLNode<Key, Value>* aLeft = NULL;
+    AVLNode<Key, Value>* aRight = NULL;
+    int aLeftHeight = 0;
+    int aRightHeight = 0;
+    AVLNode<Key, Value>* found = splitKey(a, b -> getKey(), aLeft, aLeftHeight, aRight, aRightHeight);
+    if (found != NULL){
+        discard.push_back(found);
+    }
+
+    AVLNode<Key, Value>* left = NULL;
+    AVLNode<Key, Value>* right = NULL;
+    int leftHeight = 0;
+    int rightHeight = 0;
+    NodeList leftDiscard;
+    bool fork = forks > 0 && aLeftHeight >= parallelHeight && bLeftHeight >= parallelHeight;
+    avlForkJoin(fork,
+        [&]{ left = subtractNodes(aLeft, aLeftHeight, bLeft, bLeftHeight, leftHeight, forks - 1, leftDiscard); },
+        [&]{ right = subtractNodes(aRight, aRightHeight, bRight, bRightHeight, rightHeight, forks - 1, discard); });
+    discard.insert(discard.end(), leftDiscard.begin(), leftDiscard.end());
+    return concat(left, leftHeight, right, rightHeight, height);
+}
+
+/**
+* subtractNodes for remove_batch: removes the count sorted, distinct keys
+* at keys from the detached tree at a. The middle key plays the part of
+* b's root.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key,Value>* AVLTree<Key, Value, Compare>::subtractKeys(AVLNode<Key,Value>* a, int aHeight,
+                                                              const Key* keys, std::size_t count,
+                                                              int& height, int forks, NodeList& discard)
+{
+    if (a == NULL || count == 0){
+        height = aHeight;
+        return a;
+    }
+
+    std::size_t mid = count / 2;
+    AVLNode<Key, Value>* aLeft = NULL;
+    AVLNode<Key, Value>* aRight = NULL;
+    int aLeftHeight = 0;
+    int aRightHeight = 0;
+    AVLNode<Key, Value>* found = splitKey(a, keys[mid], aLeft, aLeftHeight, aRight, aRightHeight);
+    if (found != NULL){
+        discard.push_back(found);
+    }
+
+    AVLNode<Key, Value>* left = NULL;
+    AVLNode<Key, Value>* right = NULL;
+    int leftHeight = 0;
+    int rightHeight = 0;
+    NodeList leftDiscard;
+    bool fork = forks > 0 && aLeftHeight >= parallelHeight && (mid >> parallelHeight) != 0;
+    avlForkJoin(fork,
+        [&]{ left = subtractKeys(aLeft, aLeftHeight, keys, mid, leftHeight, forks - 1, leftDiscard); },
+        [&]{ right = subtractKeys(aRight, aRightHeight, keys + mid + 1, count - mid - 1, rightHeight,
+                                  forks - 1, discard); });
+    discard.insert(discard.end(), leftDiscard.begin(), leftDiscard.end());
+    return concat(left, leftHeight, right, rightHeight, height);
+}
+
+/**
+* Frees the subtrees a set operation left over, once the threads are done,
+* and returns how many nodes they held.
+*/
+template<class Key, class Value, class Compare>
+std::size_t AVLTree<Key, Value, Compare>::freeNodes(NodeList& discard)
+{
+    std::size_t freed = 0;
+    for (std::size_t i = 0; i < discard.size(); ++i){
+        freed += this -> recursiveClear(discard[i]);
+    }
+    discard.clear();
+    return freed;
 }
 
 #endif
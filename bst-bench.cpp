@@ -0,0 +1,1050 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include "bst.h"
+#include "avlbst.h"
+#include "index_avl.h"
+#include "frozen_bst.h"
+#include "btree.h"
+#include "concurrent_avl.h"
+#include "persistent_avl.h"
+#include "sharded_map.h"
+
+using namespace std;
+
+// Micro-benchmarks for the search trees.
+// Usage: bst-bench [num keys]
+// (the frozen layouts are meant to be compared at 10M-100M keys)
+//
+// Build as bst-bench-nopool to get the same numbers with
+// plain per-node new/delete for comparison, and as
+// bst-bench-compact for AVLNodes with packed balance bits.
+
+typedef chrono::steady_clock Clock;
+
+static double msSince(Clock::time_point start)
+{
+    return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+static void report(const string& name, size_t ops, double ms)
+{
+    cout << left << setw(40) << name << right
+         << setw(10) << fixed << setprecision(1) << ms << " ms"
+         << setw(10) << setprecision(1) << (ops / ms / 1000.0) << " Mops/s" << endl;
+}
+
+static vector<uint64_t> randomKeys(size_t n, uint64_t seed)
+{
+    vector<uint64_t> keys(n);
+    for (size_t i = 0; i < n; ++i){
+        keys[i] = i;
+    }
+    shuffle(keys.begin(), keys.end(), mt19937_64(seed));
+    return keys;
+}
+
+// Measures bulk insert, insert/remove churn and teardown of one tree type.
+template<typename Tree>
+static void benchAllocation(const string& name, const vector<uint64_t>& keys)
+{
+    size_t n = keys.size();
+    Tree* tree = new Tree;
+
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < n; ++i){
+        tree -> insert(make_pair(keys[i], keys[i]));
+    }
+    report(name + " insert", n, msSince(start));
+
+    // remove half the keys and put them back, twice
+    start = Clock::now();
+    for (int round = 0; round < 2; ++round){
+        for (size_t i = 0; i < n; i += 2){
+            tree -> remove(keys[i]);
+        }
+        for (size_t i = 0; i < n; i += 2){
+            tree -> insert(make_pair(keys[i], keys[i]));
+        }
+    }
+    report(name + " remove/insert churn", 2 * n, msSince(start));
+
+    start = Clock::now();
+    delete tree;
+    report(name + " destroy", n, msSince(start));
+}
+
+// Exposes how much node memory a tree has reserved.
+template<typename Tree>
+struct MemoryProbe : public Tree
+{
+    size_t bytesReserved() const { return this -> pool_.bytesReserved(); }
+};
+
+template<typename Key, typename Value, size_t Fanout>
+struct MemoryProbe<BTree<Key, Value, Fanout> > : public BTree<Key, Value, Fanout>
+{
+    // leaves only; internal nodes add about 1/Fanout on top
+    size_t bytesReserved() const
+    {
+        size_t leaves = 0;
+        for (typename BTree<Key, Value, Fanout>::BTreeLeaf* leaf = this -> first_; leaf != NULL; leaf = leaf -> next_){
+            ++leaves;
+        }
+        return leaves * sizeof(typename BTree<Key, Value, Fanout>::BTreeLeaf);
+    }
+};
+
+template<typename Key, typename Value>
+struct MemoryProbe<IndexedAVLTree<Key, Value> > : public IndexedAVLTree<Key, Value>
+{
+    size_t bytesReserved() const
+    {
+        return this -> nodes_.capacity() * sizeof(typename IndexedAVLTree<Key, Value>::IndexedAVLNode);
+    }
+};
+
+// Measures random point lookups and one full in-order iteration.
+template<typename Tree>
+static void benchLookup(const string& name, const vector<uint64_t>& keys)
+{
+    size_t n = keys.size();
+    MemoryProbe<Tree> tree;
+    for (size_t i = 0; i < n; ++i){
+        tree.insert(make_pair(keys[i], keys[i]));
+    }
+    cout << left << setw(40) << (name + " bytes/entry") << right
+         << setw(10) << setprecision(1) << fixed << (double)tree.bytesReserved() / n << endl;
+    vector<uint64_t> probes = randomKeys(n, 2);
+
+    uint64_t sum = 0;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < n; ++i){
+        sum += tree.find(probes[i]) -> second;
+    }
+    report(name + " find", n, msSince(start));
+
+    start = Clock::now();
+    for (typename Tree::iterator it = tree.begin(); it != tree.end(); ++it){
+        sum += it -> second;
+    }
+    report(name + " iterate", n, msSince(start));
+
+    // keep the loops from being optimized away
+    if (sum == 42){
+        cout << "";
+    }
+}
+
+// A std::less stand-in that keeps trees on the two-way descent.
+// A key borrowed from some buffer, like a string_view.
+struct KeyRef
+{
+    const char* data;
+    size_t size;
+};
+
+static int compareBytes(const char* a, size_t aSize, const char* b, size_t bSize)
+{
+    int order = memcmp(a, b, min(aSize, bSize));
+    if (order != 0){
+        return order;
+    }
+    return (aSize < bSize) ? -1 : (aSize > bSize);
+}
+
+// Plain less-than on strings; transparent, so borrowed keys can be looked
+// up without building a string first.
+struct PlainLess
+{
+    typedef void is_transparent;
+    bool operator()(const string& a, const string& b) const { return a < b; }
+    bool operator()(const string& a, const KeyRef& b) const { return compareBytes(a.data(), a.size(), b.data, b.size) < 0; }
+    bool operator()(const KeyRef& a, const string& b) const { return compareBytes(a.data, a.size, b.data(), b.size()) < 0; }
+};
+
+// Compares string-key lookups with one compare() per level against the
+// plain less-than descent, and borrowed-key lookups that build a
+// temporary string against transparent ones.
+static void benchStringKeys(size_t n)
+{
+    vector<uint64_t> order = randomKeys(n, 5);
+    vector<string> keys(n);
+    for (size_t i = 0; i < n; ++i){
+        // a long shared prefix, as in paths or URLs
+        keys[i] = "/srv/data/shard/" + to_string(order[i]);
+    }
+    AVLTree<string, uint64_t> threeWay;
+    AVLTree<string, uint64_t, PlainLess> twoWay;
+    for (size_t i = 0; i < n; ++i){
+        threeWay.insert(make_pair(keys[i], i));
+        twoWay.insert(make_pair(keys[i], i));
+    }
+    vector<uint64_t> probes = randomKeys(n, 6);
+
+    uint64_t sum = 0;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < n; ++i){
+        sum += threeWay.find(keys[probes[i]]) -> second;
+    }
+    report("AVLTree<string> find (three-way)", n, msSince(start));
+
+    start = Clock::now();
+    for (size_t i = 0; i < n; ++i){
+        sum += twoWay.find(keys[probes[i]]) -> second;
+    }
+    report("AVLTree<string> find (less-than)", n, msSince(start));
+
+    vector<KeyRef> refs(n);
+    for (size_t i = 0; i < n; ++i){
+        refs[i].data = keys[probes[i]].data();
+        refs[i].size = keys[probes[i]].size();
+    }
+    start = Clock::now();
+    for (size_t i = 0; i < n; ++i){
+        sum += twoWay.find(string(refs[i].data, refs[i].size)) -> second;
+    }
+    report("AVLTree<string> find (temp string)", n, msSince(start));
+
+    start = Clock::now();
+    for (size_t i = 0; i < n; ++i){
+        sum += twoWay.find(refs[i]) -> second;
+    }
+    report("AVLTree<string> find (transparent)", n, msSince(start));
+
+    if (sum == 42){
+        cout << "";
+    }
+}
+
+// Loads an AVLTree with plain inserts, then with each insert hinted by the
+// iterator the previous one returned.
+static void benchHintedInsert(const string& order, const vector<uint64_t>& keys)
+{
+    size_t n = keys.size();
+    Clock::time_point start = Clock::now();
+    {
+        AVLTree<uint64_t, uint64_t> tree;
+        for (size_t i = 0; i < n; ++i){
+            tree.insert(make_pair(keys[i], keys[i]));
+        }
+        report("AVLTree insert (" + order + ")", n, msSince(start));
+    }
+
+    start = Clock::now();
+    {
+        AVLTree<uint64_t, uint64_t> tree;
+        AVLTree<uint64_t, uint64_t>::iterator hint = tree.end();
+        for (size_t i = 0; i < n; ++i){
+            hint = tree.insert(hint, make_pair(keys[i], keys[i]));
+        }
+        report("AVLTree hinted insert (" + order + ")", n, msSince(start));
+    }
+}
+
+// Erases every other block of width keys, with one remove per key and
+// with erase_range.
+static void benchRangeErase(const vector<uint64_t>& keys, uint64_t width)
+{
+    size_t n = keys.size();
+    size_t erased = 0;
+    Clock::time_point start = Clock::now();
+    {
+        AVLTree<uint64_t, uint64_t> tree;
+        for (size_t i = 0; i < n; ++i){
+            tree.insert(make_pair(keys[i], keys[i]));
+        }
+        start = Clock::now();
+        for (uint64_t lo = 0; lo + width <= n; lo += 2 * width){
+            for (uint64_t k = lo; k < lo + width; ++k){
+                tree.remove(k);
+                ++erased;
+            }
+        }
+        report("AVLTree remove loop (" + to_string(width) + "-key ranges)", erased, msSince(start));
+    }
+
+    {
+        AVLTree<uint64_t, uint64_t> tree;
+        for (size_t i = 0; i < n; ++i){
+            tree.insert(make_pair(keys[i], keys[i]));
+        }
+        start = Clock::now();
+        for (uint64_t lo = 0; lo + width <= n; lo += 2 * width){
+            tree.erase_range(lo, lo + width);
+        }
+        report("AVLTree erase_range (" + to_string(width) + "-key ranges)", erased, msSince(start));
+    }
+}
+
+// Evicts every item with an odd value during one scan: collecting the
+// keys and removing each with a search, against erase(iterator).
+static void benchEraseIf(const vector<uint64_t>& keys)
+{
+    size_t n = keys.size();
+    size_t erased = 0;
+    Clock::time_point start = Clock::now();
+    {
+        AVLTree<uint64_t, uint64_t> tree;
+        for (size_t i = 0; i < n; ++i){
+            tree.insert(make_pair(keys[i], i));
+        }
+        start = Clock::now();
+        vector<uint64_t> doomed;
+        for (AVLTree<uint64_t, uint64_t>::iterator it = tree.begin(); it != tree.end(); ++it){
+            if (it -> second % 2 == 1){
+                doomed.push_back(it -> first);
+            }
+        }
+        for (size_t i = 0; i < doomed.size(); ++i){
+            tree.remove(doomed[i]);
+        }
+        erased = doomed.size();
+        report("AVLTree scan + remove(key)", erased, msSince(start));
+    }
+
+    {
+        AVLTree<uint64_t, uint64_t> tree;
+        for (size_t i = 0; i < n; ++i){
+            tree.insert(make_pair(keys[i], i));
+        }
+        start = Clock::now();
+        for (AVLTree<uint64_t, uint64_t>::iterator it = tree.begin(); it != tree.end(); ){
+            if (it -> second % 2 == 1){
+                it = tree.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        report("AVLTree scan + erase(iterator)", erased, msSince(start));
+    }
+}
+
+// Counts keys drawn from n / 10 distinct values, the counter-service
+// pattern: find() then insert() on a miss or an update through the
+// iterator, against the inserting operator[] and upsert.
+static void benchCounters(const vector<uint64_t>& keys)
+{
+    size_t n = keys.size();
+    uint64_t distinct = n / 10 + 1;
+    uint64_t sums[3] = {0, 0, 0};
+    Clock::time_point start = Clock::now();
+    {
+        AVLTree<uint64_t, uint64_t> tree;
+        for (size_t i = 0; i < n; ++i){
+            uint64_t key = keys[i] % distinct;
+            AVLTree<uint64_t, uint64_t>::iterator it = tree.find(key);
+            if (it == tree.end()){
+                tree.insert(make_pair(key, (uint64_t)1));
+            } else {
+                ++it -> second;
+            }
+        }
+        report("AVLTree find + insert counting", n, msSince(start));
+        sums[0] = tree[keys[0] % distinct];
+    }
+
+    start = Clock::now();
+    {
+        AVLTree<uint64_t, uint64_t> tree;
+        for (size_t i = 0; i < n; ++i){
+            ++tree[keys[i] % distinct];
+        }
+        report("AVLTree operator[] counting", n, msSince(start));
+        sums[1] = tree[keys[0] % distinct];
+    }
+
+    start = Clock::now();
+    {
+        AVLTree<uint64_t, uint64_t> tree;
+        for (size_t i = 0; i < n; ++i){
+            tree.upsert(keys[i] % distinct, [](uint64_t& count) { ++count; });
+        }
+        report("AVLTree upsert counting", n, msSince(start));
+        sums[2] = tree[keys[0] % distinct];
+    }
+    if (sums[0] != sums[1] || sums[0] != sums[2]){
+        cout << "counting methods disagree" << endl;
+    }
+}
+
+// Latest-N queries: the 100 largest keys, read by copying the tree into
+// a vector and walking it backwards, against walking from rbegin().
+static void benchLatest(const vector<uint64_t>& keys)
+{
+    size_t n = keys.size();
+    size_t queries = 3;
+    size_t latest = 100;
+    uint64_t sums[2] = {0, 0};
+    AVLTree<uint64_t, uint64_t> tree;
+    for (size_t i = 0; i < n; ++i){
+        tree.insert(make_pair(keys[i], keys[i]));
+    }
+
+    Clock::time_point start = Clock::now();
+    for (size_t q = 0; q < queries; ++q){
+        vector<pair<uint64_t, uint64_t> > items(tree.begin(), tree.end());
+        for (size_t i = 0; i < latest && i < items.size(); ++i){
+            sums[0] += items[items.size() - 1 - i].second;
+        }
+    }
+    report("AVLTree latest-100 via vector copy", queries, msSince(start));
+
+    start = Clock::now();
+    for (size_t q = 0; q < queries; ++q){
+        AVLTree<uint64_t, uint64_t>::reverse_iterator it = tree.rbegin();
+        for (size_t i = 0; i < latest && it != tree.rend(); ++i, ++it){
+            sums[1] += it -> second;
+        }
+    }
+    report("AVLTree latest-100 via rbegin()", queries, msSince(start));
+    if (sums[0] != sums[1]){
+        cout << "reverse scan disagrees" << endl;
+    }
+}
+
+// Moves every other key of a hot tree into a cold one: remove and insert,
+// which frees the node and allocates a copy, against extract and insert
+// of the node itself; then merging the rest in with merge().
+static void benchMigration(const vector<uint64_t>& keys)
+{
+    size_t n = keys.size();
+    size_t moved = 0;
+    Clock::time_point start = Clock::now();
+    {
+        AVLTree<uint64_t, uint64_t> hot;
+        AVLTree<uint64_t, uint64_t> cold;
+        for (size_t i = 0; i < n; ++i){
+            hot.insert(make_pair(keys[i], keys[i]));
+        }
+        start = Clock::now();
+        for (size_t i = 0; i < n; i += 2){
+            AVLTree<uint64_t, uint64_t>::iterator it = hot.find(keys[i]);
+            cold.insert(make_pair(it -> first, it -> second));
+            hot.remove(keys[i]);
+            ++moved;
+        }
+        report("AVLTree remove + insert migration", moved, msSince(start));
+    }
+
+    {
+        AVLTree<uint64_t, uint64_t> hot;
+        AVLTree<uint64_t, uint64_t> cold;
+        for (size_t i = 0; i < n; ++i){
+            hot.insert(make_pair(keys[i], keys[i]));
+        }
+        start = Clock::now();
+        for (size_t i = 0; i < n; i += 2){
+            cold.insert(hot.extract(keys[i]));
+        }
+        report("AVLTree extract + insert migration", moved, msSince(start));
+
+        start = Clock::now();
+        cold.merge(hot);
+        report("AVLTree merge of the rest", n - moved, msSince(start));
+    }
+}
+
+// Drains a tree smallest key first, as a work queue does: begin() and
+// remove() with a search for the key, against pop_min().
+static void benchPopMin(const vector<uint64_t>& keys)
+{
+    size_t n = keys.size();
+    uint64_t sum = 0;
+    Clock::time_point start = Clock::now();
+    {
+        AVLTree<uint64_t, uint64_t> tree;
+        for (size_t i = 0; i < n; ++i){
+            tree.insert(make_pair(keys[i], keys[i]));
+        }
+        start = Clock::now();
+        while (!tree.empty()){
+            uint64_t key = tree.begin() -> first;
+            sum += key;
+            tree.remove(key);
+        }
+        report("AVLTree begin + remove drain", n, msSince(start));
+    }
+
+    {
+        AVLTree<uint64_t, uint64_t> tree;
+        for (size_t i = 0; i < n; ++i){
+            tree.insert(make_pair(keys[i], keys[i]));
+        }
+        start = Clock::now();
+        while (!tree.empty()){
+            sum -= tree.pop_min().first;
+        }
+        report("AVLTree pop_min drain", n, msSince(start));
+    }
+    if (sum != 0){
+        cout << "pop_min drained a different order" << endl;
+    }
+}
+
+// Interleaves updates with snapshots for a reader: copying an AVLTree
+// (in order, each insert hinted by the last) against taking a
+// PersistentAVLTree snapshot, which shares all but the changed paths.
+static void benchSnapshots(const vector<uint64_t>& keys)
+{
+    size_t n = keys.size();
+    size_t updates = n / 10;
+    size_t snapshots = 20;
+    uint64_t sum = 0;
+
+    Clock::time_point start = Clock::now();
+    {
+        PersistentAVLTree<uint64_t, uint64_t> tree;
+        for (size_t i = 0; i < n; ++i){
+            tree.insert(make_pair(keys[i], keys[i]));
+        }
+        report("PersistentAVLTree insert", n, msSince(start));
+    }
+
+    {
+        AVLTree<uint64_t, uint64_t> tree;
+        for (size_t i = 0; i < n; ++i){
+            tree.insert(make_pair(keys[i], keys[i]));
+        }
+        vector<AVLTree<uint64_t, uint64_t>*> copies;
+        start = Clock::now();
+        for (size_t i = 0; i < updates; ++i){
+            if (i % (updates / snapshots) == 0){
+                AVLTree<uint64_t, uint64_t>* copy = new AVLTree<uint64_t, uint64_t>;
+                AVLTree<uint64_t, uint64_t>::iterator hint = copy -> end();
+                for (AVLTree<uint64_t, uint64_t>::iterator it = tree.begin(); it != tree.end(); ++it){
+                    hint = copy -> insert(hint, *it);
+                }
+                copies.push_back(copy);
+            }
+            tree.insert(make_pair(keys[(i * 7919) % n], i));
+        }
+        report("AVLTree updates + full copies", updates, msSince(start));
+        for (size_t i = 0; i < copies.size(); ++i){
+            sum += copies[i] -> begin() -> second;
+            delete copies[i];
+        }
+    }
+
+    {
+        PersistentAVLTree<uint64_t, uint64_t> tree;
+        for (size_t i = 0; i < n; ++i){
+            tree.insert(make_pair(keys[i], keys[i]));
+        }
+        vector<PersistentAVLTree<uint64_t, uint64_t> > versions;
+        start = Clock::now();
+        for (size_t i = 0; i < updates; ++i){
+            if (i % (updates / snapshots) == 0){
+                versions.push_back(tree.snapshot());
+            }
+            tree.insert(make_pair(keys[(i * 7919) % n], i));
+        }
+        report("PersistentAVLTree updates + snapshots", updates, msSince(start));
+        for (size_t i = 0; i < versions.size(); ++i){
+            sum += versions[i].begin() -> second;
+        }
+    }
+
+    if (sum == 42){
+        cout << "";
+    }
+}
+
+// Adds the second half of keys to a tree holding the first half, then
+// removes the first half, in batches of batchSize: once with a call per
+// key and once with insert_batch/remove_batch per batch.
+static void benchBatches(const vector<uint64_t>& keys, size_t batchSize)
+{
+    size_t n = keys.size();
+    size_t half = n / 2;
+    string suffix = " (batches of " + to_string(batchSize) + ")";
+    double ms[2][2];
+    for (int batched = 0; batched < 2; ++batched){
+        AVLTree<uint64_t, uint64_t> tree;
+        for (size_t i = 0; i < half; ++i){
+            tree.insert(make_pair(keys[i], keys[i]));
+        }
+        vector<pair<const uint64_t, uint64_t> > items;
+        for (size_t i = half; i < n; ++i){
+            items.push_back(make_pair(keys[i], keys[i]));
+        }
+
+        Clock::time_point start = Clock::now();
+        for (size_t lo = 0; lo < items.size(); lo += batchSize){
+            size_t hi = min(lo + batchSize, items.size());
+            if (batched){
+                tree.insert_batch(items.begin() + lo, items.begin() + hi);
+            } else {
+                for (size_t i = lo; i < hi; ++i){
+                    tree.insert(items[i]);
+                }
+            }
+        }
+        ms[batched][0] = msSince(start);
+
+        start = Clock::now();
+        for (size_t lo = 0; lo < half; lo += batchSize){
+            size_t hi = min(lo + batchSize, half);
+            if (batched){
+                tree.remove_batch(keys.begin() + lo, keys.begin() + hi);
+            } else {
+                for (size_t i = lo; i < hi; ++i){
+                    tree.remove(keys[i]);
+                }
+            }
+        }
+        ms[batched][1] = msSince(start);
+    }
+    report("AVLTree insert loop" + suffix, n - half, ms[0][0]);
+    report("AVLTree insert_batch" + suffix, n - half, ms[1][0]);
+    report("AVLTree remove loop" + suffix, half, ms[0][1]);
+    report("AVLTree remove_batch" + suffix, half, ms[1][1]);
+    cout << left << setw(40) << "  speedup insert / remove" << right
+         << setw(10) << fixed << setprecision(2) << (ms[0][0] / ms[1][0]) << " x"
+         << setw(10) << (ms[0][1] / ms[1][1]) << " x" << endl;
+}
+
+// Fills a with the even multiples of 2 and b with the multiples of 3 taken
+// from keys, so a sixth of the keys are in both.
+static void fillOverlapping(const vector<uint64_t>& keys,
+                            AVLTree<uint64_t, uint64_t>& a, AVLTree<uint64_t, uint64_t>& b)
+{
+    for (size_t i = 0; i < keys.size(); ++i){
+        a.insert(make_pair(2 * keys[i], keys[i]));
+        b.insert(make_pair(3 * keys[i], keys[i]));
+    }
+}
+
+// Compares unite/intersect/subtract of two overlapping trees with doing
+// the same one key at a time.
+static void benchSetOperations(const vector<uint64_t>& keys)
+{
+    size_t n = keys.size();
+    for (int op = 0; op < 3; ++op){
+        const char* name = (op == 0) ? "union" : (op == 1) ? "intersection" : "difference";
+        double loopMs = 0;
+        double treeMs = 0;
+        {
+            AVLTree<uint64_t, uint64_t> a;
+            AVLTree<uint64_t, uint64_t> b;
+            fillOverlapping(keys, a, b);
+            Clock::time_point start = Clock::now();
+            if (op == 0){
+                for (AVLTree<uint64_t, uint64_t>::iterator it = b.begin(); it != b.end(); ++it){
+                    a.insert(*it);
+                }
+            } else if (op == 1){
+                vector<uint64_t> gone;
+                for (AVLTree<uint64_t, uint64_t>::iterator it = a.begin(); it != a.end(); ++it){
+                    if (b.find(it -> first) == b.end()){
+                        gone.push_back(it -> first);
+                    }
+                }
+                for (size_t i = 0; i < gone.size(); ++i){
+                    a.remove(gone[i]);
+                }
+            } else {
+                for (AVLTree<uint64_t, uint64_t>::iterator it = b.begin(); it != b.end(); ++it){
+                    a.remove(it -> first);
+                }
+            }
+            loopMs = msSince(start);
+        }
+        {
+            AVLTree<uint64_t, uint64_t> a;
+            AVLTree<uint64_t, uint64_t> b;
+            fillOverlapping(keys, a, b);
+            Clock::time_point start = Clock::now();
+            if (op == 0){
+                a.unite(b);
+            } else if (op == 1){
+                a.intersect(b);
+            } else {
+                a.subtract(b);
+            }
+            treeMs = msSince(start);
+        }
+        report(string("AVLTree ") + name + " key loop", 2 * n, loopMs);
+        report(string("AVLTree ") + name + " set op", 2 * n, treeMs);
+    }
+}
+
+// An AVLTree behind one mutex, the way a shared map is usually guarded.
+class LockedAVLTree
+{
+public:
+    bool find(uint64_t key, uint64_t& value)
+    {
+        lock_guard<mutex> lock(lock_);
+        AVLTree<uint64_t, uint64_t>::iterator it = tree_.find(key);
+        if (it == tree_.end()){
+            return false;
+        }
+        value = it -> second;
+        return true;
+    }
+    void insert(const pair<const uint64_t, uint64_t>& item)
+    {
+        lock_guard<mutex> lock(lock_);
+        tree_.insert(item);
+    }
+    void remove(uint64_t key)
+    {
+        lock_guard<mutex> lock(lock_);
+        tree_.remove(key);
+    }
+
+private:
+    mutex lock_;
+    AVLTree<uint64_t, uint64_t> tree_;
+};
+
+// Runs threads that each do ops random operations on keys below range,
+// readPercent of them lookups and the rest an even mix of inserts and
+// removes; returns the wall time.
+template<typename Tree>
+static double runMixedLoad(Tree& tree, int threads, size_t ops, uint64_t range, int readPercent)
+{
+    vector<thread> workers;
+    Clock::time_point start = Clock::now();
+    for (int t = 0; t < threads; ++t){
+        workers.push_back(thread([&tree, t, ops, range, readPercent]{
+            uint64_t state = 0x9E3779B97F4A7C15ull * (t + 1);
+            uint64_t sink = 0;
+            for (size_t i = 0; i < ops; ++i){
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                uint64_t key = (state >> 8) % range;
+                int roll = static_cast<int>(state % 100);
+                uint64_t value;
+                if (roll < readPercent){
+                    sink += tree.find(key, value) ? value : 0;
+                } else if ((roll - readPercent) % 2 == 0){
+                    tree.insert(make_pair(key, key));
+                } else {
+                    tree.remove(key);
+                }
+            }
+            if (sink == 1){
+                cout << "";
+            }
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); ++t){
+        workers[t].join();
+    }
+    return msSince(start);
+}
+
+// Compares the lock-free-reader ConcurrentAVLTree and a ShardedMap with
+// one shard per core against a mutex-guarded AVLTree at 90/10 and 50/50
+// read/write mixes as threads are added.
+static void benchConcurrent(const vector<uint64_t>& keys)
+{
+    size_t n = keys.size();
+    unsigned int cores = max(thread::hardware_concurrency(), 4u);
+    size_t opsPerThread = max<size_t>(n, 100000);
+    for (int readPercent = 90; readPercent >= 50; readPercent -= 40){
+        for (unsigned int threads = 1; threads <= cores; threads *= 2){
+            string mix = to_string(readPercent) + "/" + to_string(100 - readPercent) + ", " +
+                         to_string(threads) + " thr";
+            {
+                LockedAVLTree tree;
+                for (size_t i = 0; i < n; i += 2){
+                    tree.insert(make_pair(keys[i], keys[i]));
+                }
+                report("mutex AVLTree " + mix, threads * opsPerThread,
+                       runMixedLoad(tree, threads, opsPerThread, n, readPercent));
+            }
+            {
+                ConcurrentAVLTree<uint64_t, uint64_t> tree;
+                for (size_t i = 0; i < n; i += 2){
+                    tree.insert(make_pair(keys[i], keys[i]));
+                }
+                report("ConcurrentAVLTree " + mix, threads * opsPerThread,
+                       runMixedLoad(tree, threads, opsPerThread, n, readPercent));
+            }
+            {
+                ShardedMap<uint64_t, uint64_t> tree(cores);
+                for (size_t i = 0; i < n; i += 2){
+                    tree.insert(make_pair(keys[i], keys[i]));
+                }
+                report("ShardedMap " + mix, threads * opsPerThread,
+                       runMixedLoad(tree, threads, opsPerThread, n, readPercent));
+            }
+        }
+    }
+}
+
+#ifdef AVL_ORDER_STATISTICS
+// Compares k-th smallest queries through select() with walking from
+// begin(), and times rank() and distance().
+static void benchOrderStatistics(const vector<uint64_t>& keys)
+{
+    size_t n = keys.size();
+    AVLTree<uint64_t, uint64_t> tree;
+    for (size_t i = 0; i < n; ++i){
+        tree.insert(make_pair(keys[i], keys[i]));
+    }
+    vector<uint64_t> probes = randomKeys(n, 7);
+
+    // walking is O(k), so only a few percentiles
+    const size_t walks = 20;
+    uint64_t sum = 0;
+    Clock::time_point start = Clock::now();
+    for (size_t q = 0; q < walks; ++q){
+        AVLTree<uint64_t, uint64_t>::iterator it = tree.begin();
+        for (size_t k = q * n / walks; k > 0; --k){
+            ++it;
+        }
+        sum += it -> first;
+    }
+    report("AVLTree k-th key by walking", walks, msSince(start));
+
+    start = Clock::now();
+    for (size_t i = 0; i < n; ++i){
+        sum += tree.select(probes[i]) -> first;
+    }
+    report("AVLTree select", n, msSince(start));
+
+    start = Clock::now();
+    for (size_t i = 0; i < n; ++i){
+        sum += tree.rank(probes[i]);
+    }
+    report("AVLTree rank", n, msSince(start));
+
+    start = Clock::now();
+    AVLTree<uint64_t, uint64_t>::iterator first = tree.begin();
+    for (size_t i = 0; i < n; ++i){
+        sum += tree.distance(first, tree.find(probes[i]));
+    }
+    report("AVLTree find + distance", n, msSince(start));
+
+    if (sum == 42){
+        cout << "";
+    }
+}
+#endif
+
+// Compares loading an AVLTree one insert at a time with the bulk builds.
+static void benchBulkLoad(const vector<uint64_t>& keys)
+{
+    size_t n = keys.size();
+    vector<pair<uint64_t, uint64_t> > sorted(n);
+    for (size_t i = 0; i < n; ++i){
+        sorted[i] = make_pair((uint64_t)i, (uint64_t)i);
+    }
+    vector<pair<uint64_t, uint64_t> > shuffled(n);
+    for (size_t i = 0; i < n; ++i){
+        shuffled[i] = make_pair(keys[i], keys[i]);
+    }
+
+    Clock::time_point start = Clock::now();
+    {
+        AVLTree<uint64_t, uint64_t> tree;
+        for (size_t i = 0; i < n; ++i){
+            tree.insert(sorted[i]);
+        }
+        report("AVLTree sorted insert loop", n, msSince(start));
+    }
+
+    start = Clock::now();
+    {
+        AVLTree<uint64_t, uint64_t> tree(sorted.begin(), sorted.end());
+        report("AVLTree bulk build (sorted)", n, msSince(start));
+    }
+
+    start = Clock::now();
+    {
+        AVLTree<uint64_t, uint64_t> tree(shuffled.begin(), shuffled.end(), false);
+        report("AVLTree bulk build (sort first)", n, msSince(start));
+    }
+}
+
+// Compares BTree against AVLTree and std::map on insert, random lookup
+// and full iteration over the same keys.
+template<typename Tree>
+static void benchMap(const string& name, const vector<uint64_t>& keys, const vector<uint64_t>& probes)
+{
+    size_t n = keys.size();
+    Tree* tree = new Tree;
+
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < n; ++i){
+        tree -> insert(make_pair(keys[i], keys[i]));
+    }
+    report(name + " insert", n, msSince(start));
+
+    uint64_t sum = 0;
+    start = Clock::now();
+    for (size_t i = 0; i < n; ++i){
+        sum += tree -> find(probes[i]) -> second;
+    }
+    report(name + " find", n, msSince(start));
+
+    start = Clock::now();
+    for (typename Tree::iterator it = tree -> begin(); it != tree -> end(); ++it){
+        sum += it -> second;
+    }
+    report(name + " iterate", n, msSince(start));
+
+    delete tree;
+    if (sum == 42){
+        cout << "";
+    }
+}
+
+static void benchBTree(const vector<uint64_t>& keys)
+{
+    vector<uint64_t> probes = randomKeys(keys.size(), 4);
+    benchMap<AVLTree<uint64_t, uint64_t> >("AVLTree", keys, probes);
+    benchMap<map<uint64_t, uint64_t> >("std::map", keys, probes);
+    benchMap<BTree<uint64_t, uint64_t, 8> >("BTree<8>", keys, probes);
+    benchMap<BTree<uint64_t, uint64_t, 32> >("BTree<32>", keys, probes);
+    benchMap<BTree<uint64_t, uint64_t, 128> >("BTree<128>", keys, probes);
+}
+
+// Sums 'length' consecutive values starting at each probe key.
+template<typename Iterator>
+static uint64_t scanFrom(Iterator it, Iterator end, size_t length)
+{
+    uint64_t sum = 0;
+    for (size_t j = 0; j < length && it != end; ++j, ++it){
+        sum += it -> second;
+    }
+    return sum;
+}
+
+// Compares point lookups and range scans on a live AVLTree with its
+// frozen snapshots.
+static void benchFrozen(const vector<uint64_t>& keys)
+{
+    size_t n = keys.size();
+    AVLTree<uint64_t, uint64_t> tree;
+    for (size_t i = 0; i < n; ++i){
+        tree.insert(make_pair(keys[i], keys[i]));
+    }
+    vector<uint64_t> probes = randomKeys(n, 3);
+
+    Clock::time_point start = Clock::now();
+    EytzingerIndex<uint64_t, uint64_t> index = freeze(tree);
+    report("EytzingerIndex build", n, msSince(start));
+
+    uint64_t sum = 0;
+    start = Clock::now();
+    for (size_t i = 0; i < n; ++i){
+        sum += tree.find(probes[i]) -> second;
+    }
+    report("AVLTree find", n, msSince(start));
+
+    start = Clock::now();
+    for (size_t i = 0; i < n; ++i){
+        sum += *index.find(probes[i]);
+    }
+    report("EytzingerIndex find", n, msSince(start));
+
+    start = Clock::now();
+    VebIndex<uint64_t, uint64_t> veb = freezeVeb(tree);
+    report("VebIndex build", n, msSince(start));
+
+    start = Clock::now();
+    for (size_t i = 0; i < n; ++i){
+        sum += veb.find(probes[i]) -> second;
+    }
+    report("VebIndex find", n, msSince(start));
+
+    // n / 100 scans of 100 consecutive keys each
+    const size_t scanLength = 100;
+    size_t scans = n / scanLength;
+    start = Clock::now();
+    for (size_t i = 0; i < scans; ++i){
+        sum += scanFrom(tree.find(probes[i]), tree.end(), scanLength);
+    }
+    report("AVLTree range scan", scans * scanLength, msSince(start));
+
+    start = Clock::now();
+    for (size_t i = 0; i < scans; ++i){
+        sum += scanFrom(veb.lower_bound(probes[i]), veb.end(), scanLength);
+    }
+    report("VebIndex range scan", scans * scanLength, msSince(start));
+
+    if (sum == 42){
+        cout << "";
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n = 1000000;
+    if (argc > 1){
+        n = strtoull(argv[1], NULL, 10);
+    }
+#ifdef BST_NO_POOL
+    cout << "node allocation: per-node new/delete" << endl;
+#else
+    cout << "node allocation: NodePool" << endl;
+#endif
+#ifdef AVL_COMPACT_NODES
+    cout << "AVL balance: packed into parent pointer" << endl;
+#else
+    cout << "AVL balance: int8_t member" << endl;
+#endif
+#ifdef AVL_ORDER_STATISTICS
+    cout << "AVL subtree sizes: maintained" << endl;
+#endif
+    cout << n << " keys" << endl << endl;
+
+    cout << "sizeof(Node<uint64_t,uint64_t>)    = " << sizeof(Node<uint64_t, uint64_t>) << endl;
+    cout << "sizeof(AVLNode<uint64_t,uint64_t>) = " << sizeof(AVLNode<uint64_t, uint64_t>) << endl << endl;
+
+    vector<uint64_t> keys = randomKeys(n, 1);
+    benchAllocation<BinarySearchTree<uint64_t, uint64_t> >("BinarySearchTree", keys);
+    benchAllocation<AVLTree<uint64_t, uint64_t> >("AVLTree", keys);
+    benchAllocation<IndexedAVLTree<uint64_t, uint64_t> >("IndexedAVLTree", keys);
+    benchAllocation<BTree<uint64_t, uint64_t> >("BTree<32>", keys);
+    benchLookup<BinarySearchTree<uint64_t, uint64_t> >("BinarySearchTree", keys);
+    benchLookup<AVLTree<uint64_t, uint64_t> >("AVLTree", keys);
+    benchLookup<IndexedAVLTree<uint64_t, uint64_t> >("IndexedAVLTree", keys);
+    benchLookup<BTree<uint64_t, uint64_t> >("BTree<32>", keys);
+    vector<uint64_t> ascending(n);
+    for (size_t i = 0; i < n; ++i){
+        ascending[i] = i;
+    }
+    vector<uint64_t> descending(ascending.rbegin(), ascending.rend());
+    benchHintedInsert("sorted", ascending);
+    benchHintedInsert("reverse", descending);
+    benchHintedInsert("random", keys);
+#ifdef AVL_ORDER_STATISTICS
+    benchOrderStatistics(keys);
+#endif
+    benchRangeErase(keys, 16);
+    benchRangeErase(keys, 1024);
+    benchPopMin(keys);
+    benchEraseIf(keys);
+    benchCounters(keys);
+    benchLatest(keys);
+    benchMigration(keys);
+    benchSetOperations(keys);
+    for (size_t batchSize = 100; batchSize <= n / 2; batchSize *= 10){
+        benchBatches(keys, batchSize);
+    }
+    benchSnapshots(keys);
+    benchConcurrent(keys);
+    benchBulkLoad(keys);
+    benchStringKeys(n);
+    benchFrozen(keys);
+    benchBTree(keys);
+
+    return 0;
+}
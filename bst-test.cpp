@@ -1,10 +1,905 @@
+#include <atomic>
 #include <iostream>
+#include <iterator>
 #include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 #include "bst.h"
 #include "avlbst.h"
+#include "btree.h"
+#include "concurrent_avl.h"
+#include "frozen_bst.h"
+#include "index_avl.h"
+#include "persistent_avl.h"
+#include "sharded_map.h"
 
 using namespace std;
 
+static int failures = 0;
+
+static void check(bool ok, const char* what)
+{
+    if(!ok) {
+        cout << "FAILED: " << what << endl;
+        ++failures;
+    }
+}
+
+// Inserts through a BinarySearchTree reference to an AVLTree must make
+// AVL nodes and rebalance, just like the same calls on the AVLTree.
+static void testBaseReferenceInserts()
+{
+    AVLTree<int,int> avl;
+    BinarySearchTree<int,int>& base = avl;
+    for(int i = 0; i < 1000; ++i) {
+        if(i % 2 == 0) {
+            base.emplace(i, i);
+        }
+        else {
+            base.try_emplace(i, i);
+        }
+    }
+    check(avl.isBalanced(), "emplace/try_emplace through a base reference keep an AVLTree balanced");
+    check(avl.size() == 1000 && !base.try_emplace(5, 0).second && avl[5] == 5,
+          "try_emplace through a base reference leaves an existing key alone");
+
+    AVLTree<int,int> hinted;
+    BinarySearchTree<int,int>& hintedBase = hinted;
+    BinarySearchTree<int,int>::iterator hint = hintedBase.end();
+    for(int i = 0; i < 1000; ++i) {
+        hint = hintedBase.insert(hint, std::make_pair(i, i));
+    }
+    check(hinted.isBalanced() && hinted.size() == 1000,
+          "hinted inserts through a base reference keep an AVLTree balanced");
+
+    AVLTree<int,int> counted;
+    BinarySearchTree<int,int>& countedBase = counted;
+    for(int i = 0; i < 3000; ++i) {
+        if(i < 1000) {
+            countedBase[i] = i;
+        }
+        else if(i < 2000) {
+            countedBase.get_or_insert(i, [i]() { return i; });
+        }
+        else {
+            countedBase.upsert(i, [i](int& value) { value = i; });
+        }
+    }
+    countedBase[7] += 1;
+    check(counted.isBalanced() && counted.size() == 3000 && counted[7] == 8 && counted[2500] == 2500,
+          "operator[], get_or_insert and upsert through a base reference keep an AVLTree balanced");
+}
+
+static std::size_t countItems(const AVLTree<int,int>& tree)
+{
+    std::size_t count = 0;
+    for(AVLTree<int,int>::iterator it = tree.begin(); it != tree.end(); ++it) {
+        ++count;
+    }
+    return count;
+}
+
+// split leaves the halves' counts for size() to take, which must then
+// agree with the items, also after more inserts and removes.
+static void testSplitSizes()
+{
+    bool exact = true;
+    for(int cut = -1; cut <= 101; cut += 17) {
+        AVLTree<int,int> left;
+        AVLTree<int,int> right;
+        for(int i = 0; i < 100; ++i) {
+            left.insert(std::make_pair(i, i));
+        }
+        left.split(cut, right);
+        exact = exact && left.size() == countItems(left) && right.size() == countItems(right);
+        exact = exact && left.size() + right.size() == 100;
+
+        // the same, with the counts still unknown while the halves change
+        AVLTree<int,int> tail;
+        left.split(cut / 2, tail);
+        tail.insert(std::make_pair(1000, 0));
+        tail.remove(cut / 2);
+        left.join(tail);
+        left.unite(right);
+        AVLTree<int,int> upper;
+        left.split(50, upper);
+        left.pop_min();
+        left.erase_range(10, 20);
+        exact = exact && left.size() == countItems(left) && upper.size() == countItems(upper);
+    }
+    check(exact, "split leaves both sizes exact");
+}
+
+// IndexedAVLTree iterators work with the standard algorithms.
+static void testIndexedIterator()
+{
+    IndexedAVLTree<int,int> tree;
+    for(int i = 0; i < 100; ++i) {
+        tree.insert(std::make_pair((i * 37) % 100, i));
+    }
+    IndexedAVLTree<int,int>::iterator it = tree.begin();
+    IndexedAVLTree<int,int>::iterator old = it++;
+    check(old->first == 0 && it->first == 1, "IndexedAVLTree iterator post-increment");
+    check(std::distance(tree.begin(), tree.end()) == 100, "IndexedAVLTree iterator works with std::distance");
+    bool threw = false;
+    try {
+        tree.reserve(std::size_t(1) << 33);
+    }
+    catch(std::length_error&) {
+        threw = true;
+    }
+    check(threw || sizeof(std::size_t) < 8, "IndexedAVLTree refuses more than 2^32 - 1 nodes");
+}
+
+// True if tree holds exactly the items of expected, in order.
+template<typename Tree>
+static bool sameItems(const Tree& tree, const std::map<int,int>& expected)
+{
+    std::map<int,int>::const_iterator want = expected.begin();
+    for(typename Tree::iterator it = tree.begin(); it != tree.end(); ++it, ++want) {
+        if(want == expected.end() || it->first != want->first || it->second != want->second) {
+            return false;
+        }
+    }
+    return want == expected.end();
+}
+
+// Under AVL_COMPACT_NODES the balance lives in the parent pointer's low
+// bits, so the upward walks of iteration must survive heavy rebalancing.
+static void testCompactNodes()
+{
+#ifdef AVL_COMPACT_NODES
+    check(sizeof(AVLNode<int,int>) == sizeof(Node<int,int>), "a compact AVLNode is no bigger than a Node");
+#endif
+    AVLTree<int,int> tree;
+    std::map<int,int> expected;
+    for(int i = 0; i < 5000; ++i) {
+        tree.insert(std::make_pair((i * 7919) % 10007, i));
+        expected[(i * 7919) % 10007] = i;
+    }
+    for(int i = 0; i < 5000; i += 3) {
+        tree.remove((i * 7919) % 10007);
+        expected.erase((i * 7919) % 10007);
+    }
+    check(sameItems(tree, expected) && tree.isBalanced(), "AVLTree keeps its items through rotations");
+    std::map<int,int>::reverse_iterator want = expected.rbegin();
+    AVLTree<int,int>::iterator it = tree.end();
+    bool backwards = true;
+    while(it != tree.begin()) {
+        --it;
+        backwards = backwards && want != expected.rend() && it->first == want->first;
+        ++want;
+    }
+    check(backwards && want == expected.rend(), "AVLTree iterates backwards through rotated nodes");
+}
+
+// Scattered keys for the standalone containers to hold.
+static std::map<int,int> scatteredItems()
+{
+    std::map<int,int> items;
+    for(int i = 0; i < 2000; ++i) {
+        items[(i * 7919) % 5000] = i;
+    }
+    return items;
+}
+
+static void testIndexedTree()
+{
+    std::map<int,int> items = scatteredItems();
+    IndexedAVLTree<int,int> tree;
+    std::map<int,int> kept;
+    for(std::map<int,int>::iterator it = items.begin(); it != items.end(); ++it) {
+        tree.insert(*it);
+    }
+    for(std::map<int,int>::iterator it = items.begin(); it != items.end(); ++it) {
+        if(it->first % 3 == 0) {
+            tree.remove(it->first);
+        }
+        else {
+            kept.insert(*it);
+        }
+    }
+    check(sameItems(tree, kept) && tree.size() == kept.size() && tree.isBalanced(),
+          "IndexedAVLTree inserts and removes");
+    check(tree.find(3) == tree.end() && tree.find(kept.rbegin()->first)->second == kept.rbegin()->second,
+          "IndexedAVLTree find");
+}
+
+// Every key in range, present or not, against the snapshot's source.
+static void testEytzingerIndex()
+{
+    std::map<int,int> items = scatteredItems();
+    AVLTree<int,int> source(items.begin(), items.end());
+    EytzingerIndex<int,int> index(source.begin(), source.end());
+    bool found = index.size() == items.size();
+    for(int key = -1; key <= 5000; ++key) {
+        std::map<int,int>::iterator want = items.find(key);
+        const int* value = index.find(key);
+        found = found && (want == items.end() ? value == NULL : value != NULL && *value == want->second);
+        found = found && index.contains(key) == (want != items.end());
+    }
+    check(found, "EytzingerIndex find and contains");
+    EytzingerIndex<int,int> empty(source.end(), source.end());
+    check(empty.empty() && empty.find(0) == NULL, "an empty EytzingerIndex finds nothing");
+}
+
+static void testVebIndex()
+{
+    std::map<int,int> items = scatteredItems();
+    AVLTree<int,int> source(items.begin(), items.end());
+    VebIndex<int,int> index(source.begin(), source.end());
+    check(sameItems(index, items) && index.size() == items.size(), "VebIndex iterates in key order");
+    bool found = true;
+    for(int key = -1; key <= 5000; ++key) {
+        std::map<int,int>::iterator want = items.find(key);
+        VebIndex<int,int>::iterator it = index.find(key);
+        found = found && (want == items.end() ? it == index.end() : it != index.end() && it->second == want->second);
+        std::map<int,int>::iterator wantLower = items.lower_bound(key);
+        VebIndex<int,int>::iterator lower = index.lower_bound(key);
+        found = found && (wantLower == items.end() ? lower == index.end() : lower->first == wantLower->first);
+        std::map<int,int>::iterator wantUpper = items.upper_bound(key);
+        VebIndex<int,int>::iterator upper = index.upper_bound(key);
+        found = found && (wantUpper == items.end() ? upper == index.end() : upper->first == wantUpper->first);
+    }
+    check(found, "VebIndex find, lower_bound and upper_bound");
+}
+
+// A small fanout, so a few thousand keys split and merge nodes on
+// several levels.
+static void testBTree()
+{
+    std::map<int,int> items = scatteredItems();
+    BTree<int,int,8> tree;
+    std::map<int,int> kept;
+    for(std::map<int,int>::iterator it = items.begin(); it != items.end(); ++it) {
+        tree.insert(*it);
+    }
+    check(sameItems(tree, items) && tree.size() == items.size(), "BTree inserts");
+    for(std::map<int,int>::iterator it = items.begin(); it != items.end(); ++it) {
+        if(it->first % 3 == 0) {
+            tree.remove(it->first);
+        }
+        else {
+            kept.insert(*it);
+        }
+    }
+    check(sameItems(tree, kept) && tree.size() == kept.size() && tree.find(3) == tree.end(), "BTree removes");
+    tree.clear();
+    check(tree.empty() && tree.begin() == tree.end(), "BTree clear");
+}
+
+// Orders by operator<, but its compare() only tests equality, so the
+// tree must not take it for a three-way compare.
+struct EqualityKey
+{
+    int id;
+
+    bool operator<(const EqualityKey& other) const
+    {
+        return id < other.id;
+    }
+
+    bool compare(const EqualityKey& other) const
+    {
+        return id == other.id;
+    }
+};
+
+// print() needs the keys to be printable
+static std::ostream& operator<<(std::ostream& out, const EqualityKey& key)
+{
+    return out << key.id;
+}
+
+static void testThreeWayCompare()
+{
+    AVLTree<EqualityKey,int> tree;
+    for(int i = 0; i < 10; ++i) {
+        EqualityKey key = { i };
+        tree.insert(std::make_pair(key, i));
+    }
+    bool found = tree.size() == 10;
+    for(int i = 0; i < 12; ++i) {
+        EqualityKey key = { i };
+        AVLTree<EqualityKey,int>::iterator it = tree.find(key);
+        found = found && (i < 10 ? it != tree.end() && it->second == i : it == tree.end());
+    }
+    check(found, "a bool compare() member does not replace operator<");
+
+    // long shared prefixes, which the three-way descent walks once per level
+    std::map<std::string,int> expected;
+    BinarySearchTree<std::string,int> plain;
+    AVLTree<std::string,int> avl;
+    for(int i = 0; i < 500; ++i) {
+        std::string key = std::string(64, 'k') + std::to_string((i * 7919) % 1000);
+        expected[key] = i;
+        plain.insert(std::make_pair(key, i));
+        avl.insert(std::make_pair(key, i));
+    }
+    bool same = plain.size() == expected.size() && avl.size() == expected.size() && avl.isBalanced();
+    std::map<std::string,int>::iterator want = expected.begin();
+    for(AVLTree<std::string,int>::iterator it = avl.begin(); it != avl.end() && want != expected.end(); ++it, ++want) {
+        same = same && it->first == want->first && it->second == want->second;
+    }
+    for(int i = 0; i < 1000; ++i) {
+        std::string key = std::string(64, 'k') + std::to_string(i);
+        bool present = expected.count(key) != 0;
+        same = same && (plain.find(key) != plain.end()) == present && (avl.find(key) != avl.end()) == present;
+    }
+    avl.remove(expected.begin()->first);
+    same = same && avl.find(expected.begin()->first) == avl.end() && avl.size() == expected.size() - 1;
+    check(same, "std::string keys on the three-way descent");
+}
+
+// Orders std::string against C strings and counts its calls.
+struct CountingLess
+{
+    typedef void is_transparent;
+    static int calls;
+
+    bool operator()(const std::string& a, const std::string& b) const
+    {
+        ++calls;
+        return a < b;
+    }
+
+    bool operator()(const std::string& a, const char* b) const
+    {
+        ++calls;
+        return a.compare(b) < 0;
+    }
+
+    bool operator()(const char* a, const std::string& b) const
+    {
+        ++calls;
+        return b.compare(a) > 0;
+    }
+};
+
+int CountingLess::calls = 0;
+
+static void testTransparentLookup()
+{
+    AVLTree<std::string,int,CountingLess> tree;
+    for(int i = 0; i < 1000; i += 2) {
+        tree.insert(std::make_pair(std::to_string(i), i));
+    }
+    check(tree.find("10") != tree.end() && tree.find("10")->second == 10 && tree.find("11") == tree.end(),
+          "transparent find");
+    tree["10"] = -10;
+    check(tree.find(std::string("10"))->second == -10 && tree.size() == 500, "transparent operator[] on a hit");
+
+    CountingLess::calls = 0;
+    bool missing = tree.find("11") == tree.end();
+    int findCalls = CountingLess::calls;
+    CountingLess::calls = 0;
+    tree["11"] = 11;
+    check(missing && CountingLess::calls <= findCalls, "transparent operator[] inserts after one descent");
+    check(tree.size() == 501 && tree.find("11")->second == 11 && tree.isBalanced(),
+          "transparent operator[] inserts a missing key");
+    const AVLTree<std::string,int,CountingLess>& constTree = tree;
+    bool threw = false;
+    try {
+        constTree["13"];
+    }
+    catch(std::out_of_range&) {
+        threw = true;
+    }
+    check(threw && constTree["11"] == 11, "const transparent operator[]");
+}
+
+#ifdef AVL_ORDER_STATISTICS
+// The subtree sizes behind rank and select must survive rotations,
+// removals and split/join.
+static void testOrderStatistics()
+{
+    std::map<int,int> items = scatteredItems();
+    AVLTree<int,int> tree;
+    for(std::map<int,int>::iterator it = items.begin(); it != items.end(); ++it) {
+        tree.insert(*it);
+    }
+    for(int key = 0; key < 5000; key += 7) {
+        tree.remove(key);
+        items.erase(key);
+    }
+    AVLTree<int,int> high;
+    tree.split(2500, high);
+    tree.join(high);
+
+    std::vector<int> keys;
+    for(std::map<int,int>::iterator it = items.begin(); it != items.end(); ++it) {
+        keys.push_back(it->first);
+    }
+    bool right = tree.size() == keys.size() && tree.select(keys.size()) == tree.end();
+    for(std::size_t i = 0; i < keys.size(); ++i) {
+        AVLTree<int,int>::iterator it = tree.select(i);
+        right = right && it != tree.end() && it->first == keys[i];
+        right = right && tree.rank(keys[i]) == i && tree.rank(keys[i] + 1) == i + 1;
+        right = right && tree.position(it) == i;
+    }
+    check(right, "rank, select and position agree with the sorted keys");
+
+    AVLTree<int,int>::iterator first = tree.select(10);
+    check(tree.advance(first, 25)->first == keys[35] && tree.advance(first, -10)->first == keys[0] &&
+          tree.advance(first, -11) == tree.end() && tree.advance(first, keys.size()) == tree.end(),
+          "advance moves by position and stops at the ends");
+    check(tree.distance(first, tree.select(40)) == 30 && tree.distance(tree.select(40), first) == -30 &&
+          tree.distance(tree.begin(), tree.end()) == static_cast<std::ptrdiff_t>(keys.size()),
+          "distance counts the steps between iterators");
+    check(tree.count_range(keys[5], keys[50]) == 45 && tree.count_range(keys[50], keys[5]) == 0,
+          "count_range from ranks");
+}
+#endif
+
+// The bounds of every key in range, present or not, against std::map,
+// then count_range and erase_range on the same tree.
+template<typename Tree>
+static void checkRangeQueries(const char* what)
+{
+    Tree tree;
+    std::map<int,int> expected;
+    for(int i = 0; i < 1000; ++i) {
+        tree.insert(std::make_pair((i * 7919) % 1000 * 2, i));
+        expected[(i * 7919) % 1000 * 2] = i;
+    }
+    bool bounds = true;
+    for(int key = -1; key <= 2000; ++key) {
+        std::map<int,int>::iterator wantLower = expected.lower_bound(key);
+        std::map<int,int>::iterator wantUpper = expected.upper_bound(key);
+        typename Tree::iterator lower = tree.lower_bound(key);
+        typename Tree::iterator upper = tree.upper_bound(key);
+        bounds = bounds && (wantLower == expected.end() ? lower == tree.end() : lower->first == wantLower->first);
+        bounds = bounds && (wantUpper == expected.end() ? upper == tree.end() : upper->first == wantUpper->first);
+        std::pair<typename Tree::iterator, typename Tree::iterator> range = tree.equal_range(key);
+        bounds = bounds && range.first == lower && range.second == upper;
+    }
+    check(bounds, what);
+
+    check(tree.count_range(200, 400) == 100 && tree.count_range(201, 203) == 1 && tree.count_range(400, 200) == 0,
+          what);
+    tree.erase_range(200, 400);
+    tree.erase_range(1980, 5000);
+    expected.erase(expected.lower_bound(200), expected.lower_bound(400));
+    expected.erase(expected.lower_bound(1980), expected.end());
+    check(sameItems(tree, expected) && tree.size() == expected.size(), what);
+    check(tree.count_range(0, 2000) == 890 && tree.count_range(100, 300) == 50, what);
+}
+
+static void testRangeQueries()
+{
+    checkRangeQueries<BinarySearchTree<int,int> >("BinarySearchTree range queries");
+    checkRangeQueries<AVLTree<int,int> >("AVLTree range queries");
+    AVLTree<int,int> tree;
+    for(int i = 0; i < 1000; ++i) {
+        tree.insert(std::make_pair(i, i));
+    }
+    tree.erase_range(10, 900);
+    check(tree.isBalanced() && tree.size() == 110 && tree.lower_bound(10)->first == 900,
+          "AVLTree erase_range stays balanced");
+}
+
+// The set operations on trees big enough that the Makefile's
+// AVL_FORK_THREADS lets them fork, plus split and join.
+static void testSetOperations()
+{
+    const int n = 120000;
+    std::map<int,int> evens;
+    std::map<int,int> threes;
+    AVLTree<int,int> a;
+    AVLTree<int,int> b;
+    for(int i = 0; i < n; i += 2) {
+        a.insert(std::make_pair(i, i));
+        evens[i] = i;
+    }
+    for(int i = 0; i < n; i += 3) {
+        b.insert(std::make_pair(i, -i));
+        threes[i] = -i;
+    }
+
+    AVLTree<int,int> united(a.begin(), a.end());
+    AVLTree<int,int> other(b.begin(), b.end());
+    united.unite(other);
+    std::map<int,int> expected = evens;
+    for(std::map<int,int>::iterator it = threes.begin(); it != threes.end(); ++it) {
+        expected[it->first] = it->second;
+    }
+    check(sameItems(united, expected) && united.size() == expected.size() && united.isBalanced() && other.empty(),
+          "unite keeps every key, with the other tree's values");
+
+    AVLTree<int,int> common(a.begin(), a.end());
+    other.assign(b.begin(), b.end());
+    common.intersect(other);
+    expected.clear();
+    for(int i = 0; i < n; i += 6) {
+        expected[i] = i;
+    }
+    check(sameItems(common, expected) && common.size() == expected.size() && common.isBalanced() && other.empty(),
+          "intersect keeps the shared keys, with this tree's values");
+
+    AVLTree<int,int> rest(a.begin(), a.end());
+    other.assign(b.begin(), b.end());
+    rest.subtract(other);
+    expected = evens;
+    for(int i = 0; i < n; i += 6) {
+        expected.erase(i);
+    }
+    check(sameItems(rest, expected) && rest.size() == expected.size() && rest.isBalanced() && other.empty(),
+          "subtract drops the other tree's keys");
+
+    AVLTree<int,int> high;
+    a.split(n / 2, high);
+    std::map<int,int> low(evens.begin(), evens.lower_bound(n / 2));
+    std::map<int,int> upper(evens.lower_bound(n / 2), evens.end());
+    check(sameItems(a, low) && sameItems(high, upper) && a.isBalanced() && high.isBalanced(),
+          "split divides the keys at the split key");
+    a.join(high);
+    check(sameItems(a, evens) && high.empty() && a.isBalanced(), "join puts the halves back together");
+
+    AVLTree<int,int> tail;
+    tail.insert(std::make_pair(n + 10, 1));
+    a.join(std::make_pair(n + 5, 2), tail);
+    evens[n + 5] = 2;
+    evens[n + 10] = 1;
+    check(sameItems(a, evens) && tail.empty() && a.isBalanced(), "join with a pivot appends pivot and right");
+
+    bool threw = false;
+    tail.insert(std::make_pair(0, 0));
+    try {
+        a.join(tail);
+    }
+    catch(std::invalid_argument&) {
+        threw = true;
+    }
+    check(threw && sameItems(a, evens), "join refuses keys out of order");
+
+    a.join(a);
+    check(sameItems(a, evens) && a.isBalanced(), "joining a tree to itself leaves it alone");
+}
+
+// Writers on disjoint keys, each also removing some of its own.
+static void testConcurrentTree()
+{
+    ConcurrentAVLTree<int,int> tree;
+    std::vector<std::thread> threads;
+    for(int t = 0; t < 4; ++t) {
+        threads.push_back(std::thread([&tree, t]() {
+            for(int i = t; i < 4000; i += 4) {
+                tree.insert(std::make_pair(i, i));
+            }
+            for(int i = t; i < 4000; i += 8) {
+                tree.remove(i);
+            }
+        }));
+    }
+    for(std::size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+    bool right = true;
+    for(int i = 0; i < 4000; ++i) {
+        int value = -1;
+        bool found = tree.find(i, value);
+        right = right && tree.contains(i) == (i % 8 >= 4) && found == (i % 8 >= 4) && (!found || value == i);
+    }
+    check(right && tree.isBalanced(), "ConcurrentAVLTree with several writers");
+}
+
+// A snapshot keeps its version however the tree changes afterwards.
+static void testPersistentTree()
+{
+    std::map<int,int> items = scatteredItems();
+    PersistentAVLTree<int,int> tree;
+    for(std::map<int,int>::iterator it = items.begin(); it != items.end(); ++it) {
+        tree.insert(*it);
+    }
+    PersistentAVLTree<int,int> before = tree.snapshot();
+    std::map<int,int> kept;
+    for(std::map<int,int>::iterator it = items.begin(); it != items.end(); ++it) {
+        if(it->first % 2 == 0) {
+            tree.remove(it->first);
+        }
+        else {
+            kept.insert(*it);
+        }
+    }
+    tree.insert(std::make_pair(-1, -1));
+    kept[-1] = -1;
+    check(sameItems(before, items) && before.size() == items.size() && before.isBalanced(),
+          "a PersistentAVLTree snapshot keeps its version");
+    check(sameItems(tree, kept) && tree.size() == kept.size() && tree.isBalanced(),
+          "PersistentAVLTree inserts and removes after a snapshot");
+    before.clear();
+    check(before.empty() && sameItems(tree, kept), "clearing a snapshot leaves the tree alone");
+}
+
+static void testPopMinMax()
+{
+    AVLTree<int,int> tree;
+    for(int i = 0; i < 100; ++i) {
+        tree.insert(std::make_pair((i * 37) % 100, i));
+    }
+    std::pair<int,int> low = tree.pop_min();
+    std::pair<int,int> high = tree.pop_max();
+    check(low.first == 0 && high.first == 99 && tree.size() == 98 && tree.isBalanced(),
+          "pop_min and pop_max take the end items");
+    check(tree.begin()->first == 1 && tree.rbegin()->first == 98, "pop_min and pop_max update the ends");
+    BinarySearchTree<int,int> empty;
+    bool threw = false;
+    try {
+        empty.pop_min();
+    }
+    catch(std::out_of_range&) {
+        threw = true;
+    }
+    check(threw, "pop_min on an empty tree throws");
+}
+
+// Batches below and above the rebuild threshold (1/64 of the tree), with
+// repeated keys and keys already in the tree.
+static void testBatches()
+{
+    AVLTree<int,int> tree;
+    std::map<int,int> expected;
+    for(int i = 0; i < 100000; i += 2) {
+        tree.insert(std::make_pair(i, i));
+        expected[i] = i;
+    }
+
+    std::vector<std::pair<int,int> > small;
+    for(int i = 0; i < 300; ++i) {
+        int key = (i * 7919) % 100000;
+        small.push_back(std::make_pair(key, -i));
+        small.push_back(std::make_pair(key, -i - 1));
+        expected[key] = -i - 1;
+    }
+    tree.insert_batch(small.begin(), small.end());
+    check(sameItems(tree, expected) && tree.size() == expected.size() && tree.isBalanced(),
+          "a small insert_batch overwrites, with the last of equal keys winning");
+
+    std::vector<int> gone;
+    for(int i = 0; i < 300; ++i) {
+        int key = (i * 104729) % 100003;
+        gone.push_back(key);
+        gone.push_back(key);
+        expected.erase(key);
+    }
+    tree.remove_batch(gone.begin(), gone.end());
+    check(sameItems(tree, expected) && tree.size() == expected.size() && tree.isBalanced(),
+          "a small remove_batch");
+
+    std::vector<std::pair<int,int> > large;
+    for(int i = 0; i < 50000; ++i) {
+        large.push_back(std::make_pair(i * 3, i));
+        expected[i * 3] = i;
+    }
+    tree.insert_batch(large.begin(), large.end());
+    check(sameItems(tree, expected) && tree.size() == expected.size() && tree.isBalanced(),
+          "a large insert_batch");
+    gone.clear();
+    for(int i = 0; i < 150000; i += 5) {
+        gone.push_back(i);
+        expected.erase(i);
+    }
+    tree.remove_batch(gone.begin(), gone.end());
+    check(sameItems(tree, expected) && tree.size() == expected.size() && tree.isBalanced(),
+          "a large remove_batch");
+
+    AVLTree<int,int> empty;
+    empty.insert_batch(small.begin(), small.end());
+    empty.remove_batch(gone.begin(), gone.end());
+    std::map<int,int> fromSmall;
+    for(std::size_t i = 0; i < small.size(); ++i) {
+        fromSmall[small[i].first] = small[i].second;
+    }
+    for(std::size_t i = 0; i < gone.size(); ++i) {
+        fromSmall.erase(gone[i]);
+    }
+    check(sameItems(empty, fromSmall) && empty.isBalanced(), "batches on an empty tree");
+}
+
+// A scan that erases as it goes, on both tree types.
+template<typename Tree>
+static void checkEraseIterator(const char* what)
+{
+    Tree tree;
+    std::map<int,int> expected;
+    for(int i = 0; i < 1000; ++i) {
+        tree.insert(std::make_pair((i * 7919) % 1000, i));
+        expected[(i * 7919) % 1000] = i;
+    }
+    bool steps = true;
+    for(typename Tree::iterator it = tree.begin(); it != tree.end(); ) {
+        if(it->first % 3 == 0) {
+            int key = it->first;
+            it = tree.erase(it);
+            std::map<int,int>::iterator next = expected.erase(expected.find(key));
+            steps = steps && (next == expected.end() ? it == tree.end() : it->first == next->first);
+        }
+        else {
+            ++it;
+        }
+    }
+    check(steps && sameItems(tree, expected) && tree.size() == expected.size(), what);
+}
+
+static void testEraseIterator()
+{
+    checkEraseIterator<BinarySearchTree<int,int> >("BinarySearchTree erase(iterator) returns the next item");
+    checkEraseIterator<AVLTree<int,int> >("AVLTree erase(iterator) returns the next item");
+    AVLTree<int,int> tree;
+    for(int i = 0; i < 1000; ++i) {
+        tree.insert(std::make_pair(i, i));
+    }
+    AVLTree<int,int>::iterator kept = tree.find(500);
+    for(AVLTree<int,int>::iterator it = tree.begin(); it != tree.end(); ) {
+        it = (it->first % 2 == 0 && it->first != 500) ? tree.erase(it) : ++it;
+    }
+    check(tree.isBalanced() && tree.size() == 501 && kept->first == 500 && (++kept)->first == 501,
+          "AVLTree erase(iterator) keeps other iterators valid through rebalancing");
+}
+
+// Walks forwards, backwards and through the const and reverse adaptors.
+static void testIterators()
+{
+    AVLTree<int,int> tree;
+    for(int i = 0; i < 50; ++i) {
+        tree.insert(std::make_pair(i, i * i));
+    }
+    int expected = 49;
+    bool descending = true;
+    for(AVLTree<int,int>::reverse_iterator it = tree.rbegin(); it != tree.rend(); ++it, --expected) {
+        descending = descending && it->first == expected;
+    }
+    check(descending && expected == -1, "reverse iteration visits every key, largest first");
+
+    const AVLTree<int,int>& constTree = tree;
+    int sum = 0;
+    for(AVLTree<int,int>::const_iterator it = constTree.cbegin(); it != constTree.cend(); ++it) {
+        sum += it->first;
+    }
+    check(sum == 49 * 50 / 2, "const iteration visits every key");
+
+    AVLTree<int,int>::iterator last = tree.end();
+    --last;
+    AVLTree<int,int>::const_iterator first = tree.cbegin();
+    check(last->first == 49 && first->first == 0 && (++first)->first == 1 && tree.crbegin()->first == 49,
+          "stepping back from end() reaches the largest key");
+    check(std::distance(tree.begin(), tree.end()) == 50, "iterators work with std::distance");
+
+    AVLTree<int,int>::iterator post = tree.begin();
+    AVLTree<int,int>::iterator old = post++;
+    AVLTree<int,int>::iterator back = post--;
+    check(old->first == 0 && back->first == 1 && post == tree.begin(), "post-increment and post-decrement");
+    AVLTree<int,int>::const_reverse_iterator crit = constTree.crbegin();
+    std::advance(crit, 49);
+    check(crit->first == 0 && ++crit == constTree.crend(), "const reverse iteration ends at crend()");
+}
+
+// extract, insert(node_type&&) and merge, including the refusals.
+static void testNodeHandles()
+{
+    AVLTree<int,int> a;
+    AVLTree<int,int> b;
+    for(int i = 0; i < 10; ++i) {
+        a.insert(std::make_pair(i, i));
+        b.insert(std::make_pair(i + 5, -i));
+    }
+
+    AVLTree<int,int>::node_type node = a.extract(3);
+    check(!node.empty() && node.key() == 3 && node.mapped() == 3 && a.find(3) == a.end() && a.size() == 9,
+          "extract unlinks the node");
+    check(a.extract(42).empty(), "extract of a missing key gives an empty handle");
+    node.mapped() = 30;
+    AVLTree<int,int>::insert_return_type moved = b.insert(std::move(node));
+    check(moved.inserted && node.empty() && moved.position->second == 30 && b.size() == 11 && b.isBalanced(),
+          "a node handle moves into another tree");
+
+    AVLTree<int,int>::node_type taken = b.extract(b.find(5));
+    AVLTree<int,int>::insert_return_type clash = a.insert(std::move(taken));
+    check(!clash.inserted && !clash.node.empty() && clash.node.mapped() == 0 && clash.position->second == 5,
+          "inserting a handle whose key is taken gives the handle back");
+
+    a.merge(b);
+    std::map<int,int> expected;
+    for(int i = 0; i < 10; ++i) {
+        expected[i] = i;
+    }
+    expected[3] = 30;
+    for(int i = 10; i < 15; ++i) {
+        expected[i] = 5 - i;
+    }
+    std::map<int,int> left;
+    for(int i = 6; i < 10; ++i) {
+        left[i] = 5 - i;
+    }
+    check(sameItems(a, expected) && sameItems(b, left) && a.isBalanced() && b.isBalanced() &&
+          a.size() == expected.size() && b.size() == left.size(),
+          "merge moves over the keys this tree lacks");
+
+    // the node types differ even where their sizes match (AVL_COMPACT_NODES)
+    BinarySearchTree<int,int> plain;
+    plain.insert(std::make_pair(100, 1));
+    bool threw = false;
+    try {
+        a.insert(plain.extract(100));
+    }
+    catch(std::invalid_argument&) {
+        threw = true;
+    }
+    check(threw && a.find(100) == a.end(), "a plain node cannot move into an AVLTree");
+    plain.insert(std::make_pair(101, 1));
+    threw = false;
+    try {
+        a.merge(plain);
+    }
+    catch(std::invalid_argument&) {
+        threw = true;
+    }
+    check(threw && a.find(101) == a.end() && plain.size() == 1, "an AVLTree cannot merge a plain tree");
+
+    BinarySearchTree<int,int> plainToo;
+    plainToo.insert(plain.extract(101));
+    check(plainToo.find(101) != plainToo.end() && plain.empty(), "nodes move between plain trees");
+}
+
+// Several writers insert scattered keys while another thread keeps
+// moving shard boundaries; every key must end up exactly once, in the
+// shard that owns it.
+static void testShardedRebalance()
+{
+    const int writers = 4;
+    const int perWriter = 40000;
+    ShardedMap<int,int> map(4);
+    std::atomic<int> running(writers);
+    std::vector<std::thread> threads;
+    for(int t = 0; t < writers; ++t) {
+        threads.push_back(std::thread([&map, &running, t]() {
+            unsigned int x = 12345u + t;
+            for(int i = 0; i < perWriter; ++i) {
+                x = x * 1103515245u + 12345u;
+                int key = (int)((x >> 8) % 1000000) * writers + t;
+                map.insert(std::make_pair(key, key));
+            }
+            --running;
+        }));
+    }
+    threads.push_back(std::thread([&map, &running]() {
+        while(running > 0) {
+            map.rebalance();
+            std::this_thread::yield();
+        }
+    }));
+    for(std::size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+
+    std::map<int,int> expected;
+    for(int t = 0; t < writers; ++t) {
+        unsigned int x = 12345u + t;
+        for(int i = 0; i < perWriter; ++i) {
+            x = x * 1103515245u + 12345u;
+            int key = (int)((x >> 8) % 1000000) * writers + t;
+            expected[key] = key;
+        }
+    }
+    std::map<int,int>::iterator want = expected.begin();
+    bool same = true;
+    for(ShardedMap<int,int>::iterator it = map.begin(); it != map.end(); ++it, ++want) {
+        if(want == expected.end() || it->first != want->first || it->second != want->second) {
+            same = false;
+            break;
+        }
+    }
+    check(same && want == expected.end(), "sharded map keeps every key once, in order");
+    check(map.activeShards() > 1, "sharded map moves its boundaries");
+    bool found = true;
+    for(want = expected.begin(); want != expected.end(); ++want) {
+        found = found && map.contains(want->first);
+    }
+    check(found, "sharded map finds every key after rebalancing");
+}
+
 
 int main(int argc, char *argv[])
 {
@@ -44,5 +939,33 @@ int main(int argc, char *argv[])
     cout << "Erasing b" << endl;
     at.remove('b');
 
+    testBaseReferenceInserts();
+    testSplitSizes();
+    testIndexedIterator();
+    testCompactNodes();
+    testIndexedTree();
+    testEytzingerIndex();
+    testVebIndex();
+    testBTree();
+    testThreeWayCompare();
+    testTransparentLookup();
+    testRangeQueries();
+    testSetOperations();
+    testConcurrentTree();
+    testPersistentTree();
+    testPopMinMax();
+    testBatches();
+    testEraseIterator();
+    testIterators();
+    testNodeHandles();
+#ifdef AVL_ORDER_STATISTICS
+    testOrderStatistics();
+#endif
+    testShardedRebalance();
+
+    if(failures > 0) {
+        cout << failures << " check(s) failed" << endl;
+        return 1;
+    }
     return 0;
 }
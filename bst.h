@@ -4,21 +4,81 @@
 #include <iostream>
 #include <exception>
 #include <cstdlib>
+#include <cstdint>
 #include <utility>
+#include <iterator>
+#include <functional>
+#include <tuple>
+#include <new>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include "node_pool.h"
+
+#if defined(__cpp_impl_three_way_comparison) && __cpp_impl_three_way_comparison >= 201907L
+#include <compare>
+#include <concepts>
+#define BST_HAS_SPACESHIP 1
+#endif
+
+/**
+ * Builds the item of a new node, for code that picks the item's
+ * constructor arguments but not the node type. Node has a constructor
+ * that takes one and initializes its item from make(); the copy of the
+ * returned temporary is elided, so the item is built in place.
+ */
+template <typename Key, typename Value>
+class ItemMaker
+{
+public:
+    virtual std::pair<const Key, Value> make() = 0;
+
+protected:
+    ~ItemMaker() {}
+};
+
+/**
+ * An ItemMaker that calls build(), typically a lambda holding the
+ * arguments by reference.
+ */
+template <typename Key, typename Value, typename Build>
+class ItemBuilder : public ItemMaker<Key, Value>
+{
+public:
+    explicit ItemBuilder(Build& build) : build_(build) {}
+    virtual std::pair<const Key, Value> make() { return build_(); }
+
+private:
+    Build& build_;
+};
 
 /**
  * A templated class for a Node in a search tree.
- * The getters for parent/left/right are virtual so
- * that they can be overridden for future kinds of
- * search trees, such as Red Black trees, Splay trees,
- * and AVL trees.
+ * The getters for parent/left/right are deliberately
+ * not virtual: node types for other kinds of search
+ * trees, such as AVL trees, redeclare them to return
+ * their own pointer type, which hides these versions
+ * at compile time. Nodes carry no vtable and every step
+ * of a search inlines.
+ *
+ * Trees destroy their nodes as plain Nodes, so derived
+ * node types may only add trivially destructible members.
+ *
+ * The low bits of parent_ are always zero in an aligned
+ * pointer, so derived node types may keep a small tag
+ * there (see getParentTag). getParent() masks it off.
  */
 template <typename Key, typename Value>
 class Node
 {
 public:
     Node(const Key& key, const Value& value, Node<Key, Value>* parent);
-    virtual ~Node();
+    template<typename... ItemArgs>
+    Node(Node<Key, Value>* parent, ItemArgs&&... itemArgs);
+    Node(Node<Key, Value>* parent, ItemMaker<Key, Value>& item);
+    ~Node();
 
     const std::pair<const Key, Value>& getItem() const;
     std::pair<const Key, Value>& getItem();
@@ -26,16 +86,22 @@ public:
     const Value& getValue() const;
     Value& getValue();
 
-    virtual Node<Key, Value>* getParent() const;
-    virtual Node<Key, Value>* getLeft() const;
-    virtual Node<Key, Value>* getRight() const;
+    Node<Key, Value>* getParent() const;
+    Node<Key, Value>* getLeft() const;
+    Node<Key, Value>* getRight() const;
 
     void setParent(Node<Key, Value>* parent);
     void setLeft(Node<Key, Value>* left);
     void setRight(Node<Key, Value>* right);
     void setValue(const Value &value);
+    void setValue(Value&& value);
 
 protected:
+    // Spare low bits of parent_, for use by derived node types
+    static const std::uintptr_t parentTagMask = 7;
+    unsigned getParentTag() const;
+    void setParentTag(unsigned tag);
+
     std::pair<const Key, Value> item_;
     Node<Key, Value>* parent_;
     Node<Key, Value>* left_;
@@ -61,6 +127,35 @@ Node<Key, Value>::Node(const Key& key, const Value& value, Node<Key, Value>* par
 
 }
 
+/**
+* Constructor that builds the item in place from any arguments a
+* std::pair<const Key, Value> accepts, e.g. std::piecewise_construct
+* and two tuples, so nothing is copied on the way into the node.
+*/
+template<typename Key, typename Value>
+template<typename... ItemArgs>
+Node<Key, Value>::Node(Node<Key, Value>* parent, ItemArgs&&... itemArgs) :
+    item_(std::forward<ItemArgs>(itemArgs)...),
+    parent_(parent),
+    left_(NULL),
+    right_(NULL)
+{
+
+}
+
+/**
+* Constructor for a node whose item comes from item.make(); see ItemMaker.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>::Node(Node<Key, Value>* parent, ItemMaker<Key, Value>& item) :
+    item_(item.make()),
+    parent_(parent),
+    left_(NULL),
+    right_(NULL)
+{
+
+}
+
 /**
 * Destructor, which does not need to do anything since the pointers inside of a node
 * are only used as references to existing nodes. The nodes pointed to by parent/left/right
@@ -118,16 +213,17 @@ Value& Node<Key, Value>::getValue()
 }
 
 /**
-* An implementation of the virtual function for retreiving the parent.
+* A getter for the parent.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getParent() const
 {
-    return parent_;
+    return reinterpret_cast<Node<Key, Value>*>(
+        reinterpret_cast<std::uintptr_t>(parent_) & ~parentTagMask);
 }
 
 /**
-* An implementation of the virtual function for retreiving the left child.
+* A getter for the left child.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getLeft() const
@@ -136,7 +232,7 @@ Node<Key, Value>* Node<Key, Value>::getLeft() const
 }
 
 /**
-* An implementation of the virtual function for retreiving the right child.
+* A getter for the right child.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getRight() const
@@ -150,7 +246,8 @@ Node<Key, Value>* Node<Key, Value>::getRight() const
 template<typename Key, typename Value>
 void Node<Key, Value>::setParent(Node<Key, Value>* parent)
 {
-    parent_ = parent;
+    parent_ = reinterpret_cast<Node<Key, Value>*>(
+        reinterpret_cast<std::uintptr_t>(parent) | getParentTag());
 }
 
 /**
@@ -180,37 +277,144 @@ void Node<Key, Value>::setValue(const Value& value)
     item_.second = value;
 }
 
+/**
+* A setter for the value of a node that moves the new value in.
+*/
+template<typename Key, typename Value>
+void Node<Key, Value>::setValue(Value&& value)
+{
+    item_.second = std::move(value);
+}
+
+/**
+* A getter for the tag kept in the low bits of the parent pointer.
+*/
+template<typename Key, typename Value>
+unsigned Node<Key, Value>::getParentTag() const
+{
+    return static_cast<unsigned>(reinterpret_cast<std::uintptr_t>(parent_) & parentTagMask);
+}
+
+/**
+* A setter for the tag kept in the low bits of the parent pointer.
+* Only values up to parentTagMask fit.
+*/
+template<typename Key, typename Value>
+void Node<Key, Value>::setParentTag(unsigned tag)
+{
+    parent_ = reinterpret_cast<Node<Key, Value>*>(
+        (reinterpret_cast<std::uintptr_t>(parent_) & ~parentTagMask) | tag);
+}
+
 /*
   ---------------------------------------
   End implementations for the Node class.
   ---------------------------------------
 */
 
+/**
+* Picks how a tree descends for a key type and Compare. Every descent makes
+* one ordering decision per level:
+*  - builtin: arithmetic keys under std::less. key == k and key < k come
+*    from a single machine comparison, so the search can stop early.
+*  - threeWay: std::basic_string keys under std::less or, in C++20, keys
+*    with an operator<=>. One call answers both questions, instead of
+*    walking a long common prefix twice. Other compare() members are not
+*    trusted to agree with operator<, so they leave the key on twoWay.
+*  - twoWay: everything else. The descent only asks Compare whether the
+*    node's key is less than the one searched for and checks for a match
+*    once at the bottom.
+*/
+template<typename Key>
+struct IsBasicString : std::false_type
+{
+};
+
+template<typename Char, typename Traits, typename Alloc>
+struct IsBasicString<std::basic_string<Char, Traits, Alloc> > : std::true_type
+{
+};
+
+template<typename Key, typename Compare>
+struct ThreeWayCompare
+{
+#ifdef BST_HAS_SPACESHIP
+    static const bool viaSpaceship = std::three_way_comparable<Key>;
+#else
+    static const bool viaSpaceship = false;
+#endif
+    static const bool isDefaultOrder = std::is_same<Compare, std::less<Key> >::value;
+    static const bool enabled = isDefaultOrder &&
+                                (IsBasicString<Key>::value || (std::is_class<Key>::value && viaSpaceship));
+    static const bool builtin = isDefaultOrder && std::is_arithmetic<Key>::value;
+
+    enum Descent { twoWay, threeWay, builtinCompare };
+    static const int descent = builtin ? builtinCompare : (enabled ? threeWay : twoWay);
+
+    // returns <0, 0 or >0 as a orders before, with, or after b
+    static int compare(const Key& a, const Key& b)
+    {
+        return compare(a, b, IsBasicString<Key>());
+    }
+
+private:
+    static int compare(const Key& a, const Key& b, std::true_type)
+    {
+        return a.compare(b);
+    }
+
+#ifdef BST_HAS_SPACESHIP
+    static int compare(const Key& a, const Key& b, std::false_type)
+    {
+        auto order = a <=> b;
+        return (order < 0) ? -1 : ((order == 0) ? 0 : 1);
+    }
+#endif
+};
+
 /**
 * A templated unbalanced binary search tree.
 */
-template <typename Key, typename Value>
+template <typename Key, typename Value, typename Compare = std::less<Key> >
 class BinarySearchTree
 {
 public:
     BinarySearchTree(); //TODO
+    explicit BinarySearchTree(const Compare& comp);
     virtual ~BinarySearchTree(); //TODO
     virtual void insert(const std::pair<const Key, Value>& keyValuePair); //TODO
+    virtual void insert(std::pair<const Key, Value>&& keyValuePair);
     virtual void remove(const Key& key); //TODO
     void clear(); //TODO
     bool isBalanced() const; //TODO
     void print() const;
     bool empty() const;
+    std::size_t size() const;
+    Compare key_comp() const;
+
+    // Remove and return the item with the smallest or largest key, using
+    // the cached end nodes instead of a search. Throw std::out_of_range
+    // on an empty tree.
+    std::pair<Key, Value> pop_min();
+    std::pair<Key, Value> pop_max();
 
     template<typename PPKey, typename PPValue>
     friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
 public:
     /**
     * An internal iterator class for traversing the contents of the BST.
+    * It is bidirectional: stepping back from end() lands on the largest
+    * item, which is why iterators remember their tree.
     */
     class iterator  // TODO
     {
     public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::pair<const Key, Value>* pointer;
+        typedef std::pair<const Key, Value>& reference;
+
         iterator();
 
         std::pair<const Key,Value>& operator*() const;
@@ -220,24 +424,175 @@ public:
         bool operator!=(const iterator& rhs) const;
 
         iterator& operator++();
+        iterator operator++(int);
+        iterator& operator--();
+        iterator operator--(int);
 
     protected:
-        friend class BinarySearchTree<Key, Value>;
-        iterator(Node<Key,Value>* ptr);
+        friend class BinarySearchTree<Key, Value, Compare>;
+        iterator(Node<Key,Value>* ptr, const BinarySearchTree<Key, Value, Compare>* tree);
         Node<Key, Value> *current_;
+        const BinarySearchTree<Key, Value, Compare>* tree_;
+    };
+
+    /**
+    * An iterator that only gives read access to the items. Any iterator
+    * converts to one.
+    */
+    class const_iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::pair<const Key, Value>* pointer;
+        typedef const std::pair<const Key, Value>& reference;
+
+        const_iterator();
+        const_iterator(const iterator& it);
+
+        const std::pair<const Key,Value>& operator*() const;
+        const std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
+
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+
+    protected:
+        iterator it_;
+    };
+
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+    /**
+    * Owns a node taken out of a tree by extract, until insert links it
+    * into a tree with the same node type. It keeps the pool chunk the
+    * node lives in alive, so the tree it came from may be cleared or
+    * destroyed in the meantime. A handle that is never inserted destroys
+    * the item; its block goes back to the system with the chunk.
+    */
+    class node_type
+    {
+    public:
+        node_type();
+        node_type(node_type&& other);
+        node_type& operator=(node_type&& other);
+        ~node_type();
+
+        bool empty() const;
+        explicit operator bool() const;
+        const Key& key() const;
+        Value& mapped() const;
+
+    private:
+        friend class BinarySearchTree<Key, Value, Compare>;
+        node_type(Node<Key, Value>* node, const NodePool& pool, const std::type_info& kind);
+        void reset();
+        node_type(const node_type&);
+        node_type& operator=(const node_type&);
+
+        Node<Key, Value>* node_;
+        NodePool::Chunk chunk_;
+        // the node's dynamic type, from the tree it came out of
+        const std::type_info* kind_;
+    };
+
+    struct insert_return_type
+    {
+        iterator position;
+        bool inserted;
+        node_type node;
     };
 
 public:
     iterator begin() const;
     iterator end() const;
+    const_iterator cbegin() const;
+    const_iterator cend() const;
+    reverse_iterator rbegin() const;
+    reverse_iterator rend() const;
+    const_reverse_iterator crbegin() const;
+    const_reverse_iterator crend() const;
     iterator find(const Key& key) const;
+    // Like std::map, operator[] inserts a default Value for a missing key;
+    // the const version throws std::out_of_range instead.
     Value& operator[](const Key& key);
+    Value& operator[](Key&& key);
     Value const & operator[](const Key& key) const;
 
+    // Single-descent updates. get_or_insert calls factory() for the value
+    // only when key is missing. upsert calls merge(value) on the stored
+    // value, default-constructed first if key was missing, and returns
+    // whether it inserted.
+    template<typename Factory>
+    Value& get_or_insert(const Key& key, Factory factory);
+    template<typename Merge>
+    bool upsert(const Key& key, Merge merge);
+
+    // Lookups by any type Compare can order against Key, without building
+    // a Key; only offered when Compare declares is_transparent. Only the
+    // non-const operator[] on a missing key builds one, to insert it.
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator find(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    Value& operator[](const K& key);
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    Value const & operator[](const K& key) const;
+
+    template<typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args);
+
+    // Inserts next to hint when the key belongs there, skipping the search
+    iterator insert(iterator hint, const std::pair<const Key, Value>& keyValuePair);
+    iterator insert(iterator hint, std::pair<const Key, Value>&& keyValuePair);
+
+    // Range queries. The bounds match std::map; count_range and erase_range
+    // cover the half-open range [lo, hi).
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    std::pair<iterator, iterator> equal_range(const Key& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator lower_bound(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator upper_bound(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    std::pair<iterator, iterator> equal_range(const K& key) const;
+    std::size_t count_range(const Key& lo, const Key& hi) const;
+    virtual void erase_range(const Key& lo, const Key& hi);
+
+    // Moving nodes between trees without copying the items or allocating
+    // nodes. extract unlinks a node and returns it in a handle; inserting
+    // the handle links it into this tree unless the key is taken, in which
+    // case the handle comes back in the result. merge moves over every
+    // node of other whose key this tree lacks. Nodes only move between
+    // trees with the same node type; otherwise these throw
+    // std::invalid_argument.
+    node_type extract(const Key& key);
+    node_type extract(iterator pos);
+    insert_return_type insert(node_type&& node);
+    void merge(BinarySearchTree& other);
+
+    // Removes the item at pos, found by a scan or find, without searching
+    // for its key again, and returns the iterator after it. Iterators to
+    // other items stay valid, so a scan can erase as it goes.
+    iterator erase(iterator pos);
+
 protected:
     // Mandatory helper functions
     Node<Key, Value>* internalFind(const Key& k) const; // TODO
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    Node<Key, Value>* internalFind(const K& k) const;
     Node<Key, Value> *getSmallestNode() const;  // TODO
+    Node<Key, Value> *getLargestNode() const;
     static Node<Key, Value>* predecessor(Node<Key, Value>* current); // TODO
     // Note:  static means these functions don't have a "this" pointer
     //        and instead just use the input argument.
@@ -249,12 +604,90 @@ protected:
     // Add helper functions here
     static Node<Key, Value>* successor(Node<Key, Value>* current);
     int height(Node<Key, Value>* current) const;
-    void recursiveClear(Node<Key, Value>* root);
+    std::size_t recursiveClear(Node<Key, Value>* root);
+
+    // Node storage, shared by derived trees with bigger node types
+    BinarySearchTree(std::size_t nodeSize, std::size_t nodeAlign, const Compare& comp = Compare());
+    template<typename NodeT, typename... Args>
+    NodeT* createNode(Args&&... args);
+    void destroyNode(Node<Key, Value>* node);
+
+    // Building blocks for the in-place inserts, shared with derived trees
+    Node<Key, Value>* findInsertPoint(const Key& key, Node<Key, Value>*& parent, bool& isLeft) const;
+    void linkNode(Node<Key, Value>* node, Node<Key, Value>* parent, bool isLeft);
+    bool keyLess(const Key& a, const Key& b) const;
+    Node<Key, Value>* findInsertPoint(iterator hint, const Key& key, Node<Key, Value>*& parent, bool& isLeft) const;
+    template<typename K, typename... Args>
+    std::pair<Node<Key, Value>*, bool> tryEmplaceNode(K&& key, Args&&... args);
+    template<typename K, typename... Args>
+    std::pair<Node<Key, Value>*, bool> tryEmplaceNodeHint(iterator hint, K&& key, Args&&... args);
+    template<typename Factory>
+    std::pair<Node<Key, Value>*, bool> tryEmplaceNodeFrom(const Key& key, Factory& factory);
+    template<typename... Args>
+    std::pair<Node<Key, Value>*, bool> emplaceNode(Args&&... args);
+    // Makes a node of this tree's node type around item; derived trees
+    // with bigger nodes override it. The inserts above link what it makes
+    // with adoptNode, so they work the same through a base reference.
+    virtual Node<Key, Value>* makeNode(Node<Key, Value>* parent, ItemMaker<Key, Value>& item);
+    // The type of the nodes makeNode makes. Node handles and merge check
+    // it, since node sizes can match across types (AVL_COMPACT_NODES).
+    virtual const std::type_info& nodeKind() const;
+    template<typename Build>
+    Node<Key, Value>* makeNodeWith(Node<Key, Value>* parent, Build& build);
+    iterator makeIterator(Node<Key, Value>* node) const;
+    static Node<Key, Value>* getNode(iterator it);
+    template<typename K>
+    Node<Key, Value>* lowerBoundNode(const K& key) const;
+    template<typename K>
+    Node<Key, Value>* upperBoundNode(const K& key) const;
+    void removeNode(Node<Key, Value>* badNode);
+    Node<Key, Value>* unlinkAndAdvance(Node<Key, Value>* badNode);
+    // Detach a node from the tree or hang a detached one under parent,
+    // leaving its storage alone; derived trees rebalance here.
+    virtual void unlinkNode(Node<Key, Value>* badNode);
+    virtual void adoptNode(Node<Key, Value>* node, Node<Key, Value>* parent, bool isLeft);
+
+    // Bookkeeping for size() and the cached end nodes. Inserts go through
+    // linkNode and removals call trackUnlink before unlinking; code that
+    // relinks whole subtrees sets count_ itself and calls refreshEnds.
+    static const std::size_t unknownSize = static_cast<std::size_t>(-1);
+    static std::size_t addSizes(std::size_t a, std::size_t b);
+    void trackUnlink(Node<Key, Value>* node);
+    void refreshEnds();
+    void detachAll();
+
+private:
+    // one descent per strategy; see ThreeWayCompare
+    typedef ThreeWayCompare<Key, Compare> KeyOrder;
+    typedef std::integral_constant<int, KeyOrder::descent> Descent;
+    typedef std::integral_constant<int, KeyOrder::twoWay> TwoWay;
+    typedef std::integral_constant<int, KeyOrder::threeWay> ThreeWay;
+    typedef std::integral_constant<int, KeyOrder::builtinCompare> Builtin;
+    template<typename K>
+    Node<Key, Value>* findNode(const K& key, TwoWay) const;
+    Node<Key, Value>* findNode(const Key& key, ThreeWay) const;
+    Node<Key, Value>* findNode(const Key& key, Builtin) const;
+    template<typename K>
+    Node<Key, Value>* findInsertPoint(const K& key, Node<Key, Value>*& parent, bool& isLeft, TwoWay) const;
+    Node<Key, Value>* findInsertPoint(const Key& key, Node<Key, Value>*& parent, bool& isLeft, ThreeWay) const;
+    Node<Key, Value>* findInsertPoint(const Key& key, Node<Key, Value>*& parent, bool& isLeft, Builtin) const;
 
 
 protected:
     Node<Key, Value>* root_;
-    // You should not need other data members
+    NodePool pool_;
+    Compare compare_;
+    // the number of items, or unknownSize until size() next counts them
+    mutable std::size_t count_;
+    // the nodes with the smallest and largest keys, NULL when empty.
+    // Rotations and nodeSwap move nodes without changing their items, so
+    // only links and unlinks can change these.
+    Node<Key, Value>* leftmost_;
+    Node<Key, Value>* rightmost_;
+
+private:
+    BinarySearchTree(const BinarySearchTree&);
+    BinarySearchTree& operator=(const BinarySearchTree&);
 };
 
 /*
@@ -264,31 +697,35 @@ Begin implementations for the BinarySearchTree::iterator class.
 */
 
 /**
-* Explicit constructor that initializes an iterator with a given node pointer.
+* Explicit constructor that initializes an iterator with a given node pointer
+* and the tree it belongs to.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr)
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::iterator::iterator(Node<Key,Value> *ptr,
+                                                         const BinarySearchTree<Key, Value, Compare>* tree)
 {
     // TODO
     current_ = ptr;
+    tree_ = tree;
 }
 
 /**
 * A default constructor that initializes the iterator to NULL.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator() 
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::iterator::iterator() 
 {
     // TODO
     current_ = NULL;
+    tree_ = NULL;
 }
 
 /**
 * Provides access to the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 std::pair<const Key,Value> &
-BinarySearchTree<Key, Value>::iterator::operator*() const
+BinarySearchTree<Key, Value, Compare>::iterator::operator*() const
 {
     return current_->getItem();
 }
@@ -296,9 +733,9 @@ BinarySearchTree<Key, Value>::iterator::operator*() const
 /**
 * Provides access to the address of the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 std::pair<const Key,Value> *
-BinarySearchTree<Key, Value>::iterator::operator->() const
+BinarySearchTree<Key, Value, Compare>::iterator::operator->() const
 {
     return &(current_->getItem());
 }
@@ -307,10 +744,10 @@ BinarySearchTree<Key, Value>::iterator::operator->() const
 * Checks if 'this' iterator's internals have the same value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 bool
-BinarySearchTree<Key, Value>::iterator::operator==(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Compare>::iterator::operator==(
+    const BinarySearchTree<Key, Value, Compare>::iterator& rhs) const
 {
     // TODO
     return this -> current_ == rhs.current_;
@@ -320,10 +757,10 @@ BinarySearchTree<Key, Value>::iterator::operator==(
 * Checks if 'this' iterator's internals have a different value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 bool
-BinarySearchTree<Key, Value>::iterator::operator!=(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Compare>::iterator::operator!=(
+    const BinarySearchTree<Key, Value, Compare>::iterator& rhs) const
 {
     // TODO
     return !(this -> current_ == rhs.current_);
@@ -333,9 +770,9 @@ BinarySearchTree<Key, Value>::iterator::operator!=(
 /**
 * Advances the iterator's location using an in-order sequencing
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator&
-BinarySearchTree<Key, Value>::iterator::operator++()
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator&
+BinarySearchTree<Key, Value, Compare>::iterator::operator++()
 {
     // TODO
     if (current_ != NULL){
@@ -344,6 +781,40 @@ BinarySearchTree<Key, Value>::iterator::operator++()
     return *this;
 }
 
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::iterator::operator++(int)
+{
+    iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+/**
+* Moves the iterator back to the previous item in key order. From end()
+* that is the largest item, which the tree keeps track of.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator&
+BinarySearchTree<Key, Value, Compare>::iterator::operator--()
+{
+    if (current_ != NULL){
+        current_ = predecessor(current_);
+    } else if (tree_ != NULL){
+        current_ = tree_ -> rightmost_;
+    }
+    return *this;
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::iterator::operator--(int)
+{
+    iterator old(*this);
+    --(*this);
+    return old;
+}
+
 
 /*
 -------------------------------------------------------------
@@ -352,187 +823,919 @@ End implementations for the BinarySearchTree::iterator class.
 */
 
 /*
------------------------------------------------------
-Begin implementations for the BinarySearchTree class.
------------------------------------------------------
+--------------------------------------------------------------------
+Begin implementations for the BinarySearchTree::const_iterator class.
+--------------------------------------------------------------------
 */
 
 /**
-* Default constructor for a BinarySearchTree, which sets the root to NULL.
+* A default constructor that makes an iterator equal to end().
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::BinarySearchTree() 
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::const_iterator::const_iterator()
 {
-    // TODO
-    root_ = NULL;
 
 }
 
-template<typename Key, typename Value>
-BinarySearchTree<Key, Value>::~BinarySearchTree()
+/**
+* Converts a mutable iterator, keeping its position.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::const_iterator::const_iterator(const iterator& it) :
+    it_(it)
 {
-    // TODO
-    clear();
 
 }
 
-/**
- * Returns true if tree is empty
-*/
-template<class Key, class Value>
-bool BinarySearchTree<Key, Value>::empty() const
+template<class Key, class Value, class Compare>
+const std::pair<const Key,Value> &
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator*() const
 {
-    return root_ == NULL;
+    return *it_;
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::print() const
+template<class Key, class Value, class Compare>
+const std::pair<const Key,Value> *
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator->() const
 {
-    printRoot(root_);
-    std::cout << "\n";
+    return it_.operator->();
 }
 
-/**
-* Returns an iterator to the "smallest" item in the tree
-*/
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::begin() const
+template<class Key, class Value, class Compare>
+bool
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator==(const const_iterator& rhs) const
 {
-    BinarySearchTree<Key, Value>::iterator begin(getSmallestNode());
-    return begin;
+    return it_ == rhs.it_;
+}
+
+template<class Key, class Value, class Compare>
+bool
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator!=(const const_iterator& rhs) const
+{
+    return it_ != rhs.it_;
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator&
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator++()
+{
+    ++it_;
+    return *this;
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator++(int)
+{
+    const_iterator old(*this);
+    ++it_;
+    return old;
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator&
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator--()
+{
+    --it_;
+    return *this;
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator--(int)
+{
+    const_iterator old(*this);
+    --it_;
+    return old;
 }
 
+/*
+------------------------------------------------------------------
+End implementations for the BinarySearchTree::const_iterator class.
+------------------------------------------------------------------
+*/
+
+/*
+---------------------------------------------------------------
+Begin implementations for the BinarySearchTree::node_type class.
+---------------------------------------------------------------
+*/
+
 /**
-* Returns an iterator whose value means INVALID
+* Creates an empty handle.
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::end() const
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::node_type::node_type() :
+    node_(NULL),
+    chunk_(),
+    kind_(NULL)
 {
-    BinarySearchTree<Key, Value>::iterator end(NULL);
-    return end;
+
 }
 
 /**
-* Returns an iterator to the item with the given key, k
-* or the end iterator if k does not exist in the tree
+* Takes ownership of node, already unlinked, which came out of pool and
+* whose dynamic type is kind.
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::find(const Key & k) const
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::node_type::node_type(Node<Key, Value>* node, const NodePool& pool,
+                                                            const std::type_info& kind) :
+    node_(node),
+    chunk_(pool.chunkOf(node)),
+    kind_(&kind)
 {
-    Node<Key, Value> *curr = internalFind(k);
-    BinarySearchTree<Key, Value>::iterator it(curr);
-    return it;
+
 }
 
-/**
- * @precondition The key exists in the map
- * Returns the value associated with the key
- */
-template<class Key, class Value>
-Value& BinarySearchTree<Key, Value>::operator[](const Key& key)
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::node_type::node_type(node_type&& other) :
+    node_(other.node_),
+    chunk_(std::move(other.chunk_)),
+    kind_(other.kind_)
 {
-    Node<Key, Value> *curr = internalFind(key);
-    if(curr == NULL) throw std::out_of_range("Invalid key");
-    return curr->getValue();
+    other.node_ = NULL;
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::node_type&
+BinarySearchTree<Key, Value, Compare>::node_type::operator=(node_type&& other)
+{
+    if (&other != this){
+        reset();
+        node_ = other.node_;
+        chunk_ = std::move(other.chunk_);
+        kind_ = other.kind_;
+        other.node_ = NULL;
+    }
+    return *this;
 }
-template<class Key, class Value>
-Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
+
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::node_type::~node_type()
 {
-    Node<Key, Value> *curr = internalFind(key);
-    if(curr == NULL) throw std::out_of_range("Invalid key");
-    return curr->getValue();
+    reset();
 }
 
 /**
-* An insert method to insert into a Binary Search Tree.
-* The tree will not remain balanced when inserting.
-* Recall: If key is already in the tree, you should 
-* overwrite the current value with the updated value.
+* Destroys the node, if any, and lets go of the chunk it lived in. Without
+* pooling the node was allocated on its own and is deleted.
 */
-template<class Key, class Value>
-void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::node_type::reset()
 {
-    // TODO
-
-    // traverse BST starting at root
-    Node<Key, Value>* temp = this -> root_;
-
-    // beginning node should be root, so its parent should be null
-    Node<Key, Value>* tempParent = NULL;
-
-    // traverse through list until insertion point is found
-    while (temp != NULL){
-        tempParent = temp;
-        
-        // key already exists, replace value
-        if (keyValuePair.first == temp -> getKey()){
-            temp -> setValue(keyValuePair.second); 
-            return;                  
-        }
-        else if (keyValuePair.first < temp -> getKey()){
-            temp = temp -> getLeft();
-        } 
-        else {
-            temp = temp -> getRight();     
+    if (node_ != NULL){
+        node_ -> ~Node();
+        if (!NodePool::releasesBlocks){
+            ::operator delete(node_);
         }
+        node_ = NULL;
     }
+    chunk_.memory.reset();
+}
 
-    // create new node with key/value from the argument
-    Node<Key, Value>* newPair = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, tempParent);
-    
-    // tree is empty, set new node as root
-    if (tempParent == NULL){
-        this -> root_ = newPair;
-        return;
+template<class Key, class Value, class Compare>
+bool BinarySearchTree<Key, Value, Compare>::node_type::empty() const
+{
+    return node_ == NULL;
+}
 
-    // add node as child of parent (check which side) 
-    } else if (keyValuePair.first < tempParent -> getKey()){
-        tempParent -> setLeft(newPair);
-        newPair -> setParent(tempParent);
-    } else {
-        tempParent -> setRight(newPair);
-        newPair -> setParent(tempParent);
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::node_type::operator bool() const
+{
+    return node_ != NULL;
+}
 
-    }
+template<class Key, class Value, class Compare>
+const Key& BinarySearchTree<Key, Value, Compare>::node_type::key() const
+{
+    return node_ -> getKey();
+}
 
+template<class Key, class Value, class Compare>
+Value& BinarySearchTree<Key, Value, Compare>::node_type::mapped() const
+{
+    return node_ -> getValue();
 }
 
+/*
+-------------------------------------------------------------
+End implementations for the BinarySearchTree::node_type class.
+-------------------------------------------------------------
+*/
+
+/*
+-----------------------------------------------------
+Begin implementations for the BinarySearchTree class.
+-----------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+const std::size_t BinarySearchTree<Key, Value, Compare>::unknownSize;
 
 /**
-* A remove method to remove a specific key from a Binary Search Tree.
-* Recall: The writeup specifies that if a node has 2 children you
-* should swap with the predecessor and then remove.
+* Default constructor for a BinarySearchTree, which sets the root to NULL.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::remove(const Key& key)
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree() :
+    pool_(sizeof(Node<Key, Value>), alignof(Node<Key, Value>)),
+    count_(0),
+    leftmost_(NULL),
+    rightmost_(NULL)
 {
     // TODO
-    // find if node exists to be removed
-    Node<Key, Value>* badNode = internalFind(key);
-    if (badNode == NULL){
-        return;
-    }
+    root_ = NULL;
 
-    // node has two children, so must swap with its predecessor before removing
-    if (badNode -> getLeft() != NULL && badNode -> getRight() != NULL){
-        Node<Key, Value>* temp = predecessor(badNode);
-        this -> nodeSwap(badNode, temp);
-    }
+}
 
-    // node has no children (leaf node)
-    if (badNode -> getRight() == NULL && badNode -> getLeft() == NULL){
-        // root case
-        if (badNode -> getParent() == NULL){
-            root_ = NULL;
-        } else {
-            // edit parent of node 
-            if ((badNode -> getParent()) -> getLeft() == badNode){
-                (badNode -> getParent()) -> setLeft(NULL);
-            } else {
-                (badNode -> getParent()) -> setRight(NULL);
+/**
+* Constructor for a tree ordered by the given comparison object.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree(const Compare& comp) :
+    root_(NULL),
+    pool_(sizeof(Node<Key, Value>), alignof(Node<Key, Value>)),
+    compare_(comp),
+    count_(0),
+    leftmost_(NULL),
+    rightmost_(NULL)
+{
+
+}
+
+/**
+* Constructor for derived trees, which sizes the node pool for their node type.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree(std::size_t nodeSize, std::size_t nodeAlign,
+                                                        const Compare& comp) :
+    root_(NULL),
+    pool_(nodeSize, nodeAlign),
+    compare_(comp),
+    count_(0),
+    leftmost_(NULL),
+    rightmost_(NULL)
+{
+
+}
+
+template<typename Key, typename Value, typename Compare>
+BinarySearchTree<Key, Value, Compare>::~BinarySearchTree()
+{
+    // TODO
+    clear();
+
+}
+
+/**
+ * Returns true if tree is empty
+*/
+template<class Key, class Value, class Compare>
+bool BinarySearchTree<Key, Value, Compare>::empty() const
+{
+    return root_ == NULL;
+}
+
+/**
+* Returns the number of items in the tree. This is a stored count, except
+* right after an AVLTree::split, which leaves it to be counted here once.
+*/
+template<class Key, class Value, class Compare>
+std::size_t BinarySearchTree<Key, Value, Compare>::size() const
+{
+    if (count_ == unknownSize){
+        count_ = 0;
+        for (Node<Key, Value>* temp = leftmost_; temp != NULL; temp = successor(temp)){
+            ++count_;
+        }
+    }
+    return count_;
+}
+
+/**
+* Removes the item with the smallest key and returns it.
+*/
+template<class Key, class Value, class Compare>
+std::pair<Key, Value> BinarySearchTree<Key, Value, Compare>::pop_min()
+{
+    if (leftmost_ == NULL){
+        throw std::out_of_range("Tree is empty");
+    }
+    std::pair<Key, Value> item(leftmost_ -> getKey(), std::move(leftmost_ -> getValue()));
+    removeNode(leftmost_);
+    return item;
+}
+
+/**
+* Removes the item with the largest key and returns it.
+*/
+template<class Key, class Value, class Compare>
+std::pair<Key, Value> BinarySearchTree<Key, Value, Compare>::pop_max()
+{
+    if (rightmost_ == NULL){
+        throw std::out_of_range("Tree is empty");
+    }
+    std::pair<Key, Value> item(rightmost_ -> getKey(), std::move(rightmost_ -> getValue()));
+    removeNode(rightmost_);
+    return item;
+}
+
+/**
+* Returns a copy of the comparison object that orders the keys.
+*/
+template<class Key, class Value, class Compare>
+Compare BinarySearchTree<Key, Value, Compare>::key_comp() const
+{
+    return compare_;
+}
+
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::print() const
+{
+    printRoot(root_);
+    std::cout << "\n";
+}
+
+/**
+* Returns an iterator to the "smallest" item in the tree
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::begin() const
+{
+    BinarySearchTree<Key, Value, Compare>::iterator begin(leftmost_, this);
+    return begin;
+}
+
+/**
+* Returns an iterator whose value means INVALID
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::end() const
+{
+    BinarySearchTree<Key, Value, Compare>::iterator end(NULL, this);
+    return end;
+}
+
+/**
+* Read-only versions of begin() and end().
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator
+BinarySearchTree<Key, Value, Compare>::cbegin() const
+{
+    return const_iterator(begin());
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator
+BinarySearchTree<Key, Value, Compare>::cend() const
+{
+    return const_iterator(end());
+}
+
+/**
+* Iterators over the items in descending key order; rbegin() is the
+* largest item.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::reverse_iterator
+BinarySearchTree<Key, Value, Compare>::rbegin() const
+{
+    return reverse_iterator(end());
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::reverse_iterator
+BinarySearchTree<Key, Value, Compare>::rend() const
+{
+    return reverse_iterator(begin());
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_reverse_iterator
+BinarySearchTree<Key, Value, Compare>::crbegin() const
+{
+    return const_reverse_iterator(cend());
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_reverse_iterator
+BinarySearchTree<Key, Value, Compare>::crend() const
+{
+    return const_reverse_iterator(cbegin());
+}
+
+/**
+* Returns an iterator to the item with the given key, k
+* or the end iterator if k does not exist in the tree
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::find(const Key & k) const
+{
+    Node<Key, Value> *curr = internalFind(k);
+    BinarySearchTree<Key, Value, Compare>::iterator it(curr, this);
+    return it;
+}
+
+/**
+ * Returns the value associated with the key, inserting a default-constructed
+ * value first if the key is missing. The search for the key also finds
+ * where a new node goes, so this is one descent either way. A derived tree
+ * may rebalance after the insert, which relinks nodes without moving
+ * items, so the reference returned stays valid.
+ */
+template<class Key, class Value, class Compare>
+Value& BinarySearchTree<Key, Value, Compare>::operator[](const Key& key)
+{
+    return tryEmplaceNode(key).first -> getValue();
+}
+
+template<class Key, class Value, class Compare>
+Value& BinarySearchTree<Key, Value, Compare>::operator[](Key&& key)
+{
+    return tryEmplaceNode(std::move(key)).first -> getValue();
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value, class Compare>
+Value const & BinarySearchTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    Node<Key, Value> *curr = internalFind(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+
+/**
+* Transparent versions of find and operator[]: key can be anything
+* Compare orders against Key (say, a const char* for string keys). The
+* only Key built from it is the new node's, when operator[] misses; the
+* same descent that missed gives the insert point.
+*/
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::find(const K& k) const
+{
+    BinarySearchTree<Key, Value, Compare>::iterator it(internalFind(k), this);
+    return it;
+}
+
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+Value& BinarySearchTree<Key, Value, Compare>::operator[](const K& key)
+{
+    // a transparent Compare is never std::less<Key>, so the descent is two-way
+    Node<Key, Value>* parent = NULL;
+    bool isLeft = false;
+    Node<Key, Value>* existing = findInsertPoint(key, parent, isLeft, TwoWay());
+    if(existing != NULL){
+        return existing->getValue();
+    }
+    auto build = [&]() {
+        return std::pair<const Key, Value>(std::piecewise_construct,
+                                           std::forward_as_tuple(key), std::forward_as_tuple());
+    };
+    Node<Key, Value>* node = makeNodeWith(parent, build);
+    adoptNode(node, parent, isLeft);
+    return node->getValue();
+}
+
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+Value const & BinarySearchTree<Key, Value, Compare>::operator[](const K& key) const
+{
+    Node<Key, Value> *curr = internalFind(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+
+/**
+* Returns the value for key, inserting factory() first if key is missing.
+*/
+template<class Key, class Value, class Compare>
+template<typename Factory>
+Value& BinarySearchTree<Key, Value, Compare>::get_or_insert(const Key& key, Factory factory)
+{
+    return tryEmplaceNodeFrom(key, factory).first -> getValue();
+}
+
+/**
+* Applies merge to the value for key, inserting a default-constructed value
+* first if key is missing. Returns true if key was inserted.
+*/
+template<class Key, class Value, class Compare>
+template<typename Merge>
+bool BinarySearchTree<Key, Value, Compare>::upsert(const Key& key, Merge merge)
+{
+    std::pair<Node<Key, Value>*, bool> result = tryEmplaceNode(key);
+    merge(result.first -> getValue());
+    return result.second;
+}
+
+/**
+* An insert method to insert into a Binary Search Tree.
+* The tree will not remain balanced when inserting.
+* Recall: If key is already in the tree, you should 
+* overwrite the current value with the updated value.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::insert(const std::pair<const Key, Value> &keyValuePair)
+{
+    // TODO
+
+    // traverse BST starting at root until insertion point is found
+    Node<Key, Value>* tempParent = NULL;
+    bool isLeft = false;
+    Node<Key, Value>* existing = findInsertPoint(keyValuePair.first, tempParent, isLeft);
+
+    // key already exists, replace value
+    if (existing != NULL){
+        existing -> setValue(keyValuePair.second);
+        return;
+    }
+
+    // create new node with key/value from the argument
+    Node<Key, Value>* newPair = createNode<Node<Key, Value> >(keyValuePair.first, keyValuePair.second, tempParent);
+    linkNode(newPair, tempParent, isLeft);
+}
+
+/**
+* An insert that moves the value into the tree instead of copying it,
+* either into a new node or over the old value of an existing key.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::insert(std::pair<const Key, Value>&& keyValuePair)
+{
+    std::pair<Node<Key, Value>*, bool> result =
+        tryEmplaceNode(keyValuePair.first, std::move(keyValuePair.second));
+
+    // key already exists, replace value
+    if (!result.second){
+        result.first -> setValue(std::move(keyValuePair.second));
+    }
+}
+
+/**
+* Constructs an item from args directly inside a new node, then links
+* it in unless its key is already present, in which case the new item is
+* discarded and the tree is unchanged (unlike insert, which overwrites).
+* Returns an iterator to the item with that key and whether it is new.
+*/
+template<class Key, class Value, class Compare>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::emplace(Args&&... args)
+{
+    std::pair<Node<Key, Value>*, bool> result = emplaceNode(std::forward<Args>(args)...);
+    return std::make_pair(makeIterator(result.first), result.second);
+}
+
+/**
+* If key is not present, inserts a node whose value is constructed in
+* place from args. Otherwise does nothing, and args are left untouched.
+* Returns an iterator to the item with that key and whether it is new.
+*/
+template<class Key, class Value, class Compare>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::try_emplace(const Key& key, Args&&... args)
+{
+    std::pair<Node<Key, Value>*, bool> result = tryEmplaceNode(key, std::forward<Args>(args)...);
+    return std::make_pair(makeIterator(result.first), result.second);
+}
+
+template<class Key, class Value, class Compare>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::try_emplace(Key&& key, Args&&... args)
+{
+    std::pair<Node<Key, Value>*, bool> result =
+        tryEmplaceNode(std::move(key), std::forward<Args>(args)...);
+    return std::make_pair(makeIterator(result.first), result.second);
+}
+
+/**
+* An insert that starts looking at hint instead of the root: if the key
+* goes right before hint (or after the largest key, for end()), it is
+* linked in with a couple of comparisons. A wrong hint only costs those
+* comparisons on top of the normal search. Passing the iterator returned
+* by the previous call makes loading keys in ascending order cheap.
+* As with insert, an existing key has its value overwritten.
+* Returns an iterator to the item with that key.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::insert(iterator hint, const std::pair<const Key, Value>& keyValuePair)
+{
+    std::pair<Node<Key, Value>*, bool> result = tryEmplaceNodeHint(hint, keyValuePair.first, keyValuePair.second);
+
+    // key already exists, replace value
+    if (!result.second){
+        result.first -> setValue(keyValuePair.second);
+    }
+    return iterator(result.first, this);
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::insert(iterator hint, std::pair<const Key, Value>&& keyValuePair)
+{
+    std::pair<Node<Key, Value>*, bool> result =
+        tryEmplaceNodeHint(hint, keyValuePair.first, std::move(keyValuePair.second));
+
+    // key already exists, replace value
+    if (!result.second){
+        result.first -> setValue(std::move(keyValuePair.second));
+    }
+    return iterator(result.first, this);
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key,
+* or end() if there is none.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    return iterator(lowerBoundNode(key), this);
+}
+
+/**
+* Returns an iterator to the first item whose key is greater than key,
+* or end() if there is none.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::upper_bound(const Key& key) const
+{
+    return iterator(upperBoundNode(key), this);
+}
+
+/**
+* Returns the range of items with the given key: empty, or just the one
+* item since keys are unique.
+*/
+template<class Key, class Value, class Compare>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator,
+          typename BinarySearchTree<Key, Value, Compare>::iterator>
+BinarySearchTree<Key, Value, Compare>::equal_range(const Key& key) const
+{
+    Node<Key, Value>* first = lowerBoundNode(key);
+    Node<Key, Value>* last = first;
+    if (first != NULL && !compare_(key, first -> getKey())){
+        last = successor(first);
+    }
+    return std::make_pair(iterator(first, this), iterator(last, this));
+}
+
+/**
+* Transparent versions of the bounds; see the transparent find.
+*/
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::lower_bound(const K& key) const
+{
+    return iterator(lowerBoundNode(key), this);
+}
+
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::upper_bound(const K& key) const
+{
+    return iterator(upperBoundNode(key), this);
+}
+
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator,
+          typename BinarySearchTree<Key, Value, Compare>::iterator>
+BinarySearchTree<Key, Value, Compare>::equal_range(const K& key) const
+{
+    Node<Key, Value>* first = lowerBoundNode(key);
+    Node<Key, Value>* last = first;
+    if (first != NULL && !compare_(key, first -> getKey())){
+        last = successor(first);
+    }
+    return std::make_pair(iterator(first, this), iterator(last, this));
+}
+
+/**
+* Returns how many keys lie in [lo, hi), by walking the range.
+*/
+template<class Key, class Value, class Compare>
+std::size_t BinarySearchTree<Key, Value, Compare>::count_range(const Key& lo, const Key& hi) const
+{
+    std::size_t count = 0;
+    if (!compare_(lo, hi)){
+        return count;
+    }
+    Node<Key, Value>* last = lowerBoundNode(hi);
+    for (Node<Key, Value>* temp = lowerBoundNode(lo); temp != last; temp = successor(temp)){
+        ++count;
+    }
+    return count;
+}
+
+/**
+* Removes every key in [lo, hi). Both ends are found up front, and the
+* nodes in between are then unlinked one after the other without
+* searching the tree again.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::erase_range(const Key& lo, const Key& hi)
+{
+    if (!compare_(lo, hi)){
+        return;
+    }
+    Node<Key, Value>* last = lowerBoundNode(hi);
+    Node<Key, Value>* temp = lowerBoundNode(lo);
+    while (temp != last){
+        Node<Key, Value>* next = unlinkAndAdvance(temp);
+        destroyNode(temp);
+        temp = next;
+    }
+}
+
+/**
+* Unlinks the node holding key and returns it in a handle, which is
+* empty if key is not in the tree.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::node_type
+BinarySearchTree<Key, Value, Compare>::extract(const Key& key)
+{
+    return extract(iterator(internalFind(key), this));
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::node_type
+BinarySearchTree<Key, Value, Compare>::extract(iterator pos)
+{
+    Node<Key, Value>* node = pos.current_;
+    if (node == NULL){
+        return node_type();
+    }
+    unlinkNode(node);
+    return node_type(node, pool_, nodeKind());
+}
+
+/**
+* Links the handle's node into the tree if its key is not there yet. The
+* tree then shares the chunks the node lives in.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::insert_return_type
+BinarySearchTree<Key, Value, Compare>::insert(node_type&& node)
+{
+    if (node.empty()){
+        insert_return_type result = {end(), false, node_type()};
+        return result;
+    }
+    if (*node.kind_ != nodeKind()){
+        throw std::invalid_argument("Node from a different kind of tree");
+    }
+    Node<Key, Value>* parent = NULL;
+    bool isLeft = false;
+    Node<Key, Value>* existing = findInsertPoint(node.key(), parent, isLeft);
+    if (existing != NULL){
+        insert_return_type result = {iterator(existing, this), false, std::move(node)};
+        return result;
+    }
+
+    pool_.share(node.chunk_);
+    Node<Key, Value>* adopted = node.node_;
+    node.node_ = NULL;
+    node.chunk_.memory.reset();
+    adoptNode(adopted, parent, isLeft);
+    insert_return_type result = {iterator(adopted, this), true, node_type()};
+    return result;
+}
+
+/**
+* Moves every node of other whose key is not in this tree over, in key
+* order, each search starting from the node moved before it. Nodes with
+* keys already here stay in other.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::merge(BinarySearchTree& other)
+{
+    if (&other == this || other.root_ == NULL){
+        return;
+    }
+    if (other.nodeKind() != nodeKind()){
+        throw std::invalid_argument("Node from a different kind of tree");
+    }
+    pool_.share(other.pool_);
+
+    iterator hint = end();
+    Node<Key, Value>* temp = other.leftmost_;
+    while (temp != NULL){
+        Node<Key, Value>* next = NULL;
+        Node<Key, Value>* parent = NULL;
+        bool isLeft = false;
+        Node<Key, Value>* existing = findInsertPoint(hint, temp -> getKey(), parent, isLeft);
+        if (existing == NULL){
+            next = other.unlinkAndAdvance(temp);
+            adoptNode(temp, parent, isLeft);
+            existing = temp;
+        } else {
+            next = successor(temp);
+        }
+        hint = iterator(existing, this);
+        temp = next;
+    }
+}
+
+/**
+* Unlinks the node pos points to and returns an iterator to its
+* successor, or end() if pos was the last item or end() itself.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::erase(iterator pos)
+{
+    Node<Key, Value>* badNode = pos.current_;
+    if (badNode == NULL){
+        return end();
+    }
+    Node<Key, Value>* next = unlinkAndAdvance(badNode);
+    destroyNode(badNode);
+    return iterator(next, this);
+}
+
+/**
+* A remove method to remove a specific key from a Binary Search Tree.
+* Recall: The writeup specifies that if a node has 2 children you
+* should swap with the predecessor and then remove.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::remove(const Key& key)
+{
+    // TODO
+    // find if node exists to be removed
+    Node<Key, Value>* badNode = internalFind(key);
+    if (badNode == NULL){
+        return;
+    }
+    removeNode(badNode);
+}
+
+/**
+* Unlinks badNode from the tree and frees it.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::removeNode(Node<Key, Value>* badNode)
+{
+    unlinkNode(badNode);
+    destroyNode(badNode); // free memory
+}
+
+/**
+* Takes badNode out of the tree without freeing it and returns the node
+* after it in key order, for loops that unlink as they walk.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::unlinkAndAdvance(Node<Key, Value>* badNode)
+{
+    // nodeSwap moves nodes, not items, so next stays valid
+    Node<Key, Value>* next = successor(badNode);
+    unlinkNode(badNode);
+    return next;
+}
+
+/**
+* Takes badNode out of the tree without freeing it.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::unlinkNode(Node<Key, Value>* badNode)
+{
+    trackUnlink(badNode);
+
+    // node has two children, so must swap with its predecessor before removing
+    if (badNode -> getLeft() != NULL && badNode -> getRight() != NULL){
+        Node<Key, Value>* temp = predecessor(badNode);
+        this -> nodeSwap(badNode, temp);
+    }
+
+    // node has no children (leaf node)
+    if (badNode -> getRight() == NULL && badNode -> getLeft() == NULL){
+        // root case
+        if (badNode -> getParent() == NULL){
+            root_ = NULL;
+        } else {
+            // edit parent of node 
+            if ((badNode -> getParent()) -> getLeft() == badNode){
+                (badNode -> getParent()) -> setLeft(NULL);
+            } else {
+                (badNode -> getParent()) -> setRight(NULL);
             }
         }
     } else {
@@ -561,14 +1764,13 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
         }
     }
 
-    delete badNode; // free memory
 }
 
 
 
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 Node<Key, Value>*
-BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
+BinarySearchTree<Key, Value, Compare>::predecessor(Node<Key, Value>* current)
 {
     // TODO
     if (current == NULL){
@@ -598,9 +1800,9 @@ BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
     return NULL;
 }
 
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 Node<Key, Value>*
-BinarySearchTree<Key, Value>::successor(Node<Key, Value>* current)
+BinarySearchTree<Key, Value, Compare>::successor(Node<Key, Value>* current)
 {
     // TODO
     if (current == NULL){
@@ -633,59 +1835,567 @@ BinarySearchTree<Key, Value>::successor(Node<Key, Value>* current)
 }
 
 // helper function for isBalanced() function
-// returns height of given node
-template<class Key, class Value>
-int BinarySearchTree<Key, Value>::height(Node<Key, Value>* current) const{
-    if (current == NULL) {
-        return 0;
+// returns height of given node, or -1 if some subtree is out of balance
+// walks the tree post-order with an explicit stack of frames instead of
+// recursing; a height-balanced tree of h levels holds at least fib(h + 2) - 1
+// nodes, so no balanced tree that fits in memory is deeper than maxDepth and
+// anything deeper can be reported unbalanced without looking further
+template<class Key, class Value, class Compare>
+int BinarySearchTree<Key, Value, Compare>::height(Node<Key, Value>* current) const{
+    static const int maxDepth = 96;
+    // leftHeight stays -2 until the left subtree of node has been measured
+    struct Frame {
+        Node<Key, Value>* node;
+        int leftHeight;
+    };
+    Frame frames[maxDepth];
+    int depth = 0;
+
+    Node<Key, Value>* n = current;
+    while (true){
+        // push n and its chain of left children
+        for (; n != NULL; n = n -> getLeft()){
+            if (depth == maxDepth){
+                return -1;
+            }
+            frames[depth].node = n;
+            frames[depth].leftHeight = -2;
+            ++depth;
+        }
+
+        // the subtree just finished is empty
+        int h = 0;
+        while (true){
+            if (depth == 0){
+                return h;
+            }
+            Frame& top = frames[depth - 1];
+            // left subtree done, measure the right one next
+            if (top.leftHeight == -2){
+                top.leftHeight = h;
+                n = top.node -> getRight();
+                break;
+            }
+
+            // both subtrees done; abs(1)
+            int leftHeight = top.leftHeight;
+            int rightHeight = h;
+            if ((rightHeight - leftHeight) * (rightHeight - leftHeight) > 1){
+                return -1;
+            }
+
+            // height is the max height of the left and right subtrees
+            h = 1 + std::max(leftHeight, rightHeight);
+            --depth;
+        }
     }
-    
-    // recursively get height of left subtree of node
-    int leftHeight = height(current -> getLeft());
+}
 
-    // recursively get height of right subtree of node
-    int rightHeight = height(current -> getRight());
-    
-    // if -1 is returned, that means (via other conditional) the difference in left subtree and right subtree height is greater than abs(1)
-    if (rightHeight == -1 || leftHeight == -1){
-        return -1;
+// helper function
+// frees root and everything under it in constant stack space: a node with a
+// left child is rotated right so the left child rises to the top, and a node
+// with no left child is freed and its right child takes over, which turns the
+// tree into a vine and frees it in one pass. Only child pointers are used, so
+// root may be a subtree detached from its parent. Returns the number of
+// nodes freed.
+template<class Key, class Value, class Compare>
+std::size_t BinarySearchTree<Key, Value, Compare>::recursiveClear(Node<Key, Value>* root){
+    std::size_t freed = 0;
+    while (root != NULL){
+        Node<Key, Value>* left = root -> getLeft();
+        if (left != NULL){
+            root -> setLeft(left -> getRight());
+            left -> setRight(root);
+            root = left;
+        } else {
+            Node<Key, Value>* right = root -> getRight();
+            destroyNode(root); // free memory
+            root = right;
+            ++freed;
+        }
     }
+    return freed;
+}
 
-    // abs(1)
-    if ((rightHeight - leftHeight) * (rightHeight - leftHeight) > 1){
-        return -1;
+/**
+* Allocates a node of type NodeT from the pool and constructs it from args.
+*/
+template<class Key, class Value, class Compare>
+template<typename NodeT, typename... Args>
+NodeT* BinarySearchTree<Key, Value, Compare>::createNode(Args&&... args)
+{
+    void* block = pool_.allocate();
+    try {
+        return new (block) NodeT(std::forward<Args>(args)...);
+    } catch (...) {
+        pool_.deallocate(block);
+        throw;
     }
-    
-    // returns height by getting the max height of the left and right subtrees
-    return 1 + std::max(leftHeight, rightHeight);
 }
 
-// helper function
-template<class Key, class Value>
-void BinarySearchTree<Key, Value>::recursiveClear(Node<Key, Value>* root){
-    if (root == NULL){
-        return;
+/**
+* Destroys a node and hands its block back to the pool.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::destroyNode(Node<Key, Value>* node)
+{
+    node -> ~Node();
+    pool_.deallocate(node);
+}
+
+/**
+* Returns the node holding key, or NULL if there is none, in which case
+* parent is set to the node a new node for key belongs under (NULL if
+* the tree is empty) and isLeft to the side it goes on.
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::findInsertPoint(const Key& key, Node<Key, Value>*& parent,
+                                                                         bool& isLeft) const
+{
+    return findInsertPoint(key, parent, isLeft, Descent());
+}
+
+template<class Key, class Value, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::findInsertPoint(const Key& key, Node<Key, Value>*& parent,
+                                                                         bool& isLeft, ThreeWay) const
+{
+    Node<Key, Value>* temp = root_;
+    parent = NULL;
+    isLeft = false;
+    while (temp != NULL){
+        int order = KeyOrder::compare(key, temp -> getKey());
+        if (order == 0){
+            return temp;
+        }
+        parent = temp;
+        isLeft = order < 0;
+        temp = isLeft ? temp -> getLeft() : temp -> getRight();
+    }
+    return NULL;
+}
+
+template<class Key, class Value, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::findInsertPoint(const Key& key, Node<Key, Value>*& parent,
+                                                                         bool& isLeft, Builtin) const
+{
+    Node<Key, Value>* temp = root_;
+    parent = NULL;
+    isLeft = false;
+    while (temp != NULL){
+        if (key == temp -> getKey()){
+            return temp;
+        }
+        parent = temp;
+        isLeft = key < temp -> getKey();
+        temp = isLeft ? temp -> getLeft() : temp -> getRight();
+    }
+    return NULL;
+}
+
+/**
+* The two-way version goes all the way down, keeping nothing but the last
+* node visited, so the loop stays short and branch-free. If key is in
+* the tree it is the smallest key not less than key: the last node itself
+* if the walk ended by going left, else that node's in-order successor,
+* one of the ancestors just passed.
+*/
+template<class Key, class Value, class Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::findInsertPoint(const K& key, Node<Key, Value>*& parent,
+                                                                         bool& isLeft, TwoWay) const
+{
+    Node<Key, Value>* temp = root_;
+    parent = NULL;
+    isLeft = false;
+    while (temp != NULL){
+        parent = temp;
+        temp = compare_(temp -> getKey(), key) ? temp -> getRight() : temp -> getLeft();
+    }
+    if (parent == NULL){
+        return NULL;
+    }
+
+    Node<Key, Value>* candidate = parent;
+    isLeft = !compare_(parent -> getKey(), key);
+    if (!isLeft){
+        candidate = successor(parent);
+    }
+    if (candidate != NULL && !compare_(key, candidate -> getKey())){
+        return candidate;
+    }
+    return NULL;
+}
+
+/**
+* findInsertPoint for the hinted inserts. The key belongs right before
+* hint when it orders between hint and hint's predecessor; it is then
+* linked as hint's left child or, if that is taken, as the predecessor's
+* right child. Inserting after hint's key is handled the same way, since
+* callers loading ascending keys usually pass the last item inserted.
+* Anything else falls back to the search from the root.
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::findInsertPoint(iterator hint, const Key& key,
+                                                                         Node<Key, Value>*& parent,
+                                                                         bool& isLeft) const
+{
+    Node<Key, Value>* next = hint.current_;
+    parent = NULL;
+    isLeft = false;
+    if (next == NULL){
+        // end(): the key goes after the largest one
+        Node<Key, Value>* last = rightmost_;
+        if (last == NULL){
+            return NULL;
+        }
+        if (compare_(last -> getKey(), key)){
+            parent = last;
+            return NULL;
+        }
+    } else if (compare_(key, next -> getKey())){
+        Node<Key, Value>* prev = predecessor(next);
+        if (prev == NULL || compare_(prev -> getKey(), key)){
+            if (next -> getLeft() == NULL){
+                parent = next;
+                isLeft = true;
+            } else {
+                parent = prev;
+            }
+            return NULL;
+        }
+    } else if (compare_(next -> getKey(), key)){
+        Node<Key, Value>* after = successor(next);
+        if (after == NULL || compare_(key, after -> getKey())){
+            if (next -> getRight() == NULL){
+                parent = next;
+            } else {
+                parent = after;
+                isLeft = true;
+            }
+            return NULL;
+        }
+    } else {
+        return next;
+    }
+
+    // bad hint, search from the root
+    return findInsertPoint(key, parent, isLeft);
+}
+
+/**
+* Hangs a new node under the parent found by findInsertPoint, on the
+* side it reported, or makes it the root if parent is NULL.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::linkNode(Node<Key, Value>* node, Node<Key, Value>* parent, bool isLeft)
+{
+    node -> setParent(parent);
+    if (parent == NULL){
+        root_ = node;
+        leftmost_ = node;
+        rightmost_ = node;
+    } else if (isLeft){
+        parent -> setLeft(node);
+        if (parent == leftmost_){
+            leftmost_ = node;
+        }
+    } else {
+        parent -> setRight(node);
+        if (parent == rightmost_){
+            rightmost_ = node;
+        }
+    }
+    count_ = addSizes(count_, 1);
+}
+
+/**
+* Links node, detached from this or another tree or just made by
+* makeNode, as a new leaf under parent, as findInsertPoint reported.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::adoptNode(Node<Key, Value>* node, Node<Key, Value>* parent, bool isLeft)
+{
+    node -> setLeft(NULL);
+    node -> setRight(NULL);
+    linkNode(node, parent, isLeft);
+}
+
+/**
+* Adds two item counts, either of which may be unknownSize.
+*/
+template<class Key, class Value, class Compare>
+std::size_t BinarySearchTree<Key, Value, Compare>::addSizes(std::size_t a, std::size_t b)
+{
+    return (a == unknownSize || b == unknownSize) ? unknownSize : a + b;
+}
+
+/**
+* Updates the count and the end nodes for node, which is about to be
+* unlinked. An end node has at most one child, so nodeSwap never moves
+* it, and its neighbour in key order stays in the tree.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::trackUnlink(Node<Key, Value>* node)
+{
+    if (node == leftmost_){
+        leftmost_ = successor(node);
+    }
+    if (node == rightmost_){
+        rightmost_ = predecessor(node);
+    }
+    if (count_ != unknownSize){
+        --count_;
+    }
+}
+
+/**
+* Empties the tree without freeing anything, once its nodes have been
+* handed to another tree.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::detachAll()
+{
+    root_ = NULL;
+    count_ = 0;
+    leftmost_ = NULL;
+    rightmost_ = NULL;
+}
+
+/**
+* Finds the end nodes again after whole subtrees have been relinked.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::refreshEnds()
+{
+    leftmost_ = getSmallestNode();
+    rightmost_ = getLargestNode();
+}
+
+/**
+* Orders two keys with the tree's comparison object.
+*/
+template<class Key, class Value, class Compare>
+bool BinarySearchTree<Key, Value, Compare>::keyLess(const Key& a, const Key& b) const
+{
+    return compare_(a, b);
+}
+
+/**
+* Makes a plain Node around item.
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::makeNode(Node<Key, Value>* parent,
+                                                                  ItemMaker<Key, Value>& item)
+{
+    return createNode<Node<Key, Value> >(parent, item);
+}
+
+/**
+* A plain tree's nodes are plain Nodes.
+*/
+template<class Key, class Value, class Compare>
+const std::type_info& BinarySearchTree<Key, Value, Compare>::nodeKind() const
+{
+    return typeid(Node<Key, Value>);
+}
+
+/**
+* makeNode for an item built by calling build().
+*/
+template<class Key, class Value, class Compare>
+template<typename Build>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::makeNodeWith(Node<Key, Value>* parent, Build& build)
+{
+    ItemBuilder<Key, Value, Build> item(build);
+    return makeNode(parent, item);
+}
+
+/**
+* Looks key up and, if it is missing, links in a new node whose value is
+* constructed from args. Returns the node with that key and whether it
+* was just created. The node comes from makeNode and is linked with
+* adoptNode, so derived trees get their own node type and rebalance.
+*/
+template<class Key, class Value, class Compare>
+template<typename K, typename... Args>
+std::pair<Node<Key, Value>*, bool> BinarySearchTree<Key, Value, Compare>::tryEmplaceNode(K&& key, Args&&... args)
+{
+    Node<Key, Value>* parent = NULL;
+    bool isLeft = false;
+    Node<Key, Value>* existing = findInsertPoint(key, parent, isLeft);
+    if (existing != NULL){
+        return std::make_pair(existing, false);
+    }
+    auto build = [&]() {
+        return std::pair<const Key, Value>(std::piecewise_construct,
+                                           std::forward_as_tuple(std::forward<K>(key)),
+                                           std::forward_as_tuple(std::forward<Args>(args)...));
+    };
+    Node<Key, Value>* node = makeNodeWith(parent, build);
+    adoptNode(node, parent, isLeft);
+    return std::make_pair(node, true);
+}
+
+/**
+* tryEmplaceNode for a value that is only worth building on a miss: the
+* new node's value is constructed from factory(), which is not called if
+* key is already present.
+*/
+template<class Key, class Value, class Compare>
+template<typename Factory>
+std::pair<Node<Key, Value>*, bool> BinarySearchTree<Key, Value, Compare>::tryEmplaceNodeFrom(const Key& key,
+                                                                                             Factory& factory)
+{
+    Node<Key, Value>* parent = NULL;
+    bool isLeft = false;
+    Node<Key, Value>* existing = findInsertPoint(key, parent, isLeft);
+    if (existing != NULL){
+        return std::make_pair(existing, false);
+    }
+    auto build = [&]() {
+        return std::pair<const Key, Value>(std::piecewise_construct,
+                                           std::forward_as_tuple(key), std::forward_as_tuple(factory()));
+    };
+    Node<Key, Value>* node = makeNodeWith(parent, build);
+    adoptNode(node, parent, isLeft);
+    return std::make_pair(node, true);
+}
+
+/**
+* tryEmplaceNode for the hinted inserts.
+*/
+template<class Key, class Value, class Compare>
+template<typename K, typename... Args>
+std::pair<Node<Key, Value>*, bool> BinarySearchTree<Key, Value, Compare>::tryEmplaceNodeHint(iterator hint, K&& key,
+                                                                                             Args&&... args)
+{
+    Node<Key, Value>* parent = NULL;
+    bool isLeft = false;
+    Node<Key, Value>* existing = findInsertPoint(hint, key, parent, isLeft);
+    if (existing != NULL){
+        return std::make_pair(existing, false);
+    }
+    auto build = [&]() {
+        return std::pair<const Key, Value>(std::piecewise_construct,
+                                           std::forward_as_tuple(std::forward<K>(key)),
+                                           std::forward_as_tuple(std::forward<Args>(args)...));
+    };
+    Node<Key, Value>* node = makeNodeWith(parent, build);
+    adoptNode(node, parent, isLeft);
+    return std::make_pair(node, true);
+}
+
+/**
+* Like tryEmplaceNode, but the whole item is constructed from args first,
+* since the key is only known afterwards. The node is destroyed again if
+* its key is already present.
+*/
+template<class Key, class Value, class Compare>
+template<typename... Args>
+std::pair<Node<Key, Value>*, bool> BinarySearchTree<Key, Value, Compare>::emplaceNode(Args&&... args)
+{
+    auto build = [&]() {
+        return std::pair<const Key, Value>(std::forward<Args>(args)...);
+    };
+    Node<Key, Value>* node = makeNodeWith(static_cast<Node<Key, Value>*>(NULL), build);
+    Node<Key, Value>* parent = NULL;
+    bool isLeft = false;
+    Node<Key, Value>* existing = NULL;
+    try {
+        existing = findInsertPoint(node -> getKey(), parent, isLeft);
+    } catch (...) {
+        destroyNode(node);
+        throw;
+    }
+    if (existing != NULL){
+        destroyNode(node);
+        return std::make_pair(existing, false);
+    }
+    adoptNode(node, parent, isLeft);
+    return std::make_pair(node, true);
+}
+
+/**
+* Lets derived trees hand out iterators to their nodes.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::makeIterator(Node<Key, Value>* node) const
+{
+    return iterator(node, this);
+}
+
+/**
+* The first node whose key is not less than key, or NULL. Like the
+* two-way findInsertPoint, it descends keeping only the last node and
+* steps to its successor at the end if that node is too small.
+*/
+template<class Key, class Value, class Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::lowerBoundNode(const K& key) const
+{
+    Node<Key, Value>* temp = root_;
+    Node<Key, Value>* last = NULL;
+    while (temp != NULL){
+        last = temp;
+        temp = compare_(temp -> getKey(), key) ? temp -> getRight() : temp -> getLeft();
     }
-    // recursively clears by calling left and right subtrees and getting to the end before deleting
-    recursiveClear(root -> getLeft());
-    recursiveClear(root -> getRight());
+    if (last != NULL && compare_(last -> getKey(), key)){
+        last = successor(last);
+    }
+    return last;
+}
+
+/**
+* The first node whose key is greater than key, or NULL.
+*/
+template<class Key, class Value, class Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::upperBoundNode(const K& key) const
+{
+    Node<Key, Value>* temp = root_;
+    Node<Key, Value>* last = NULL;
+    while (temp != NULL){
+        last = temp;
+        temp = compare_(key, temp -> getKey()) ? temp -> getLeft() : temp -> getRight();
+    }
+    if (last != NULL && !compare_(key, last -> getKey())){
+        last = successor(last);
+    }
+    return last;
+}
 
-    delete root; // free memory
+/**
+* The node an iterator points at, NULL for end().
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::getNode(iterator it)
+{
+    return it.current_;
 }
 
 /**
 * A method to remove all contents of the tree and
 * reset the values in the tree for use again.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clear()
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::clear()
 {
     // TODO
+    count_ = 0;
+    leftmost_ = NULL;
+    rightmost_ = NULL;
     if (root_ == NULL){
         return;
     }
-    // call helper function
-    recursiveClear(root_);
+    // nodes only need visiting if they hold something to destroy;
+    // otherwise dropping the pool's chunks frees them all at once
+    if (!NodePool::releasesBlocks ||
+        !std::is_trivially_destructible<Key>::value ||
+        !std::is_trivially_destructible<Value>::value){
+        recursiveClear(root_);
+    }
+    pool_.release();
 
     // set data member back to NULL
     root_ = NULL;
@@ -695,9 +2405,9 @@ void BinarySearchTree<Key, Value>::clear()
 /**
 * A helper function to find the smallest node in the tree.
 */
-template<typename Key, typename Value>
+template<typename Key, typename Value, typename Compare>
 Node<Key, Value>*
-BinarySearchTree<Key, Value>::getSmallestNode() const
+BinarySearchTree<Key, Value, Compare>::getSmallestNode() const
 {
     // TODO
     if (root_ == NULL){
@@ -712,41 +2422,104 @@ BinarySearchTree<Key, Value>::getSmallestNode() const
     return temp;
 }
 
+/**
+* A helper function to find the largest node in the tree.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Compare>::getLargestNode() const
+{
+    if (root_ == NULL){
+        return NULL;
+    }
+
+    // largest node is rightmost node in a BST
+    Node<Key, Value>* temp = root_;
+    while (temp -> getRight() != NULL){
+        temp = temp -> getRight();
+    }
+    return temp;
+}
+
 /**
 * Helper function to find a node with given key, k and
 * return a pointer to it or NULL if no item with that key
 * exists
 */
-template<typename Key, typename Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) const
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::internalFind(const Key& key) const
 {
     // TODO
-    Node<Key, Value>* temp = this -> root_;
-    if (temp == NULL){
-        return NULL;
-    }
+    return findNode(key, Descent());
+}
+
+/**
+* internalFind for a key of another type, ordered against the stored keys
+* by a transparent Compare.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename K, typename C, typename>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::internalFind(const K& key) const
+{
+    return findNode(key, TwoWay());
+}
 
-    // traverse BST to find node
+/**
+* internalFind for three-way comparable keys: one compare() per level,
+* stopping as soon as the key turns up.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::findNode(const Key& key, ThreeWay) const
+{
+    Node<Key, Value>* temp = root_;
     while (temp != NULL){
-        // returns pointer to node if found, continues iterating if not
-        if ((temp -> getItem()).first == key){
+        int order = KeyOrder::compare(key, temp -> getKey());
+        if (order == 0){
             return temp;
         }
-        if (key > (temp -> getItem()).first){
-            temp = temp -> getRight();
-        } else {
-            temp = temp -> getLeft();
+        temp = (order < 0) ? temp -> getLeft() : temp -> getRight();
+    }
+    // doesn't exist
+    return NULL;
+}
+
+/**
+* internalFind for arithmetic keys, where == and < compile down to one
+* comparison and the child is picked without a branch.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::findNode(const Key& key, Builtin) const
+{
+    Node<Key, Value>* temp = root_;
+    while (temp != NULL){
+        if (key == temp -> getKey()){
+            return temp;
         }
+        temp = (key < temp -> getKey()) ? temp -> getLeft() : temp -> getRight();
     }
     // doesn't exist
     return NULL;
 }
 
+/**
+* internalFind for any other Compare; see the two-way findInsertPoint.
+* It only ever passes key to compare_, so it also serves the transparent
+* lookups.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::findNode(const K& key, TwoWay) const
+{
+    Node<Key, Value>* parent = NULL;
+    bool isLeft = false;
+    return findInsertPoint(key, parent, isLeft, TwoWay());
+}
+
 /**
  * Return true iff the BST is balanced.
  */
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::isBalanced() const
+template<typename Key, typename Value, typename Compare>
+bool BinarySearchTree<Key, Value, Compare>::isBalanced() const
 {
     // TODO
     if (root_ == NULL){
@@ -762,8 +2535,8 @@ bool BinarySearchTree<Key, Value>::isBalanced() const
 
 
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
 {
     if((n1 == n2) || (n1 == NULL) || (n2 == NULL) ) {
         return;
@@ -0,0 +1,778 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+#include <type_traits>
+
+/**
+* A B+ tree map with the same insert/remove/find/operator[]/iterator
+* surface as BinarySearchTree, so it can stand in for an AVLTree.
+*
+* Each node holds up to Fanout sorted entries (leaves) or Fanout children
+* (internal nodes), so a lookup touches a handful of wide nodes instead
+* of one cache line per key, and the leaves are chained for iteration.
+* Every node except the root stays at least half full.
+*
+* Entries are stored as std::pair<const Key, Value> inside the leaves;
+* inserting or removing shifts entries within a leaf, so iterators are
+* invalidated by insert() and remove() of new or existing keys.
+*/
+template <typename Key, typename Value, std::size_t Fanout = 32>
+class BTree
+{
+public:
+    BTree();
+    ~BTree();
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    std::size_t size() const;
+
+protected:
+    struct BTreeLeaf;
+
+public:
+    /**
+    * An iterator over the entries in key order, walking the leaf chain.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        std::pair<const Key,Value>& operator*() const;
+        std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class BTree<Key, Value, Fanout>;
+        iterator(BTreeLeaf* leaf, std::size_t index);
+        BTreeLeaf* leaf_;
+        std::size_t index_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+protected:
+    typedef std::pair<const Key, Value> Item;
+
+    static const std::size_t leafMin = Fanout / 2;
+    static const std::size_t internalMinKeys = (Fanout + 1) / 2 - 1;
+    static const int maxDepth = 64;
+
+    /**
+    * Uninitialized room for N objects of type T; nodes construct and
+    * destroy their entries one at a time.
+    */
+    template<typename T, std::size_t N>
+    struct RawArray
+    {
+        T* at(std::size_t i) { return reinterpret_cast<T*>(&data_[i]); }
+        const T* at(std::size_t i) const { return reinterpret_cast<const T*>(&data_[i]); }
+
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type data_[N];
+    };
+
+    // count_ is the number of entries in a leaf, or of keys in an
+    // internal node (which then has count_ + 1 children)
+    struct BTreeNode
+    {
+        BTreeNode(bool leaf) : leaf_(leaf), count_(0) {}
+        bool leaf_;
+        std::size_t count_;
+    };
+
+    struct BTreeLeaf : public BTreeNode
+    {
+        BTreeLeaf() : BTreeNode(true), prev_(NULL), next_(NULL) {}
+        RawArray<Item, Fanout> items_;
+        BTreeLeaf* prev_;
+        BTreeLeaf* next_;
+    };
+
+    // keys_[i] is the smallest key reachable through children_[i + 1]
+    struct BTreeInternal : public BTreeNode
+    {
+        BTreeInternal() : BTreeNode(false) {}
+        RawArray<Key, Fanout - 1> keys_;
+        BTreeNode* children_[Fanout];
+    };
+
+    // one step of a root-to-leaf descent
+    struct PathStep
+    {
+        BTreeInternal* node;
+        std::size_t child;
+    };
+
+    BTreeLeaf* findLeaf(const Key& key, PathStep* path, int& depth) const;
+    static std::size_t leafLowerBound(const BTreeLeaf* leaf, const Key& key);
+    static std::size_t childIndex(const BTreeInternal* node, const Key& key);
+
+    static void moveItem(BTreeLeaf* to, std::size_t toIndex, BTreeLeaf* from, std::size_t fromIndex);
+    static void moveKey(BTreeInternal* to, std::size_t toIndex, BTreeInternal* from, std::size_t fromIndex);
+    static void eraseKeyAndRightChild(BTreeInternal* node, std::size_t i);
+
+    void insertIntoParent(PathStep* path, int depth, BTreeNode* left, const Key& separator, BTreeNode* right);
+    void fixLeafUnderflow(BTreeLeaf* leaf, PathStep* path, int depth);
+    void fixInternalUnderflow(BTreeInternal* node, PathStep* path, int depth);
+    void destroySubtree(BTreeNode* node);
+
+    BTreeNode* root_;
+    BTreeLeaf* first_;
+    std::size_t size_;
+
+private:
+    BTree(const BTree&);
+    BTree& operator=(const BTree&);
+};
+
+/*
+  --------------------------------------------------
+  Begin implementations for the BTree::iterator class.
+  --------------------------------------------------
+*/
+
+template<typename Key, typename Value, std::size_t Fanout>
+BTree<Key, Value, Fanout>::iterator::iterator() :
+    leaf_(NULL),
+    index_(0)
+{
+
+}
+
+template<typename Key, typename Value, std::size_t Fanout>
+BTree<Key, Value, Fanout>::iterator::iterator(BTreeLeaf* leaf, std::size_t index) :
+    leaf_(leaf),
+    index_(index)
+{
+
+}
+
+template<typename Key, typename Value, std::size_t Fanout>
+std::pair<const Key,Value>&
+BTree<Key, Value, Fanout>::iterator::operator*() const
+{
+    return *leaf_ -> items_.at(index_);
+}
+
+template<typename Key, typename Value, std::size_t Fanout>
+std::pair<const Key,Value>*
+BTree<Key, Value, Fanout>::iterator::operator->() const
+{
+    return leaf_ -> items_.at(index_);
+}
+
+template<typename Key, typename Value, std::size_t Fanout>
+bool BTree<Key, Value, Fanout>::iterator::operator==(const iterator& rhs) const
+{
+    return leaf_ == rhs.leaf_ && index_ == rhs.index_;
+}
+
+template<typename Key, typename Value, std::size_t Fanout>
+bool BTree<Key, Value, Fanout>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Advances within the leaf, then on to the next leaf in the chain.
+*/
+template<typename Key, typename Value, std::size_t Fanout>
+typename BTree<Key, Value, Fanout>::iterator&
+BTree<Key, Value, Fanout>::iterator::operator++()
+{
+    if (leaf_ != NULL && ++index_ == leaf_ -> count_){
+        leaf_ = leaf_ -> next_;
+        index_ = 0;
+    }
+    return *this;
+}
+
+/*
+  ------------------------------------------
+  Begin implementations for the BTree class.
+  ------------------------------------------
+*/
+
+template<typename Key, typename Value, std::size_t Fanout>
+BTree<Key, Value, Fanout>::BTree() :
+    root_(NULL),
+    first_(NULL),
+    size_(0)
+{
+    static_assert(Fanout >= 4, "BTree needs a fanout of at least 4");
+}
+
+template<typename Key, typename Value, std::size_t Fanout>
+BTree<Key, Value, Fanout>::~BTree()
+{
+    clear();
+}
+
+template<typename Key, typename Value, std::size_t Fanout>
+bool BTree<Key, Value, Fanout>::empty() const
+{
+    return root_ == NULL;
+}
+
+template<typename Key, typename Value, std::size_t Fanout>
+std::size_t BTree<Key, Value, Fanout>::size() const
+{
+    return size_;
+}
+
+template<typename Key, typename Value, std::size_t Fanout>
+typename BTree<Key, Value, Fanout>::iterator
+BTree<Key, Value, Fanout>::begin() const
+{
+    return iterator(first_, 0);
+}
+
+template<typename Key, typename Value, std::size_t Fanout>
+typename BTree<Key, Value, Fanout>::iterator
+BTree<Key, Value, Fanout>::end() const
+{
+    return iterator(NULL, 0);
+}
+
+template<typename Key, typename Value, std::size_t Fanout>
+typename BTree<Key, Value, Fanout>::iterator
+BTree<Key, Value, Fanout>::find(const Key& key) const
+{
+    PathStep path[maxDepth];
+    int depth = 0;
+    BTreeLeaf* leaf = findLeaf(key, path, depth);
+    if (leaf == NULL){
+        return end();
+    }
+    std::size_t pos = leafLowerBound(leaf, key);
+    if (pos == leaf -> count_ || key < leaf -> items_.at(pos) -> first){
+        return end();
+    }
+    return iterator(leaf, pos);
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<typename Key, typename Value, std::size_t Fanout>
+Value& BTree<Key, Value, Fanout>::operator[](const Key& key)
+{
+    iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return it -> second;
+}
+
+template<typename Key, typename Value, std::size_t Fanout>
+Value const & BTree<Key, Value, Fanout>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return it -> second;
+}
+
+/**
+* Returns the position of the first entry in leaf not less than key.
+*/
+template<typename Key, typename Value, std::size_t Fanout>
+std::size_t BTree<Key, Value, Fanout>::leafLowerBound(const BTreeLeaf* leaf, const Key& key)
+{
+    std::size_t lo = 0;
+    std::size_t hi = leaf -> count_;
+    while (lo < hi){
+        std::size_t mid = lo + (hi - lo) / 2;
+        if (leaf -> items_.at(mid) -> first < key){
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+* Returns which child of node may hold key: the number of separator
+* keys that are not greater than key.
+*/
+template<typename Key, typename Value, std::size_t Fanout>
+std::size_t BTree<Key, Value, Fanout>::childIndex(const BTreeInternal* node, const Key& key)
+{
+    std::size_t lo = 0;
+    std::size_t hi = node -> count_;
+    while (lo < hi){
+        std::size_t mid = lo + (hi - lo) / 2;
+        if (key < *node -> keys_.at(mid)){
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+/**
+* Descends to the leaf that holds (or would hold) key, recording the
+* internal nodes passed in path. Returns NULL for an empty tree.
+*/
+template<typename Key, typename Value, std::size_t Fanout>
+typename BTree<Key, Value, Fanout>::BTreeLeaf*
+BTree<Key, Value, Fanout>::findLeaf(const Key& key, PathStep* path, int& depth) const
+{
+    depth = 0;
+    BTreeNode* node = root_;
+    if (node == NULL){
+        return NULL;
+    }
+    while (!node -> leaf_){
+        BTreeInternal* internal = static_cast<BTreeInternal*>(node);
+        std::size_t child = childIndex(internal, key);
+        path[depth].node = internal;
+        path[depth].child = child;
+        ++depth;
+        node = internal -> children_[child];
+    }
+    return static_cast<BTreeLeaf*>(node);
+}
+
+/**
+* Move-constructs an entry into an empty slot and destroys the source.
+*/
+template<typename Key, typename Value, std::size_t Fanout>
+void BTree<Key, Value, Fanout>::moveItem(BTreeLeaf* to, std::size_t toIndex, BTreeLeaf* from, std::size_t fromIndex)
+{
+    Item* source = from -> items_.at(fromIndex);
+    new (to -> items_.at(toIndex)) Item(std::move(*source));
+    source -> ~Item();
+}
+
+/**
+* Move-constructs a separator key into an empty slot and destroys the source.
+*/
+template<typename Key, typename Value, std::size_t Fanout>
+void BTree<Key, Value, Fanout>::moveKey(BTreeInternal* to, std::size_t toIndex, BTreeInternal* from, std::size_t fromIndex)
+{
+    Key* source = from -> keys_.at(fromIndex);
+    new (to -> keys_.at(toIndex)) Key(std::move(*source));
+    source -> ~Key();
+}
+
+/**
+* Removes separator i and the child to its right from node.
+*/
+template<typename Key, typename Value, std::size_t Fanout>
+void BTree<Key, Value, Fanout>::eraseKeyAndRightChild(BTreeInternal* node, std::size_t i)
+{
+    node -> keys_.at(i) -> ~Key();
+    for (std::size_t j = i + 1; j < node -> count_; ++j){
+        moveKey(node, j - 1, node, j);
+    }
+    for (std::size_t j = i + 2; j <= node -> count_; ++j){
+        node -> children_[j - 1] = node -> children_[j];
+    }
+    --node -> count_;
+}
+
+/**
+* Inserts a key/value pair, overwriting the value if the key exists.
+* A full leaf is split in two and the split propagates up as needed.
+*/
+template<typename Key, typename Value, std::size_t Fanout>
+void BTree<Key, Value, Fanout>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    const Key& key = keyValuePair.first;
+
+    // tree is empty, start with a single leaf
+    if (root_ == NULL){
+        BTreeLeaf* leaf = new BTreeLeaf;
+        try {
+            new (leaf -> items_.at(0)) Item(keyValuePair);
+        } catch (...) {
+            delete leaf;
+            throw;
+        }
+        leaf -> count_ = 1;
+        root_ = first_ = leaf;
+        size_ = 1;
+        return;
+    }
+
+    PathStep path[maxDepth];
+    int depth = 0;
+    BTreeLeaf* leaf = findLeaf(key, path, depth);
+    std::size_t pos = leafLowerBound(leaf, key);
+
+    // key already exists, replace value
+    if (pos < leaf -> count_ && !(key < leaf -> items_.at(pos) -> first)){
+        leaf -> items_.at(pos) -> second = keyValuePair.second;
+        return;
+    }
+
+    // the full leaf case moves its upper half out first
+    BTreeLeaf* target = leaf;
+    BTreeLeaf* right = NULL;
+    if (leaf -> count_ == Fanout){
+        right = new BTreeLeaf;
+        std::size_t leftCount = (Fanout + 1) / 2;
+        std::size_t splitAt = (pos < leftCount) ? leftCount - 1 : leftCount;
+        for (std::size_t i = splitAt; i < Fanout; ++i){
+            moveItem(right, i - splitAt, leaf, i);
+        }
+        right -> count_ = Fanout - splitAt;
+        leaf -> count_ = splitAt;
+
+        right -> next_ = leaf -> next_;
+        right -> prev_ = leaf;
+        if (leaf -> next_ != NULL){
+            leaf -> next_ -> prev_ = right;
+        }
+        leaf -> next_ = right;
+
+        if (pos >= leftCount){
+            target = right;
+            pos -= splitAt;
+        }
+    }
+
+    // shift entries up and construct the new one in place
+    for (std::size_t i = target -> count_; i > pos; --i){
+        moveItem(target, i, target, i - 1);
+    }
+    try {
+        new (target -> items_.at(pos)) Item(keyValuePair);
+    } catch (...) {
+        for (std::size_t i = pos; i < target -> count_; ++i){
+            moveItem(target, i, target, i + 1);
+        }
+        throw;
+    }
+    ++target -> count_;
+    ++size_;
+
+    if (right != NULL){
+        insertIntoParent(path, depth, leaf, right -> items_.at(0) -> first, right);
+    }
+}
+
+/**
+* Adds separator and the new node right, which was split off left, to the
+* parent recorded at path[depth - 1], splitting parents as needed and
+* growing a new root when the old root splits.
+*/
+template<typename Key, typename Value, std::size_t Fanout>
+void BTree<Key, Value, Fanout>::insertIntoParent(PathStep* path, int depth, BTreeNode* left,
+                                                 const Key& separator, BTreeNode* right)
+{
+    Key sep(separator);
+    while (true){
+        // the root was split
+        if (depth == 0){
+            BTreeInternal* root = new BTreeInternal;
+            new (root -> keys_.at(0)) Key(std::move(sep));
+            root -> children_[0] = left;
+            root -> children_[1] = right;
+            root -> count_ = 1;
+            root_ = root;
+            return;
+        }
+
+        BTreeInternal* parent = path[depth - 1].node;
+        std::size_t idx = path[depth - 1].child;
+        --depth;
+
+        if (parent -> count_ < Fanout - 1){
+            for (std::size_t i = parent -> count_; i > idx; --i){
+                moveKey(parent, i, parent, i - 1);
+                parent -> children_[i + 1] = parent -> children_[i];
+            }
+            new (parent -> keys_.at(idx)) Key(std::move(sep));
+            parent -> children_[idx + 1] = right;
+            ++parent -> count_;
+            return;
+        }
+
+        // gather all Fanout keys and Fanout + 1 children in order, then
+        // deal them out between parent and a new sibling
+        std::vector<Key> keys;
+        keys.reserve(Fanout);
+        BTreeNode* children[Fanout + 1];
+        for (std::size_t i = 0; i < parent -> count_; ++i){
+            if (i == idx){
+                keys.push_back(std::move(sep));
+            }
+            keys.push_back(std::move(*parent -> keys_.at(i)));
+            parent -> keys_.at(i) -> ~Key();
+        }
+        if (idx == parent -> count_){
+            keys.push_back(std::move(sep));
+        }
+        for (std::size_t i = 0, j = 0; i <= Fanout; ++i){
+            children[i] = (i == idx + 1) ? right : parent -> children_[j++];
+        }
+
+        std::size_t leftChildren = (Fanout + 1) / 2;
+        BTreeInternal* sibling = new BTreeInternal;
+        for (std::size_t i = 0; i + 1 < leftChildren; ++i){
+            new (parent -> keys_.at(i)) Key(std::move(keys[i]));
+            parent -> children_[i] = children[i];
+        }
+        parent -> children_[leftChildren - 1] = children[leftChildren - 1];
+        parent -> count_ = leftChildren - 1;
+
+        for (std::size_t i = leftChildren; i < Fanout; ++i){
+            new (sibling -> keys_.at(i - leftChildren)) Key(std::move(keys[i]));
+        }
+        for (std::size_t i = leftChildren; i <= Fanout; ++i){
+            sibling -> children_[i - leftChildren] = children[i];
+        }
+        sibling -> count_ = Fanout - leftChildren;
+
+        // the middle key moves up a level
+        sep = std::move(keys[leftChildren - 1]);
+        left = parent;
+        right = sibling;
+    }
+}
+
+/**
+* Removes the key if present. Leaves and internal nodes that drop below
+* half full borrow from a sibling, or merge with one when neither can spare.
+*/
+template<typename Key, typename Value, std::size_t Fanout>
+void BTree<Key, Value, Fanout>::remove(const Key& key)
+{
+    PathStep path[maxDepth];
+    int depth = 0;
+    BTreeLeaf* leaf = findLeaf(key, path, depth);
+    if (leaf == NULL){
+        return;
+    }
+    std::size_t pos = leafLowerBound(leaf, key);
+    if (pos == leaf -> count_ || key < leaf -> items_.at(pos) -> first){
+        return;
+    }
+
+    leaf -> items_.at(pos) -> ~Item();
+    for (std::size_t i = pos + 1; i < leaf -> count_; ++i){
+        moveItem(leaf, i - 1, leaf, i);
+    }
+    --leaf -> count_;
+    --size_;
+
+    if (depth == 0){
+        // the root leaf may shrink down to nothing
+        if (leaf -> count_ == 0){
+            delete leaf;
+            root_ = NULL;
+            first_ = NULL;
+        }
+        return;
+    }
+    if (leaf -> count_ < leafMin){
+        fixLeafUnderflow(leaf, path, depth);
+    }
+}
+
+template<typename Key, typename Value, std::size_t Fanout>
+void BTree<Key, Value, Fanout>::fixLeafUnderflow(BTreeLeaf* leaf, PathStep* path, int depth)
+{
+    BTreeInternal* parent = path[depth - 1].node;
+    std::size_t idx = path[depth - 1].child;
+    BTreeLeaf* left = (idx > 0) ? static_cast<BTreeLeaf*>(parent -> children_[idx - 1]) : NULL;
+    BTreeLeaf* right = (idx < parent -> count_) ? static_cast<BTreeLeaf*>(parent -> children_[idx + 1]) : NULL;
+
+    // borrow the largest entry of the left sibling
+    if (left != NULL && left -> count_ > leafMin){
+        for (std::size_t i = leaf -> count_; i > 0; --i){
+            moveItem(leaf, i, leaf, i - 1);
+        }
+        moveItem(leaf, 0, left, left -> count_ - 1);
+        --left -> count_;
+        ++leaf -> count_;
+        *parent -> keys_.at(idx - 1) = leaf -> items_.at(0) -> first;
+        return;
+    }
+
+    // borrow the smallest entry of the right sibling
+    if (right != NULL && right -> count_ > leafMin){
+        moveItem(leaf, leaf -> count_, right, 0);
+        for (std::size_t i = 1; i < right -> count_; ++i){
+            moveItem(right, i - 1, right, i);
+        }
+        --right -> count_;
+        ++leaf -> count_;
+        *parent -> keys_.at(idx) = right -> items_.at(0) -> first;
+        return;
+    }
+
+    // merge with a sibling; always fold the right leaf into the left one
+    std::size_t sepIndex = idx;
+    if (left != NULL){
+        right = leaf;
+        leaf = left;
+        sepIndex = idx - 1;
+    }
+    for (std::size_t i = 0; i < right -> count_; ++i){
+        moveItem(leaf, leaf -> count_ + i, right, i);
+    }
+    leaf -> count_ += right -> count_;
+    leaf -> next_ = right -> next_;
+    if (right -> next_ != NULL){
+        right -> next_ -> prev_ = leaf;
+    }
+    delete right;
+
+    eraseKeyAndRightChild(parent, sepIndex);
+    fixInternalUnderflow(parent, path, depth - 1);
+}
+
+/**
+* Restores the minimum fill of node, whose parent is path[depth - 1],
+* after it lost a child. Collapses the root when it has a single child.
+*/
+template<typename Key, typename Value, std::size_t Fanout>
+void BTree<Key, Value, Fanout>::fixInternalUnderflow(BTreeInternal* node, PathStep* path, int depth)
+{
+    while (true){
+        if (depth == 0){
+            if (node -> count_ == 0){
+                root_ = node -> children_[0];
+                delete node;
+            }
+            return;
+        }
+        if (node -> count_ >= internalMinKeys){
+            return;
+        }
+
+        BTreeInternal* parent = path[depth - 1].node;
+        std::size_t idx = path[depth - 1].child;
+        BTreeInternal* left = (idx > 0) ? static_cast<BTreeInternal*>(parent -> children_[idx - 1]) : NULL;
+        BTreeInternal* right = (idx < parent -> count_) ? static_cast<BTreeInternal*>(parent -> children_[idx + 1]) : NULL;
+
+        // rotate the left sibling's last child over through the parent
+        if (left != NULL && left -> count_ > internalMinKeys){
+            for (std::size_t i = node -> count_; i > 0; --i){
+                moveKey(node, i, node, i - 1);
+            }
+            for (std::size_t i = node -> count_ + 1; i > 0; --i){
+                node -> children_[i] = node -> children_[i - 1];
+            }
+            moveKey(node, 0, parent, idx - 1);
+            node -> children_[0] = left -> children_[left -> count_];
+            moveKey(parent, idx - 1, left, left -> count_ - 1);
+            --left -> count_;
+            ++node -> count_;
+            return;
+        }
+
+        // rotate the right sibling's first child over through the parent
+        if (right != NULL && right -> count_ > internalMinKeys){
+            moveKey(node, node -> count_, parent, idx);
+            node -> children_[node -> count_ + 1] = right -> children_[0];
+            moveKey(parent, idx, right, 0);
+            for (std::size_t i = 1; i < right -> count_; ++i){
+                moveKey(right, i - 1, right, i);
+            }
+            for (std::size_t i = 1; i <= right -> count_; ++i){
+                right -> children_[i - 1] = right -> children_[i];
+            }
+            --right -> count_;
+            ++node -> count_;
+            return;
+        }
+
+        // merge with a sibling, pulling the separator down between them
+        std::size_t sepIndex = idx;
+        if (left != NULL){
+            right = node;
+            node = left;
+            sepIndex = idx - 1;
+        }
+        moveKey(node, node -> count_, parent, sepIndex);
+        for (std::size_t i = 0; i < right -> count_; ++i){
+            moveKey(node, node -> count_ + 1 + i, right, i);
+        }
+        for (std::size_t i = 0; i <= right -> count_; ++i){
+            node -> children_[node -> count_ + 1 + i] = right -> children_[i];
+        }
+        node -> count_ += right -> count_ + 1;
+        delete right;
+
+        // the separator was moved out already; only close the gap
+        for (std::size_t j = sepIndex + 1; j < parent -> count_; ++j){
+            moveKey(parent, j - 1, parent, j);
+        }
+        for (std::size_t j = sepIndex + 2; j <= parent -> count_; ++j){
+            parent -> children_[j - 1] = parent -> children_[j];
+        }
+        --parent -> count_;
+
+        node = parent;
+        --depth;
+    }
+}
+
+/**
+* Frees every node below (and including) node, destroying their contents.
+*/
+template<typename Key, typename Value, std::size_t Fanout>
+void BTree<Key, Value, Fanout>::destroySubtree(BTreeNode* node)
+{
+    if (node -> leaf_){
+        BTreeLeaf* leaf = static_cast<BTreeLeaf*>(node);
+        for (std::size_t i = 0; i < leaf -> count_; ++i){
+            leaf -> items_.at(i) -> ~Item();
+        }
+        delete leaf;
+        return;
+    }
+    BTreeInternal* internal = static_cast<BTreeInternal*>(node);
+    for (std::size_t i = 0; i <= internal -> count_; ++i){
+        destroySubtree(internal -> children_[i]);
+    }
+    for (std::size_t i = 0; i < internal -> count_; ++i){
+        internal -> keys_.at(i) -> ~Key();
+    }
+    delete internal;
+}
+
+/**
+* A method to remove all contents of the tree and
+* reset the values in the tree for use again.
+*/
+template<typename Key, typename Value, std::size_t Fanout>
+void BTree<Key, Value, Fanout>::clear()
+{
+    if (root_ != NULL){
+        destroySubtree(root_);
+    }
+    root_ = NULL;
+    first_ = NULL;
+    size_ = 0;
+}
+
+/*
+  ----------------------------------------
+  End implementations for the BTree class.
+  ----------------------------------------
+*/
+
+#endif
@@ -0,0 +1,1349 @@
+#ifndef CONCURRENT_AVL_H
+#define CONCURRENT_AVL_H
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <stdexcept>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#include <new>
+#include <type_traits>
+#include "bst.h"
+
+/**
+* Epoch based reclamation for structures whose readers take no locks.
+*
+* A thread pins the domain for the length of one operation. Memory it
+* unlinks is retired rather than freed, tagged with the current epoch,
+* and freed once the epoch has moved on twice: the epoch only advances
+* past e when no thread is still pinned in an epoch before e, so by then
+* no thread can hold a pointer into the retired memory.
+*
+* Pinned threads each hold one of a fixed number of slots, and keep
+* their retired memory in that slot, so retiring takes no lock.
+*/
+class EpochDomain
+{
+public:
+    EpochDomain();
+    ~EpochDomain();
+
+    std::size_t pin();
+    void unpin(std::size_t slot);
+    void retire(std::size_t slot, void* block, void (*destroy)(void*));
+
+    /**
+    * Keeps the domain pinned for as long as it lives.
+    */
+    class Guard
+    {
+    public:
+        explicit Guard(EpochDomain& domain) : domain_(domain), slot_(domain.pin()) {}
+        ~Guard() { domain_.unpin(slot_); }
+        void retire(void* block, void (*destroy)(void*)) { domain_.retire(slot_, block, destroy); }
+
+    private:
+        Guard(const Guard&);
+        Guard& operator=(const Guard&);
+
+        EpochDomain& domain_;
+        std::size_t slot_;
+    };
+
+private:
+    EpochDomain(const EpochDomain&);
+    EpochDomain& operator=(const EpochDomain&);
+
+    struct Retired
+    {
+        void* block;
+        void (*destroy)(void*);
+        std::uint64_t epoch;
+    };
+
+    // state_ is 0 while free, otherwise the pinned epoch shifted left
+    // once with the low bit set; the padding keeps slots of different
+    // threads off each other's cache lines
+    struct Slot
+    {
+        Slot() : state_(0) {}
+        std::atomic<std::uint64_t> state_;
+        std::vector<Retired> retired_;
+        char pad_[64];
+    };
+
+    static const std::size_t slotCount = 64;
+    static const std::size_t reclaimBatch = 64;
+
+    static std::size_t& slotHint();
+    void tryAdvance();
+    void reclaim(Slot& slot);
+
+    std::atomic<std::uint64_t> epoch_;
+    Slot slots_[slotCount];
+};
+
+/**
+* A one-byte lock for the nodes of ConcurrentAVLTree, which are held
+* only across a few pointer updates. Waiters spin briefly, then yield.
+* A std::mutex would more than double the size of a node.
+*/
+class NodeLock
+{
+public:
+    NodeLock() : held_(false) {}
+
+    void lock()
+    {
+        for (int spins = 0; held_.exchange(true, std::memory_order_acquire); ++spins){
+            while (held_.load(std::memory_order_relaxed)){
+                if (++spins > spinLimit){
+                    std::this_thread::yield();
+                }
+            }
+        }
+    }
+
+    void unlock()
+    {
+        held_.store(false, std::memory_order_release);
+    }
+
+private:
+    NodeLock(const NodeLock&);
+    NodeLock& operator=(const NodeLock&);
+
+    static const int spinLimit = 64;
+    std::atomic<bool> held_;
+};
+
+/**
+* A map with the insert/remove/find/operator[] surface of AVLTree that
+* any number of threads may use at once.
+*
+* Lookups take no locks. Each node carries a version that a rotation
+* bumps when it moves the node down, and a reader checks the version of
+* the node it came from after every step, retrying from there if the
+* step may have taken it out of the key range it was searching. Writers
+* lock only the nodes they relink: insert locks the new leaf's parent,
+* remove the node and its parent, and a rotation the nodes it moves.
+*
+* Balance is relaxed. A writer repairs heights and rotates bottom up
+* after its change, but another thread's change may interleave, so the
+* tree is only guaranteed to be AVL balanced once writers are quiet.
+* Removing a node with two children leaves it in place as a routing node
+* without a value, which is unlinked once it has at most one child.
+*
+* Nodes and values are allocated with new and, once unlinked, freed
+* through an EpochDomain. clear() and the destructor must not run
+* concurrently with anything else. There are no iterators.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class ConcurrentAVLTree
+{
+public:
+    ConcurrentAVLTree();
+    explicit ConcurrentAVLTree(const Compare& comp);
+    ~ConcurrentAVLTree();
+
+    // insert returns true if the key was new; an existing value is
+    // overwritten. remove returns true if the key was there.
+    bool insert(const std::pair<const Key, Value>& keyValuePair);
+    bool remove(const Key& key);
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    Value operator[](const Key& key) const;
+    bool empty() const;
+    void clear();
+    bool isBalanced() const;
+
+protected:
+    // The holder at the top of the tree is a Node without a key whose
+    // right child is the root, so the key is constructed separately. It
+    // comes first to share a cache line with the links a lookup reads.
+    // A node's first value is stored in the node too; values written
+    // later are allocated on their own, since a reader may still be
+    // copying the one they replace.
+    struct Node
+    {
+        Node(Node* parent, int height);
+        const Key& key() const;
+        Value* firstValue();
+
+        typename std::aligned_storage<sizeof(Key), alignof(Key)>::type key_;
+        std::atomic<Node*> left_;
+        std::atomic<Node*> right_;
+        std::atomic<std::uint64_t> version_;
+        std::atomic<Value*> value_;
+        std::atomic<Node*> parent_;
+        std::atomic<int> height_;
+        NodeLock lock_;
+        typename std::aligned_storage<sizeof(Value), alignof(Value)>::type firstValue_;
+    };
+
+    // version_ bits: unlinked, shrinking (a rotation is moving the node
+    // down), and a count of finished rotations above them
+    static const std::uint64_t unlinked = 1;
+    static const std::uint64_t shrinking = 2;
+    static const std::uint64_t changeCount = 4;
+
+    // what nodeCondition found, when it is not a new height
+    static const int unlinkRequired = -1;
+    static const int rebalanceRequired = -2;
+    static const int nothingRequired = -3;
+
+    // attempt* results besides whether the key was present
+    static const int retry = -1;
+
+    static const int spinCount = 100;
+
+    typedef ThreeWayCompare<Key, Compare> KeyOrder;
+    typedef std::integral_constant<bool, KeyOrder::descent == KeyOrder::threeWay> ThreeWay;
+
+    int order(const Key& a, const Key& b) const;
+    int order(const Key& a, const Key& b, std::true_type) const;
+    int order(const Key& a, const Key& b, std::false_type) const;
+
+    static Node* child(Node* node, int dir);
+    static void setChild(Node* node, int dir, Node* child);
+    static int heightOf(Node* node);
+    static bool isShrinkingOrUnlinked(std::uint64_t version);
+    static void waitUntilShrinkCompleted(Node* node, std::uint64_t version);
+    static Node* createNode(const Key& key, const Value& value, Node* parent);
+    static void destroyNode(void* node);
+    static void destroyValue(void* value);
+    static void retireValue(Node* node, Value* value, EpochDomain::Guard& guard);
+
+    int attemptGet(const Key& key, Node* node, int dir, std::uint64_t nodeVersion, Value*& found) const;
+    int update(const Key& key, const Value* newValue, EpochDomain::Guard& guard);
+    int attemptUpdate(const Key& key, const Value* newValue, Node* parent, Node* node,
+                      std::uint64_t nodeVersion, EpochDomain::Guard& guard);
+    int attemptNodeUpdate(const Value* newValue, Node* parent, Node* node, EpochDomain::Guard& guard);
+    bool attemptUnlink(Node* parent, Node* node);
+
+    int nodeCondition(Node* node) const;
+    void fixHeightAndRebalance(Node* node, EpochDomain::Guard& guard);
+    Node* fixHeight(Node* node);
+    Node* rebalance(Node* nParent, Node* n, EpochDomain::Guard& guard);
+    Node* rebalanceToRight(Node* nParent, Node* n, Node* nL, int hR0, EpochDomain::Guard& guard);
+    Node* rebalanceToLeft(Node* nParent, Node* n, Node* nR, int hL0, EpochDomain::Guard& guard);
+    Node* rotateRight(Node* nParent, Node* n, Node* nL, int hR, int hLL, Node* nLR, int hLR);
+    Node* rotateLeft(Node* nParent, Node* n, int hL, Node* nR, Node* nRL, int hRL, int hRR);
+    Node* rotateRightOverLeft(Node* nParent, Node* n, Node* nL, int hR, int hLL, Node* nLR, int hLRL,
+                                  EpochDomain::Guard& guard);
+    Node* rotateLeftOverRight(Node* nParent, Node* n, int hL, Node* nR, Node* nRL, int hRR, int hRLR,
+                                  EpochDomain::Guard& guard);
+
+    void destroySubtree(Node* node);
+    int checkBalance(Node* node) const;
+
+    Node holder_;
+    mutable EpochDomain epoch_;
+    Compare compare_;
+
+private:
+    ConcurrentAVLTree(const ConcurrentAVLTree&);
+    ConcurrentAVLTree& operator=(const ConcurrentAVLTree&);
+};
+
+/*
+  --------------------------------------------
+  Begin implementations for the EpochDomain class.
+  --------------------------------------------
+*/
+
+inline EpochDomain::EpochDomain() :
+    epoch_(0)
+{
+}
+
+/**
+* Frees everything still retired. No thread may be pinned.
+*/
+inline EpochDomain::~EpochDomain()
+{
+    for (std::size_t i = 0; i < slotCount; ++i){
+        std::vector<Retired>& retired = slots_[i].retired_;
+        for (std::size_t j = 0; j < retired.size(); ++j){
+            retired[j].destroy(retired[j].block);
+        }
+    }
+}
+
+/**
+* The slot the calling thread tries first. Threads are dealt consecutive
+* hints so that up to slotCount of them never compete for a slot.
+*/
+inline std::size_t& EpochDomain::slotHint()
+{
+    static std::atomic<std::size_t> nextHint(0);
+    thread_local std::size_t hint = nextHint.fetch_add(1) % slotCount;
+    return hint;
+}
+
+/**
+* Claims a free slot and publishes the current epoch in it. Returns the
+* slot, which the thread keeps until unpin().
+*/
+inline std::size_t EpochDomain::pin()
+{
+    std::size_t& hint = slotHint();
+    std::size_t i = hint;
+    for (std::size_t tries = 1; ; ++tries){
+        Slot& slot = slots_[i];
+        std::uint64_t epoch = epoch_.load();
+        std::uint64_t expected = 0;
+        if (slot.state_.load(std::memory_order_relaxed) == 0 &&
+            slot.state_.compare_exchange_strong(expected, (epoch << 1) | 1)){
+            // the epoch may have moved on before the slot was visible;
+            // republish until it is the one we announced
+            for (std::uint64_t now = epoch_.load(); now != epoch; now = epoch_.load()){
+                epoch = now;
+                slot.state_.store((epoch << 1) | 1);
+            }
+            hint = i;
+            return i;
+        }
+        i = (i + 1) % slotCount;
+        if (tries % slotCount == 0){
+            std::this_thread::yield();
+        }
+    }
+}
+
+inline void EpochDomain::unpin(std::size_t slot)
+{
+    slots_[slot].state_.store(0, std::memory_order_release);
+}
+
+/**
+* Hands block, already unreachable for threads that pin from now on, to
+* the domain, which calls destroy(block) once no pinned thread can still
+* reach it. Every reclaimBatch retirements, tries to move the epoch on
+* and frees what has become safe.
+*/
+inline void EpochDomain::retire(std::size_t slot, void* block, void (*destroy)(void*))
+{
+    Retired retired = { block, destroy, epoch_.load() };
+    Slot& owner = slots_[slot];
+    owner.retired_.push_back(retired);
+    if (owner.retired_.size() % reclaimBatch == 0){
+        tryAdvance();
+        reclaim(owner);
+    }
+}
+
+/**
+* Moves the epoch on if every pinned thread has seen the current one.
+*/
+inline void EpochDomain::tryAdvance()
+{
+    std::uint64_t epoch = epoch_.load();
+    for (std::size_t i = 0; i < slotCount; ++i){
+        std::uint64_t state = slots_[i].state_.load();
+        if ((state & 1) != 0 && (state >> 1) != epoch){
+            return;
+        }
+    }
+    epoch_.compare_exchange_strong(epoch, epoch + 1);
+}
+
+/**
+* Frees the blocks of slot retired at least two epochs ago.
+*/
+inline void EpochDomain::reclaim(Slot& slot)
+{
+    std::uint64_t epoch = epoch_.load();
+    std::vector<Retired>& retired = slot.retired_;
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < retired.size(); ++i){
+        if (retired[i].epoch + 2 <= epoch){
+            retired[i].destroy(retired[i].block);
+        } else {
+            retired[kept++] = retired[i];
+        }
+    }
+    retired.resize(kept);
+}
+
+/*
+  --------------------------------------------
+  End implementations for the EpochDomain class.
+  --------------------------------------------
+*/
+
+/*
+  --------------------------------------------------
+  Begin implementations for the ConcurrentAVLTree class.
+  --------------------------------------------------
+*/
+
+template<typename Key, typename Value, typename Compare>
+ConcurrentAVLTree<Key, Value, Compare>::Node::Node(Node* parent, int height) :
+    left_(NULL),
+    right_(NULL),
+    version_(0),
+    value_(NULL),
+    parent_(parent),
+    height_(height)
+{
+}
+
+template<typename Key, typename Value, typename Compare>
+const Key& ConcurrentAVLTree<Key, Value, Compare>::Node::key() const
+{
+    return *reinterpret_cast<const Key*>(&key_);
+}
+
+template<typename Key, typename Value, typename Compare>
+Value* ConcurrentAVLTree<Key, Value, Compare>::Node::firstValue()
+{
+    return reinterpret_cast<Value*>(&firstValue_);
+}
+
+template<typename Key, typename Value, typename Compare>
+ConcurrentAVLTree<Key, Value, Compare>::ConcurrentAVLTree() :
+    holder_(NULL, 1),
+    compare_()
+{
+}
+
+template<typename Key, typename Value, typename Compare>
+ConcurrentAVLTree<Key, Value, Compare>::ConcurrentAVLTree(const Compare& comp) :
+    holder_(NULL, 1),
+    compare_(comp)
+{
+}
+
+template<typename Key, typename Value, typename Compare>
+ConcurrentAVLTree<Key, Value, Compare>::~ConcurrentAVLTree()
+{
+    clear();
+}
+
+/**
+* Inserts the pair, overwriting the value if the key is already there.
+* Returns true if the key was new.
+*/
+template<typename Key, typename Value, typename Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    EpochDomain::Guard guard(epoch_);
+    return update(keyValuePair.first, &keyValuePair.second, guard) == 0;
+}
+
+/**
+* Removes key if it is there, returning whether it was.
+*/
+template<typename Key, typename Value, typename Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    EpochDomain::Guard guard(epoch_);
+    return update(key, NULL, guard) == 1;
+}
+
+/**
+* Copies the value of key into value and returns true, or returns false
+* if key is not there. Takes no locks.
+*/
+template<typename Key, typename Value, typename Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::find(const Key& key, Value& value) const
+{
+    EpochDomain::Guard guard(epoch_);
+    Node* holder = const_cast<Node*>(&holder_);
+    Value* found = NULL;
+    while (attemptGet(key, holder, 1, 0, found) == retry){
+    }
+    if (found == NULL){
+        return false;
+    }
+    value = *found;
+    return true;
+}
+
+template<typename Key, typename Value, typename Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::contains(const Key& key) const
+{
+    EpochDomain::Guard guard(epoch_);
+    Node* holder = const_cast<Node*>(&holder_);
+    Value* found = NULL;
+    while (attemptGet(key, holder, 1, 0, found) == retry){
+    }
+    return found != NULL;
+}
+
+/**
+* Returns a copy of the value of key. Throws std::out_of_range if key is
+* not there. (There is no reference to hand out: another thread may
+* replace the value at any time.)
+*/
+template<typename Key, typename Value, typename Compare>
+Value ConcurrentAVLTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    Value value;
+    if (!find(key, value)){
+        throw std::out_of_range("Invalid key");
+    }
+    return value;
+}
+
+/**
+* True if the tree holds no nodes. Removals racing with the call may make
+* the answer stale as soon as it is returned.
+*/
+template<typename Key, typename Value, typename Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::empty() const
+{
+    return holder_.right_.load(std::memory_order_acquire) == NULL;
+}
+
+/**
+* Frees every node. Must not run concurrently with other calls.
+*/
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::clear()
+{
+    destroySubtree(holder_.right_.load());
+    holder_.right_.store(NULL);
+    holder_.height_.store(1);
+}
+
+/**
+* True if every node's subtrees differ in height by at most one. Only
+* meaningful while no writer is running.
+*/
+template<typename Key, typename Value, typename Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::isBalanced() const
+{
+    return checkBalance(holder_.right_.load()) >= 0;
+}
+
+/**
+* Returns <0, 0 or >0 as a orders before, with or after b, using the
+* key's own three-way compare where ThreeWayCompare finds one.
+*/
+template<typename Key, typename Value, typename Compare>
+int ConcurrentAVLTree<Key, Value, Compare>::order(const Key& a, const Key& b) const
+{
+    return order(a, b, ThreeWay());
+}
+
+template<typename Key, typename Value, typename Compare>
+int ConcurrentAVLTree<Key, Value, Compare>::order(const Key& a, const Key& b, std::true_type) const
+{
+    return KeyOrder::compare(a, b);
+}
+
+template<typename Key, typename Value, typename Compare>
+int ConcurrentAVLTree<Key, Value, Compare>::order(const Key& a, const Key& b, std::false_type) const
+{
+    if (compare_(a, b)){
+        return -1;
+    }
+    return compare_(b, a) ? 1 : 0;
+}
+
+/**
+* The left child of node if dir < 0, else the right one. The field is
+* picked before the load so the descent compiles to a conditional move
+* rather than a hard-to-predict branch.
+*/
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Node*
+ConcurrentAVLTree<Key, Value, Compare>::child(Node* node, int dir)
+{
+    return ((dir < 0) ? &node -> left_ : &node -> right_) -> load(std::memory_order_acquire);
+}
+
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::setChild(Node* node, int dir, Node* child)
+{
+    if (dir < 0){
+        node -> left_.store(child, std::memory_order_release);
+    } else {
+        node -> right_.store(child, std::memory_order_release);
+    }
+}
+
+template<typename Key, typename Value, typename Compare>
+int ConcurrentAVLTree<Key, Value, Compare>::heightOf(Node* node)
+{
+    return (node == NULL) ? 0 : node -> height_.load(std::memory_order_acquire);
+}
+
+template<typename Key, typename Value, typename Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::isShrinkingOrUnlinked(std::uint64_t version)
+{
+    return (version & (shrinking | unlinked)) != 0;
+}
+
+/**
+* Waits for the rotation moving node down to finish: spins briefly, then
+* blocks on node's lock, which the rotating thread holds throughout.
+*/
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::waitUntilShrinkCompleted(Node* node, std::uint64_t version)
+{
+    if ((version & shrinking) == 0){
+        return;
+    }
+    for (int i = 0; i < spinCount; ++i){
+        if (node -> version_.load(std::memory_order_acquire) != version){
+            return;
+        }
+    }
+    std::lock_guard<NodeLock> wait(node -> lock_);
+}
+
+/**
+* A leaf holding key and a copy of value under parent.
+*/
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Node*
+ConcurrentAVLTree<Key, Value, Compare>::createNode(const Key& key, const Value& value, Node* parent)
+{
+    Node* node = new Node(parent, 1);
+    try {
+        new (&node -> key_) Key(key);
+    } catch (...){
+        delete node;
+        throw;
+    }
+    try {
+        new (node -> firstValue()) Value(value);
+    } catch (...){
+        reinterpret_cast<Key*>(&node -> key_) -> ~Key();
+        delete node;
+        throw;
+    }
+    node -> value_.store(node -> firstValue(), std::memory_order_relaxed);
+    return node;
+}
+
+/**
+* Destroys a node made by createNode, with its first value but not any
+* value that replaced it.
+*/
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::destroyNode(void* node)
+{
+    Node* doomed = static_cast<Node*>(node);
+    reinterpret_cast<Key*>(&doomed -> key_) -> ~Key();
+    doomed -> firstValue() -> ~Value();
+    delete doomed;
+}
+
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::destroyValue(void* value)
+{
+    delete static_cast<Value*>(value);
+}
+
+/**
+* Hands a value taken out of node to the epoch domain, unless it is the
+* one stored in the node, which goes with the node.
+*/
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::retireValue(Node* node, Value* value, EpochDomain::Guard& guard)
+{
+    if (value != node -> firstValue()){
+        guard.retire(value, destroyValue);
+    }
+}
+
+/**
+* Searches for key below node, which the caller reached with version
+* nodeVersion, in the child subtree on side dir. Sets found to the
+* value (NULL if key is missing) and returns 0, or returns retry if node
+* has been moved down since the caller validated it, in which case the
+* caller must redo its own step.
+*/
+template<typename Key, typename Value, typename Compare>
+int ConcurrentAVLTree<Key, Value, Compare>::attemptGet(const Key& key, Node* node, int dir,
+                                                       std::uint64_t nodeVersion, Value*& found) const
+{
+    while (true){
+        Node* next = child(node, dir);
+        if (next == NULL){
+            if (node -> version_.load(std::memory_order_acquire) != nodeVersion){
+                return retry;
+            }
+            found = NULL;
+            return 0;
+        }
+
+        int nextDir = order(key, next -> key());
+        if (nextDir == 0){
+            found = next -> value_.load(std::memory_order_acquire);
+            return 0;
+        }
+        std::uint64_t nextVersion = next -> version_.load(std::memory_order_acquire);
+        if (isShrinkingOrUnlinked(nextVersion)){
+            waitUntilShrinkCompleted(next, nextVersion);
+            if (node -> version_.load(std::memory_order_acquire) != nodeVersion){
+                return retry;
+            }
+        } else if (next != child(node, dir)){
+            if (node -> version_.load(std::memory_order_acquire) != nodeVersion){
+                return retry;
+            }
+        } else {
+            if (node -> version_.load(std::memory_order_acquire) != nodeVersion){
+                return retry;
+            }
+            // node's step to next was still valid after next's version
+            // was read, so next's own version covers the rest
+            if (attemptGet(key, next, nextDir, nextVersion, found) != retry){
+                return 0;
+            }
+        }
+    }
+}
+
+/**
+* Sets key's value to a copy of newValue, or removes key if newValue is
+* NULL. Returns 1 if key was present beforehand, 0 if not.
+*/
+template<typename Key, typename Value, typename Compare>
+int ConcurrentAVLTree<Key, Value, Compare>::update(const Key& key, const Value* newValue, EpochDomain::Guard& guard)
+{
+    while (true){
+        Node* root = holder_.right_.load(std::memory_order_acquire);
+        if (root == NULL){
+            if (newValue == NULL){
+                return 0;
+            }
+            std::lock_guard<NodeLock> lock(holder_.lock_);
+            if (holder_.right_.load(std::memory_order_relaxed) == NULL){
+                holder_.right_.store(createNode(key, *newValue, &holder_), std::memory_order_release);
+                holder_.height_.store(2);
+                return 0;
+            }
+        } else {
+            std::uint64_t version = root -> version_.load(std::memory_order_acquire);
+            if (isShrinkingOrUnlinked(version)){
+                waitUntilShrinkCompleted(root, version);
+            } else if (root == holder_.right_.load(std::memory_order_acquire)){
+                int present = attemptUpdate(key, newValue, &holder_, root, version, guard);
+                if (present != retry){
+                    return present;
+                }
+            }
+        }
+    }
+}
+
+/**
+* The update below node, reached from parent with version nodeVersion.
+* A rotation that moves node down narrows the key range under it, so
+* node's version is checked before every step away from it.
+*/
+template<typename Key, typename Value, typename Compare>
+int ConcurrentAVLTree<Key, Value, Compare>::attemptUpdate(const Key& key, const Value* newValue,
+                                                          Node* parent, Node* node,
+                                                          std::uint64_t nodeVersion, EpochDomain::Guard& guard)
+{
+    int dir = order(key, node -> key());
+    if (dir == 0){
+        return attemptNodeUpdate(newValue, parent, node, guard);
+    }
+
+    while (true){
+        Node* next = child(node, dir);
+        if (node -> version_.load(std::memory_order_acquire) != nodeVersion){
+            return retry;
+        }
+
+        if (next == NULL){
+            if (newValue == NULL){
+                return 0;
+            }
+            Node* damaged = NULL;
+            {
+                std::lock_guard<NodeLock> lock(node -> lock_);
+                // with node locked, no rotation can invalidate the step
+                if (node -> version_.load(std::memory_order_relaxed) != nodeVersion){
+                    return retry;
+                }
+                if (child(node, dir) == NULL){
+                    setChild(node, dir, createNode(key, *newValue, node));
+                    damaged = fixHeight(node);
+                    next = NULL;
+                } else {
+                    // lost a race with another insert here
+                    next = child(node, dir);
+                }
+            }
+            if (next == NULL){
+                fixHeightAndRebalance(damaged, guard);
+                return 0;
+            }
+            continue;
+        }
+
+        std::uint64_t nextVersion = next -> version_.load(std::memory_order_acquire);
+        if (isShrinkingOrUnlinked(nextVersion)){
+            waitUntilShrinkCompleted(next, nextVersion);
+        } else if (next == child(node, dir)){
+            if (node -> version_.load(std::memory_order_acquire) != nodeVersion){
+                return retry;
+            }
+            int present = attemptUpdate(key, newValue, node, next, nextVersion, guard);
+            if (present != retry){
+                return present;
+            }
+        }
+    }
+}
+
+/**
+* Applies the update to node, which holds the key. A removal unlinks
+* node if it has at most one child and otherwise leaves it as a routing
+* node without a value.
+*/
+template<typename Key, typename Value, typename Compare>
+int ConcurrentAVLTree<Key, Value, Compare>::attemptNodeUpdate(const Value* newValue, Node* parent, Node* node,
+                                                              EpochDomain::Guard& guard)
+{
+    if (newValue == NULL && node -> value_.load(std::memory_order_acquire) == NULL){
+        return 0;
+    }
+
+    Value* prev = NULL;
+    if (newValue == NULL &&
+        (node -> left_.load(std::memory_order_acquire) == NULL ||
+         node -> right_.load(std::memory_order_acquire) == NULL)){
+        Node* damaged = NULL;
+        {
+            std::lock_guard<NodeLock> parentLock(parent -> lock_);
+            if ((parent -> version_.load(std::memory_order_relaxed) & unlinked) != 0 ||
+                node -> parent_.load(std::memory_order_relaxed) != parent){
+                return retry;
+            }
+            {
+                std::lock_guard<NodeLock> nodeLock(node -> lock_);
+                prev = node -> value_.load(std::memory_order_relaxed);
+                if (prev == NULL){
+                    return 0;
+                }
+                if (!attemptUnlink(parent, node)){
+                    return retry;
+                }
+            }
+            damaged = fixHeight(parent);
+        }
+        retireValue(node, prev, guard);
+        guard.retire(node, destroyNode);
+        fixHeightAndRebalance(damaged, guard);
+        return 1;
+    }
+
+    std::unique_ptr<Value> fresh(newValue != NULL ? new Value(*newValue) : NULL);
+    {
+        std::lock_guard<NodeLock> nodeLock(node -> lock_);
+        if ((node -> version_.load(std::memory_order_relaxed) & unlinked) != 0){
+            return retry;
+        }
+        prev = node -> value_.load(std::memory_order_relaxed);
+        if (newValue == NULL){
+            if (prev == NULL){
+                return 0;
+            }
+            // a child went away since we looked; unlink instead
+            if (node -> left_.load(std::memory_order_relaxed) == NULL ||
+                node -> right_.load(std::memory_order_relaxed) == NULL){
+                return retry;
+            }
+        }
+        node -> value_.store(fresh.release(), std::memory_order_release);
+    }
+    if (prev != NULL){
+        retireValue(node, prev, guard);
+    }
+    return (prev != NULL) ? 1 : 0;
+}
+
+/**
+* Splices node, which has at most one child, out from under parent.
+* Both must be locked. Returns false if the shape changed first.
+*/
+template<typename Key, typename Value, typename Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::attemptUnlink(Node* parent, Node* node)
+{
+    Node* parentL = parent -> left_.load(std::memory_order_relaxed);
+    Node* parentR = parent -> right_.load(std::memory_order_relaxed);
+    if (parentL != node && parentR != node){
+        return false;
+    }
+    Node* left = node -> left_.load(std::memory_order_relaxed);
+    Node* right = node -> right_.load(std::memory_order_relaxed);
+    if (left != NULL && right != NULL){
+        return false;
+    }
+    Node* splice = (left != NULL) ? left : right;
+    if (parentL == node){
+        parent -> left_.store(splice, std::memory_order_release);
+    } else {
+        parent -> right_.store(splice, std::memory_order_release);
+    }
+    if (splice != NULL){
+        splice -> parent_.store(parent, std::memory_order_release);
+    }
+    node -> version_.store(unlinked, std::memory_order_release);
+    node -> value_.store(NULL, std::memory_order_release);
+    return true;
+}
+
+/**
+* Classifies node from an unlocked, possibly inconsistent look at it:
+* a routing node that can go, a node out of balance, a node whose height
+* is off (the new height is returned), or nothing to do.
+*/
+template<typename Key, typename Value, typename Compare>
+int ConcurrentAVLTree<Key, Value, Compare>::nodeCondition(Node* node) const
+{
+    Node* nL = node -> left_.load(std::memory_order_acquire);
+    Node* nR = node -> right_.load(std::memory_order_acquire);
+    if ((nL == NULL || nR == NULL) && node -> value_.load(std::memory_order_acquire) == NULL){
+        return unlinkRequired;
+    }
+    int hN = node -> height_.load(std::memory_order_acquire);
+    int hL0 = heightOf(nL);
+    int hR0 = heightOf(nR);
+    int hNRepl = 1 + std::max(hL0, hR0);
+    int bal = hL0 - hR0;
+    if (bal < -1 || bal > 1){
+        return rebalanceRequired;
+    }
+    return (hN != hNRepl) ? hNRepl : nothingRequired;
+}
+
+/**
+* Repairs node and then its ancestors for as long as they need it,
+* locking at most a parent and child (and their children for a
+* rotation) at a time. A rotation can hand back a damaged node below
+* the one whose height it changed, so once one has happened the walk
+* goes on to the top instead of stopping at the first sound node.
+*/
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::fixHeightAndRebalance(Node* node, EpochDomain::Guard& guard)
+{
+    bool reshaped = false;
+    while (node != NULL && node -> parent_.load(std::memory_order_acquire) != NULL){
+        if ((node -> version_.load(std::memory_order_acquire) & unlinked) != 0){
+            return;
+        }
+        int condition = nodeCondition(node);
+        Node* next = node;
+        if (condition == nothingRequired){
+            if (!reshaped){
+                return;
+            }
+            next = NULL;
+        } else if (condition != unlinkRequired && condition != rebalanceRequired){
+            std::lock_guard<NodeLock> lock(node -> lock_);
+            next = fixHeight(node);
+        } else {
+            Node* nParent = node -> parent_.load(std::memory_order_acquire);
+            std::lock_guard<NodeLock> parentLock(nParent -> lock_);
+            if ((nParent -> version_.load(std::memory_order_relaxed) & unlinked) == 0 &&
+                node -> parent_.load(std::memory_order_relaxed) == nParent){
+                std::lock_guard<NodeLock> nodeLock(node -> lock_);
+                next = rebalance(nParent, node, guard);
+                reshaped = true;
+            }
+        }
+        if (next == NULL && reshaped){
+            next = node -> parent_.load(std::memory_order_acquire);
+        }
+        node = next;
+    }
+}
+
+/**
+* Fixes the height of the locked node if that is all it needs. Returns
+* the lowest node still needing repair that this thread is responsible
+* for, or NULL.
+*/
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Node*
+ConcurrentAVLTree<Key, Value, Compare>::fixHeight(Node* node)
+{
+    int condition = nodeCondition(node);
+    if (condition == rebalanceRequired || condition == unlinkRequired){
+        return node;
+    }
+    if (condition == nothingRequired){
+        return NULL;
+    }
+    node -> height_.store(condition, std::memory_order_release);
+    return node -> parent_.load(std::memory_order_relaxed);
+}
+
+/**
+* Unlinks, rotates or re-heights n, with nParent and n locked. Returns
+* the next node needing repair, or NULL.
+*/
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Node*
+ConcurrentAVLTree<Key, Value, Compare>::rebalance(Node* nParent, Node* n, EpochDomain::Guard& guard)
+{
+    Node* nL = n -> left_.load(std::memory_order_relaxed);
+    Node* nR = n -> right_.load(std::memory_order_relaxed);
+    if ((nL == NULL || nR == NULL) && n -> value_.load(std::memory_order_relaxed) == NULL){
+        if (attemptUnlink(nParent, n)){
+            guard.retire(n, destroyNode);
+            return fixHeight(nParent);
+        }
+        return n;
+    }
+
+    int hN = n -> height_.load(std::memory_order_relaxed);
+    int hL0 = heightOf(nL);
+    int hR0 = heightOf(nR);
+    int hNRepl = 1 + std::max(hL0, hR0);
+    int bal = hL0 - hR0;
+    if (bal > 1){
+        return rebalanceToRight(nParent, n, nL, hR0, guard);
+    } else if (bal < -1){
+        return rebalanceToLeft(nParent, n, nR, hL0, guard);
+    } else if (hNRepl != hN){
+        n -> height_.store(hNRepl, std::memory_order_release);
+        return fixHeight(nParent);
+    }
+    return NULL;
+}
+
+/**
+* n's left side is too tall: rotates right, first rotating nL left if
+* its inner grandchild is the taller one.
+*/
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Node*
+ConcurrentAVLTree<Key, Value, Compare>::rebalanceToRight(Node* nParent, Node* n, Node* nL, int hR0,
+                                                         EpochDomain::Guard& guard)
+{
+    std::lock_guard<NodeLock> leftLock(nL -> lock_);
+    int hL = nL -> height_.load(std::memory_order_relaxed);
+    if (hL - hR0 <= 1){
+        return n;
+    }
+    Node* nLR = nL -> right_.load(std::memory_order_relaxed);
+    int hLL0 = heightOf(nL -> left_.load(std::memory_order_relaxed));
+    int hLR0 = heightOf(nLR);
+    if (hLL0 >= hLR0){
+        return rotateRight(nParent, n, nL, hR0, hLL0, nLR, hLR0);
+    }
+    {
+        std::lock_guard<NodeLock> innerLock(nLR -> lock_);
+        int hLR = nLR -> height_.load(std::memory_order_relaxed);
+        if (hLL0 >= hLR){
+            return rotateRight(nParent, n, nL, hR0, hLL0, nLR, hLR);
+        }
+        int hLRL = heightOf(nLR -> left_.load(std::memory_order_relaxed));
+        int b = hLL0 - hLRL;
+        // a double rotation is only done if it leaves nL balanced;
+        // otherwise nL is fixed on its own first and n later
+        if (b >= -1 && b <= 1){
+            return rotateRightOverLeft(nParent, n, nL, hR0, hLL0, nLR, hLRL, guard);
+        }
+    }
+    return rebalanceToLeft(n, nL, nLR, hLL0, guard);
+}
+
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Node*
+ConcurrentAVLTree<Key, Value, Compare>::rebalanceToLeft(Node* nParent, Node* n, Node* nR, int hL0,
+                                                        EpochDomain::Guard& guard)
+{
+    std::lock_guard<NodeLock> rightLock(nR -> lock_);
+    int hR = nR -> height_.load(std::memory_order_relaxed);
+    if (hL0 - hR >= -1){
+        return n;
+    }
+    Node* nRL = nR -> left_.load(std::memory_order_relaxed);
+    int hRL0 = heightOf(nRL);
+    int hRR0 = heightOf(nR -> right_.load(std::memory_order_relaxed));
+    if (hRR0 >= hRL0){
+        return rotateLeft(nParent, n, hL0, nR, nRL, hRL0, hRR0);
+    }
+    {
+        std::lock_guard<NodeLock> innerLock(nRL -> lock_);
+        int hRL = nRL -> height_.load(std::memory_order_relaxed);
+        if (hRR0 >= hRL){
+            return rotateLeft(nParent, n, hL0, nR, nRL, hRL, hRR0);
+        }
+        int hRLR = heightOf(nRL -> right_.load(std::memory_order_relaxed));
+        int b = hRR0 - hRLR;
+        if (b >= -1 && b <= 1){
+            return rotateLeftOverRight(nParent, n, hL0, nR, nRL, hRR0, hRLR, guard);
+        }
+    }
+    return rebalanceToRight(n, nR, nRL, hRR0, guard);
+}
+
+/**
+* Rotates n down to the right under nL. n is marked shrinking for the
+* duration so that readers below it back off. Returns the deepest node
+* left damaged, after fixing what the held locks allow.
+*/
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Node*
+ConcurrentAVLTree<Key, Value, Compare>::rotateRight(Node* nParent, Node* n, Node* nL, int hR, int hLL,
+                                                    Node* nLR, int hLR)
+{
+    std::uint64_t nodeVersion = n -> version_.load(std::memory_order_relaxed);
+    Node* nPL = nParent -> left_.load(std::memory_order_relaxed);
+    n -> version_.store(nodeVersion | shrinking, std::memory_order_release);
+
+    n -> left_.store(nLR, std::memory_order_release);
+    if (nLR != NULL){
+        nLR -> parent_.store(n, std::memory_order_release);
+    }
+    nL -> right_.store(n, std::memory_order_release);
+    n -> parent_.store(nL, std::memory_order_release);
+    if (nPL == n){
+        nParent -> left_.store(nL, std::memory_order_release);
+    } else {
+        nParent -> right_.store(nL, std::memory_order_release);
+    }
+    nL -> parent_.store(nParent, std::memory_order_release);
+
+    int hNRepl = 1 + std::max(hLR, hR);
+    n -> height_.store(hNRepl, std::memory_order_release);
+    nL -> height_.store(1 + std::max(hLL, hNRepl), std::memory_order_release);
+    n -> version_.store((nodeVersion | shrinking) + shrinking, std::memory_order_release);
+
+    int balN = hLR - hR;
+    if (balN < -1 || balN > 1){
+        return n;
+    }
+    if ((nLR == NULL || hR == 0) && n -> value_.load(std::memory_order_relaxed) == NULL){
+        return n;
+    }
+    int balL = hLL - hNRepl;
+    if (balL < -1 || balL > 1){
+        return nL;
+    }
+    if (hLL == 0 && nL -> value_.load(std::memory_order_relaxed) == NULL){
+        return nL;
+    }
+    return fixHeight(nParent);
+}
+
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Node*
+ConcurrentAVLTree<Key, Value, Compare>::rotateLeft(Node* nParent, Node* n, int hL, Node* nR, Node* nRL,
+                                                   int hRL, int hRR)
+{
+    std::uint64_t nodeVersion = n -> version_.load(std::memory_order_relaxed);
+    Node* nPL = nParent -> left_.load(std::memory_order_relaxed);
+    n -> version_.store(nodeVersion | shrinking, std::memory_order_release);
+
+    n -> right_.store(nRL, std::memory_order_release);
+    if (nRL != NULL){
+        nRL -> parent_.store(n, std::memory_order_release);
+    }
+    nR -> left_.store(n, std::memory_order_release);
+    n -> parent_.store(nR, std::memory_order_release);
+    if (nPL == n){
+        nParent -> left_.store(nR, std::memory_order_release);
+    } else {
+        nParent -> right_.store(nR, std::memory_order_release);
+    }
+    nR -> parent_.store(nParent, std::memory_order_release);
+
+    int hNRepl = 1 + std::max(hL, hRL);
+    n -> height_.store(hNRepl, std::memory_order_release);
+    nR -> height_.store(1 + std::max(hNRepl, hRR), std::memory_order_release);
+    n -> version_.store((nodeVersion | shrinking) + shrinking, std::memory_order_release);
+
+    int balN = hRL - hL;
+    if (balN < -1 || balN > 1){
+        return n;
+    }
+    if ((nRL == NULL || hL == 0) && n -> value_.load(std::memory_order_relaxed) == NULL){
+        return n;
+    }
+    int balR = hRR - hNRepl;
+    if (balR < -1 || balR > 1){
+        return nR;
+    }
+    if (hRR == 0 && nR -> value_.load(std::memory_order_relaxed) == NULL){
+        return nR;
+    }
+    return fixHeight(nParent);
+}
+
+/**
+* Double rotation lifting nLR above both nL and n; both of those shrink.
+* If nL is a routing node left with one child it is spliced out on the
+* spot, since only one damaged node can be handed back.
+*/
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Node*
+ConcurrentAVLTree<Key, Value, Compare>::rotateRightOverLeft(Node* nParent, Node* n, Node* nL, int hR, int hLL,
+                                                            Node* nLR, int hLRL, EpochDomain::Guard& guard)
+{
+    std::uint64_t nodeVersion = n -> version_.load(std::memory_order_relaxed);
+    std::uint64_t leftVersion = nL -> version_.load(std::memory_order_relaxed);
+    Node* nPL = nParent -> left_.load(std::memory_order_relaxed);
+    Node* nLRL = nLR -> left_.load(std::memory_order_relaxed);
+    Node* nLRR = nLR -> right_.load(std::memory_order_relaxed);
+    int hLRR = heightOf(nLRR);
+    n -> version_.store(nodeVersion | shrinking, std::memory_order_release);
+    nL -> version_.store(leftVersion | shrinking, std::memory_order_release);
+
+    n -> left_.store(nLRR, std::memory_order_release);
+    if (nLRR != NULL){
+        nLRR -> parent_.store(n, std::memory_order_release);
+    }
+    nL -> right_.store(nLRL, std::memory_order_release);
+    if (nLRL != NULL){
+        nLRL -> parent_.store(nL, std::memory_order_release);
+    }
+    nLR -> left_.store(nL, std::memory_order_release);
+    nL -> parent_.store(nLR, std::memory_order_release);
+    nLR -> right_.store(n, std::memory_order_release);
+    n -> parent_.store(nLR, std::memory_order_release);
+    if (nPL == n){
+        nParent -> left_.store(nLR, std::memory_order_release);
+    } else {
+        nParent -> right_.store(nLR, std::memory_order_release);
+    }
+    nLR -> parent_.store(nParent, std::memory_order_release);
+
+    int hNRepl = 1 + std::max(hLRR, hR);
+    n -> height_.store(hNRepl, std::memory_order_release);
+    int hLRepl = 1 + std::max(hLL, hLRL);
+    nL -> height_.store(hLRepl, std::memory_order_release);
+    nLR -> height_.store(1 + std::max(hLRepl, hNRepl), std::memory_order_release);
+    n -> version_.store((nodeVersion | shrinking) + shrinking, std::memory_order_release);
+    nL -> version_.store((leftVersion | shrinking) + shrinking, std::memory_order_release);
+    if ((hLL == 0 || hLRL == 0) && nL -> value_.load(std::memory_order_relaxed) == NULL){
+        attemptUnlink(nLR, nL);
+        guard.retire(nL, destroyNode);
+        hLRepl = std::max(hLL, hLRL);
+        nLR -> height_.store(1 + std::max(hLRepl, hNRepl), std::memory_order_release);
+    }
+
+    int balN = hLRR - hR;
+    if (balN < -1 || balN > 1){
+        return n;
+    }
+    if ((nLRR == NULL || hR == 0) && n -> value_.load(std::memory_order_relaxed) == NULL){
+        return n;
+    }
+    int balLR = hLRepl - hNRepl;
+    if (balLR < -1 || balLR > 1){
+        return nLR;
+    }
+    return fixHeight(nParent);
+}
+
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Node*
+ConcurrentAVLTree<Key, Value, Compare>::rotateLeftOverRight(Node* nParent, Node* n, int hL, Node* nR, Node* nRL,
+                                                            int hRR, int hRLR, EpochDomain::Guard& guard)
+{
+    std::uint64_t nodeVersion = n -> version_.load(std::memory_order_relaxed);
+    std::uint64_t rightVersion = nR -> version_.load(std::memory_order_relaxed);
+    Node* nPL = nParent -> left_.load(std::memory_order_relaxed);
+    Node* nRLL = nRL -> left_.load(std::memory_order_relaxed);
+    Node* nRLR = nRL -> right_.load(std::memory_order_relaxed);
+    int hRLL = heightOf(nRLL);
+    n -> version_.store(nodeVersion | shrinking, std::memory_order_release);
+    nR -> version_.store(rightVersion | shrinking, std::memory_order_release);
+
+    n -> right_.store(nRLL, std::memory_order_release);
+    if (nRLL != NULL){
+        nRLL -> parent_.store(n, std::memory_order_release);
+    }
+    nR -> left_.store(nRLR, std::memory_order_release);
+    if (nRLR != NULL){
+        nRLR -> parent_.store(nR, std::memory_order_release);
+    }
+    nRL -> right_.store(nR, std::memory_order_release);
+    nR -> parent_.store(nRL, std::memory_order_release);
+    nRL -> left_.store(n, std::memory_order_release);
+    n -> parent_.store(nRL, std::memory_order_release);
+    if (nPL == n){
+        nParent -> left_.store(nRL, std::memory_order_release);
+    } else {
+        nParent -> right_.store(nRL, std::memory_order_release);
+    }
+    nRL -> parent_.store(nParent, std::memory_order_release);
+
+    int hNRepl = 1 + std::max(hL, hRLL);
+    n -> height_.store(hNRepl, std::memory_order_release);
+    int hRRepl = 1 + std::max(hRLR, hRR);
+    nR -> height_.store(hRRepl, std::memory_order_release);
+    nRL -> height_.store(1 + std::max(hNRepl, hRRepl), std::memory_order_release);
+    n -> version_.store((nodeVersion | shrinking) + shrinking, std::memory_order_release);
+    nR -> version_.store((rightVersion | shrinking) + shrinking, std::memory_order_release);
+    if ((hRR == 0 || hRLR == 0) && nR -> value_.load(std::memory_order_relaxed) == NULL){
+        attemptUnlink(nRL, nR);
+        guard.retire(nR, destroyNode);
+        hRRepl = std::max(hRR, hRLR);
+        nRL -> height_.store(1 + std::max(hNRepl, hRRepl), std::memory_order_release);
+    }
+
+    int balN = hRLL - hL;
+    if (balN < -1 || balN > 1){
+        return n;
+    }
+    if ((nRLL == NULL || hL == 0) && n -> value_.load(std::memory_order_relaxed) == NULL){
+        return n;
+    }
+    int balRL = hRRepl - hNRepl;
+    if (balRL < -1 || balRL > 1){
+        return nRL;
+    }
+    return fixHeight(nParent);
+}
+
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::destroySubtree(Node* node)
+{
+    if (node == NULL){
+        return;
+    }
+    destroySubtree(node -> left_.load());
+    destroySubtree(node -> right_.load());
+    Value* value = node -> value_.load();
+    if (value != node -> firstValue()){
+        delete value;
+    }
+    destroyNode(node);
+}
+
+/**
+* Height of the subtree at node, or -1 if it is out of balance anywhere.
+*/
+template<typename Key, typename Value, typename Compare>
+int ConcurrentAVLTree<Key, Value, Compare>::checkBalance(Node* node) const
+{
+    if (node == NULL){
+        return 0;
+    }
+    int left = checkBalance(node -> left_.load());
+    int right = checkBalance(node -> right_.load());
+    if (left < 0 || right < 0 || left - right > 1 || right - left > 1){
+        return -1;
+    }
+    return 1 + std::max(left, right);
+}
+
+/*
+  --------------------------------------------------
+  End implementations for the ConcurrentAVLTree class.
+  --------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,630 @@
+#ifndef FROZEN_BST_H
+#define FROZEN_BST_H
+
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "avlbst.h"
+
+/**
+* Read-only snapshots of a search tree, for lookup-heavy workloads
+* against data that rarely changes. A snapshot is built from the
+* in-order traversal of a tree (or any sorted range of unique keys)
+* and never changes afterwards; rebuild it to pick up new data.
+*/
+
+// Hints the CPU to start loading addr; a no-op where unsupported.
+#if defined(__GNUC__)
+#define FROZEN_BST_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define FROZEN_BST_PREFETCH(addr) ((void)0)
+#endif
+
+/**
+* An immutable sorted index stored in Eytzinger (BFS) order: the root
+* is at position 1 and the children of position k are at 2k and 2k+1.
+* The top levels of the implicit tree share a few cache lines, and
+* each descent step is a compare and a shift with no unpredictable
+* branch, while prefetching the keys a few levels ahead.
+*/
+template <typename Key, typename Value>
+class EytzingerIndex
+{
+public:
+    EytzingerIndex();
+    template<typename InputIt>
+    EytzingerIndex(InputIt first, InputIt last);
+
+    const Value* find(const Key& key) const;
+    bool contains(const Key& key) const;
+    Value const & operator[](const Key& key) const;
+    std::size_t size() const;
+    bool empty() const;
+
+protected:
+    std::size_t lowerBound(const Key& key) const;
+    template<typename RandomIt>
+    void fill(RandomIt sorted, std::size_t& next, std::size_t k);
+
+    // keys_[0] and values_[0] are unused so the root sits at index 1
+    std::vector<Key> keys_;
+    std::vector<Value> values_;
+};
+
+/*
+  ----------------------------------------------------
+  Begin implementations for the EytzingerIndex class.
+  ----------------------------------------------------
+*/
+
+/**
+* Creates an empty index.
+*/
+template<typename Key, typename Value>
+EytzingerIndex<Key, Value>::EytzingerIndex()
+{
+
+}
+
+/**
+* Builds the index in O(n) from a range of key/value pairs with
+* strictly increasing keys, such as a tree's begin() and end().
+*/
+template<typename Key, typename Value>
+template<typename InputIt>
+EytzingerIndex<Key, Value>::EytzingerIndex(InputIt first, InputIt last)
+{
+    std::vector<std::pair<Key, Value> > sorted;
+    for (; first != last; ++first){
+        sorted.push_back(std::pair<Key, Value>(first -> first, first -> second));
+    }
+    if (sorted.empty()){
+        return;
+    }
+
+    // position 0 is padding; fill() overwrites every other slot
+    keys_.assign(sorted.size() + 1, sorted[0].first);
+    values_.assign(sorted.size() + 1, sorted[0].second);
+    std::size_t next = 0;
+    fill(sorted.begin(), next, 1);
+}
+
+/**
+* Copies sorted items into the subtree rooted at position k by an
+* in-order walk of the implicit tree, so position order matches key order.
+*/
+template<typename Key, typename Value>
+template<typename RandomIt>
+void EytzingerIndex<Key, Value>::fill(RandomIt sorted, std::size_t& next, std::size_t k)
+{
+    if (k >= keys_.size()){
+        return;
+    }
+    fill(sorted, next, 2 * k);
+    keys_[k] = sorted[next].first;
+    values_[k] = sorted[next].second;
+    ++next;
+    fill(sorted, next, 2 * k + 1);
+}
+
+/**
+* Returns the position of the first key not less than key, or 0 if
+* every key is smaller.
+*/
+template<typename Key, typename Value>
+std::size_t EytzingerIndex<Key, Value>::lowerBound(const Key& key) const
+{
+    const Key* keys = keys_.data();
+    std::size_t n = keys_.size();
+
+    // the subtree 'levels' below k starts at k << levels; fetch one cache
+    // line's worth of keys that far ahead, or k itself near the bottom
+    const std::size_t stride = (64 / sizeof(Key)) > 0 ? (64 / sizeof(Key)) : 1;
+
+    std::size_t k = 1;
+    while (k < n){
+        FROZEN_BST_PREFETCH(keys + ((k * stride < n) ? k * stride : k));
+        k = 2 * k + (keys[k] < key);
+    }
+
+    // the path ends with some right turns after the lower bound; undo
+    // them along with the final left turn
+#if defined(__GNUC__)
+    k >>= __builtin_ffsll(static_cast<long long>(~k));
+#else
+    while (k & 1){
+        k >>= 1;
+    }
+    k >>= 1;
+#endif
+    return k;
+}
+
+/**
+* Returns a pointer to the value stored with key, or NULL if the key
+* is not in the index.
+*/
+template<typename Key, typename Value>
+const Value* EytzingerIndex<Key, Value>::find(const Key& key) const
+{
+    std::size_t k = lowerBound(key);
+    if (k == 0 || key < keys_[k]){
+        return NULL;
+    }
+    return &values_[k];
+}
+
+template<typename Key, typename Value>
+bool EytzingerIndex<Key, Value>::contains(const Key& key) const
+{
+    return find(key) != NULL;
+}
+
+/**
+ * @precondition The key exists in the index
+ * Returns the value associated with the key
+ */
+template<typename Key, typename Value>
+Value const & EytzingerIndex<Key, Value>::operator[](const Key& key) const
+{
+    const Value* value = find(key);
+    if(value == NULL) throw std::out_of_range("Invalid key");
+    return *value;
+}
+
+template<typename Key, typename Value>
+std::size_t EytzingerIndex<Key, Value>::size() const
+{
+    return keys_.empty() ? 0 : keys_.size() - 1;
+}
+
+template<typename Key, typename Value>
+bool EytzingerIndex<Key, Value>::empty() const
+{
+    return keys_.empty();
+}
+
+/*
+  --------------------------------------------------
+  End implementations for the EytzingerIndex class.
+  --------------------------------------------------
+*/
+
+/**
+* An immutable, perfectly balanced search tree whose nodes are stored in
+* van Emde Boas order: the top half of the levels is laid out first, then
+* each subtree hanging below it, each piece recursively in the same way.
+* Any root-to-leaf path then touches O(log_B n) blocks for every block
+* size B at once (cache lines, pages, ...), without tuning for either.
+*
+* Unlike EytzingerIndex the tree keeps explicit 32-bit child and parent
+* links, so it also supports in-order iteration and range scans. Searches
+* only touch the compact key/child-link nodes; the items and parent links
+* live in parallel arrays that iteration reads.
+*/
+template <typename Key, typename Value>
+class VebIndex
+{
+public:
+    typedef std::uint32_t index_type;
+    static const index_type npos = 0xFFFFFFFFu;
+
+    VebIndex();
+    template<typename InputIt>
+    VebIndex(InputIt first, InputIt last);
+
+    /**
+    * A read-only iterator over the snapshot in key order.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        const std::pair<const Key,Value>& operator*() const;
+        const std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class VebIndex<Key, Value>;
+        iterator(const VebIndex<Key, Value>* index, index_type current);
+        const VebIndex<Key, Value>* index_;
+        index_type current_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    Value const & operator[](const Key& key) const;
+    std::size_t size() const;
+    bool empty() const;
+
+protected:
+    struct VebNode
+    {
+        VebNode(const Key& key);
+
+        Key key_;
+        index_type left_;
+        index_type right_;
+    };
+
+    index_type successor(index_type current) const;
+    void layout(index_type lo, index_type hi, int levels, std::vector<index_type>& order) const;
+    void collectSubtrees(index_type lo, index_type hi, int depth,
+                         std::vector<std::pair<index_type, index_type> >& ranges) const;
+    void link(index_type lo, index_type hi, index_type parent,
+              const std::vector<index_type>& position);
+
+    // all three are indexed by storage position
+    std::vector<VebNode> nodes_;
+    std::vector<index_type> parents_;
+    std::vector<std::pair<const Key, Value> > items_;
+    index_type root_;
+    index_type first_;
+};
+
+template<typename Key, typename Value>
+const typename VebIndex<Key, Value>::index_type VebIndex<Key, Value>::npos;
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the VebIndex::iterator class.
+  ---------------------------------------------------
+*/
+
+template<typename Key, typename Value>
+VebIndex<Key, Value>::iterator::iterator() :
+    index_(NULL),
+    current_(npos)
+{
+
+}
+
+template<typename Key, typename Value>
+VebIndex<Key, Value>::iterator::iterator(const VebIndex<Key, Value>* index, index_type current) :
+    index_(index),
+    current_(current)
+{
+
+}
+
+template<typename Key, typename Value>
+const std::pair<const Key,Value>&
+VebIndex<Key, Value>::iterator::operator*() const
+{
+    return index_ -> items_[current_];
+}
+
+template<typename Key, typename Value>
+const std::pair<const Key,Value>*
+VebIndex<Key, Value>::iterator::operator->() const
+{
+    return &(index_ -> items_[current_]);
+}
+
+template<typename Key, typename Value>
+bool VebIndex<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    return current_ == rhs.current_;
+}
+
+template<typename Key, typename Value>
+bool VebIndex<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return current_ != rhs.current_;
+}
+
+/**
+* Advances the iterator's location using an in-order sequencing
+*/
+template<typename Key, typename Value>
+typename VebIndex<Key, Value>::iterator&
+VebIndex<Key, Value>::iterator::operator++()
+{
+    if (current_ != npos){
+        current_ = index_ -> successor(current_);
+    }
+    return *this;
+}
+
+/*
+  --------------------------------------------
+  Begin implementations for the VebIndex class.
+  --------------------------------------------
+*/
+
+template<typename Key, typename Value>
+VebIndex<Key, Value>::VebNode::VebNode(const Key& key) :
+    key_(key),
+    left_(npos),
+    right_(npos)
+{
+
+}
+
+/**
+* Creates an empty index.
+*/
+template<typename Key, typename Value>
+VebIndex<Key, Value>::VebIndex() :
+    root_(npos),
+    first_(npos)
+{
+
+}
+
+/**
+* Builds the index from a range of key/value pairs with strictly
+* increasing keys, such as a tree's begin() and end(). The node for the
+* sorted slice [lo, hi) is always its middle element, so the shape is
+* perfectly balanced; only the storage order is van Emde Boas.
+*/
+template<typename Key, typename Value>
+template<typename InputIt>
+VebIndex<Key, Value>::VebIndex(InputIt first, InputIt last) :
+    root_(npos),
+    first_(npos)
+{
+    std::vector<std::pair<Key, Value> > sorted;
+    for (; first != last; ++first){
+        sorted.push_back(std::pair<Key, Value>(first -> first, first -> second));
+    }
+    if (sorted.empty()){
+        return;
+    }
+    if (sorted.size() >= npos){
+        throw std::length_error("VebIndex is limited to 2^32 - 1 entries");
+    }
+    index_type n = static_cast<index_type>(sorted.size());
+
+    int levels = 0;
+    while ((static_cast<std::uint64_t>(1) << levels) <= n){
+        ++levels;
+    }
+
+    // order[p] is the sorted position of the node stored at p
+    std::vector<index_type> order;
+    order.reserve(n);
+    layout(0, n, levels, order);
+
+    std::vector<index_type> position(n);
+    nodes_.reserve(n);
+    items_.reserve(n);
+    parents_.assign(n, npos);
+    for (index_type p = 0; p < n; ++p){
+        position[order[p]] = p;
+        nodes_.push_back(VebNode(sorted[order[p]].first));
+        items_.push_back(std::pair<const Key, Value>(sorted[order[p]].first, sorted[order[p]].second));
+    }
+    link(0, n, npos, position);
+    root_ = position[n / 2];
+    first_ = position[0];
+}
+
+/**
+* Appends to order the top 'levels' levels of the balanced tree over the
+* sorted slice [lo, hi), in van Emde Boas order.
+*/
+template<typename Key, typename Value>
+void VebIndex<Key, Value>::layout(index_type lo, index_type hi, int levels,
+                                  std::vector<index_type>& order) const
+{
+    if (lo >= hi || levels == 0){
+        return;
+    }
+    if (levels == 1){
+        order.push_back(lo + (hi - lo) / 2);
+        return;
+    }
+
+    // lay out the top half, then every subtree hanging off its bottom
+    int topLevels = levels / 2;
+    layout(lo, hi, topLevels, order);
+
+    std::vector<std::pair<index_type, index_type> > ranges;
+    collectSubtrees(lo, hi, topLevels, ranges);
+    for (std::size_t i = 0; i < ranges.size(); ++i){
+        layout(ranges[i].first, ranges[i].second, levels - topLevels, order);
+    }
+}
+
+/**
+* Collects, left to right, the sorted slices of the subtrees rooted
+* 'depth' levels below the root of the balanced tree over [lo, hi).
+*/
+template<typename Key, typename Value>
+void VebIndex<Key, Value>::collectSubtrees(index_type lo, index_type hi, int depth,
+                                           std::vector<std::pair<index_type, index_type> >& ranges) const
+{
+    if (lo >= hi){
+        return;
+    }
+    if (depth == 0){
+        ranges.push_back(std::make_pair(lo, hi));
+        return;
+    }
+    index_type mid = lo + (hi - lo) / 2;
+    collectSubtrees(lo, mid, depth - 1, ranges);
+    collectSubtrees(mid + 1, hi, depth - 1, ranges);
+}
+
+/**
+* Sets the child and parent links of the balanced tree over [lo, hi),
+* translated to storage positions.
+*/
+template<typename Key, typename Value>
+void VebIndex<Key, Value>::link(index_type lo, index_type hi, index_type parent,
+                                const std::vector<index_type>& position)
+{
+    if (lo >= hi){
+        return;
+    }
+    index_type mid = lo + (hi - lo) / 2;
+    VebNode& node = nodes_[position[mid]];
+    parents_[position[mid]] = parent;
+    if (lo < mid){
+        node.left_ = position[lo + (mid - lo) / 2];
+    }
+    if (mid + 1 < hi){
+        node.right_ = position[mid + 1 + (hi - mid - 1) / 2];
+    }
+    link(lo, mid, position[mid], position);
+    link(mid + 1, hi, position[mid], position);
+}
+
+template<typename Key, typename Value>
+typename VebIndex<Key, Value>::index_type
+VebIndex<Key, Value>::successor(index_type current) const
+{
+    // leftmost node in the right subtree
+    if (nodes_[current].right_ != npos){
+        index_type temp = nodes_[current].right_;
+        while (nodes_[temp].left_ != npos){
+            temp = nodes_[temp].left_;
+        }
+        return temp;
+    }
+    // otherwise the first ancestor we reach from its left side
+    index_type tempCurr = current;
+    index_type tempPar = parents_[current];
+    while (tempPar != npos && tempCurr == nodes_[tempPar].right_){
+        tempCurr = tempPar;
+        tempPar = parents_[tempPar];
+    }
+    return tempPar;
+}
+
+template<typename Key, typename Value>
+typename VebIndex<Key, Value>::iterator
+VebIndex<Key, Value>::begin() const
+{
+    return iterator(this, first_);
+}
+
+template<typename Key, typename Value>
+typename VebIndex<Key, Value>::iterator
+VebIndex<Key, Value>::end() const
+{
+    return iterator(this, npos);
+}
+
+/**
+* Returns an iterator to the first entry whose key is not less than key.
+*/
+template<typename Key, typename Value>
+typename VebIndex<Key, Value>::iterator
+VebIndex<Key, Value>::lower_bound(const Key& key) const
+{
+    const VebNode* nodes = nodes_.data();
+    index_type temp = root_;
+    index_type found = npos;
+    while (temp != npos){
+        const VebNode& node = nodes[temp];
+
+        // start loading both children while this comparison resolves; a
+        // missing child prefetches this node again rather than past the end
+        FROZEN_BST_PREFETCH(nodes + ((node.left_ != npos) ? node.left_ : temp));
+        FROZEN_BST_PREFETCH(nodes + ((node.right_ != npos) ? node.right_ : temp));
+
+        // written as selects so the compiler can avoid a branch
+        bool goRight = node.key_ < key;
+        found = goRight ? found : temp;
+        temp = goRight ? node.right_ : node.left_;
+    }
+    return iterator(this, found);
+}
+
+/**
+* Returns an iterator to the first entry whose key is greater than key.
+*/
+template<typename Key, typename Value>
+typename VebIndex<Key, Value>::iterator
+VebIndex<Key, Value>::upper_bound(const Key& key) const
+{
+    index_type temp = root_;
+    index_type found = npos;
+    while (temp != npos){
+        if (key < nodes_[temp].key_){
+            found = temp;
+            temp = nodes_[temp].left_;
+        } else {
+            temp = nodes_[temp].right_;
+        }
+    }
+    return iterator(this, found);
+}
+
+/**
+* Returns an iterator to the entry with the given key, or end().
+*/
+template<typename Key, typename Value>
+typename VebIndex<Key, Value>::iterator
+VebIndex<Key, Value>::find(const Key& key) const
+{
+    iterator it = lower_bound(key);
+    if (it == end() || key < nodes_[it.current_].key_){
+        return end();
+    }
+    return it;
+}
+
+/**
+ * @precondition The key exists in the index
+ * Returns the value associated with the key
+ */
+template<typename Key, typename Value>
+Value const & VebIndex<Key, Value>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return it -> second;
+}
+
+template<typename Key, typename Value>
+std::size_t VebIndex<Key, Value>::size() const
+{
+    return nodes_.size();
+}
+
+template<typename Key, typename Value>
+bool VebIndex<Key, Value>::empty() const
+{
+    return nodes_.empty();
+}
+
+/*
+  ------------------------------------------
+  End implementations for the VebIndex class.
+  ------------------------------------------
+*/
+
+/**
+* Takes a read-only Eytzinger snapshot of an AVLTree in O(n).
+*/
+template<typename Key, typename Value>
+EytzingerIndex<Key, Value> freeze(const AVLTree<Key, Value>& tree)
+{
+    return EytzingerIndex<Key, Value>(tree.begin(), tree.end());
+}
+
+/**
+* Takes a read-only van Emde Boas snapshot of an AVLTree.
+*/
+template<typename Key, typename Value>
+VebIndex<Key, Value> freezeVeb(const AVLTree<Key, Value>& tree)
+{
+    return VebIndex<Key, Value>(tree.begin(), tree.end());
+}
+
+#endif
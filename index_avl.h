@@ -0,0 +1,762 @@
+#ifndef INDEX_AVL_H
+#define INDEX_AVL_H
+
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+#include <new>
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+/**
+* An AVL tree whose nodes live in one contiguous vector and link to each
+* other with 32-bit indices instead of pointers. It offers the same
+* insert/remove/find/iterator interface as AVLTree.
+*
+* For <uint64_t,uint64_t> entries an AVLNode spends 32 bytes on links,
+* balance and padding; a node here spends 16. Since no link is an address,
+* the default copy and move of the tree are correct as they are. The tree
+* holds at most 2^32 - 1 entries; inserting past that, or reserving more,
+* throws std::length_error.
+*
+* Removing a node moves the last node of the vector into its slot, so
+* iterators other than end() are invalidated by remove().
+*/
+template <typename Key, typename Value>
+class IndexedAVLTree
+{
+public:
+    typedef std::uint32_t index_type;
+    static const index_type npos = 0xFFFFFFFFu;
+
+    IndexedAVLTree();
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    void reserve(std::size_t n);
+    bool isBalanced() const;
+    bool empty() const;
+    std::size_t size() const;
+
+    /**
+    * An iterator over the contents of the tree in key order.
+    */
+    class iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::pair<const Key, Value>* pointer;
+        typedef std::pair<const Key, Value>& reference;
+
+        iterator();
+
+        std::pair<const Key,Value>& operator*() const;
+        std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+        iterator operator++(int);
+
+    protected:
+        friend class IndexedAVLTree<Key, Value>;
+        iterator(const IndexedAVLTree<Key, Value>* tree, index_type current);
+        const IndexedAVLTree<Key, Value>* tree_;
+        index_type current_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+protected:
+    /**
+    * A node stored by value in nodes_. Links are positions in nodes_,
+    * or npos for "no node".
+    */
+    struct IndexedAVLNode
+    {
+        IndexedAVLNode(const Key& key, const Value& value, index_type parent);
+
+        std::pair<const Key, Value> item_;
+        index_type parent_;
+        index_type left_;
+        index_type right_;
+        int8_t balance_;
+    };
+
+    index_type internalFind(const Key& key) const;
+    index_type getSmallestNode() const;
+    index_type successor(index_type current) const;
+    index_type predecessor(index_type current) const;
+    int height(index_type current) const;
+
+    void insertFix(index_type p, index_type n);
+    void removeFix(index_type n, int diff);
+    void rotateLeft(index_type n1);
+    void rotateRight(index_type n1);
+    void nodeSwap(index_type n1, index_type n2);
+    void replaceChild(index_type parent, index_type oldChild, index_type newChild);
+    index_type releaseNode(index_type n);
+
+    std::vector<IndexedAVLNode> nodes_;
+    index_type root_;
+};
+
+template<typename Key, typename Value>
+const typename IndexedAVLTree<Key, Value>::index_type IndexedAVLTree<Key, Value>::npos;
+
+/*
+  -----------------------------------------------------
+  Begin implementations for the IndexedAVLNode struct.
+  -----------------------------------------------------
+*/
+
+template<typename Key, typename Value>
+IndexedAVLTree<Key, Value>::IndexedAVLNode::IndexedAVLNode(const Key& key, const Value& value, index_type parent) :
+    item_(key, value),
+    parent_(parent),
+    left_(npos),
+    right_(npos),
+    balance_(0)
+{
+
+}
+
+/*
+  -----------------------------------------------------------
+  Begin implementations for the IndexedAVLTree::iterator class.
+  -----------------------------------------------------------
+*/
+
+template<typename Key, typename Value>
+IndexedAVLTree<Key, Value>::iterator::iterator() :
+    tree_(NULL),
+    current_(npos)
+{
+
+}
+
+template<typename Key, typename Value>
+IndexedAVLTree<Key, Value>::iterator::iterator(const IndexedAVLTree<Key, Value>* tree, index_type current) :
+    tree_(tree),
+    current_(current)
+{
+
+}
+
+/**
+* Provides access to the item. Like BinarySearchTree, iterators obtained
+* from a const tree still allow the value to be changed.
+*/
+template<typename Key, typename Value>
+std::pair<const Key,Value>&
+IndexedAVLTree<Key, Value>::iterator::operator*() const
+{
+    return const_cast<IndexedAVLTree<Key, Value>*>(tree_) -> nodes_[current_].item_;
+}
+
+template<typename Key, typename Value>
+std::pair<const Key,Value>*
+IndexedAVLTree<Key, Value>::iterator::operator->() const
+{
+    return &(**this);
+}
+
+template<typename Key, typename Value>
+bool IndexedAVLTree<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    return current_ == rhs.current_;
+}
+
+template<typename Key, typename Value>
+bool IndexedAVLTree<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return current_ != rhs.current_;
+}
+
+/**
+* Advances the iterator's location using an in-order sequencing
+*/
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::iterator&
+IndexedAVLTree<Key, Value>::iterator::operator++()
+{
+    if (current_ != npos){
+        current_ = tree_ -> successor(current_);
+    }
+    return *this;
+}
+
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::iterator
+IndexedAVLTree<Key, Value>::iterator::operator++(int)
+{
+    iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the IndexedAVLTree class.
+  ---------------------------------------------------
+*/
+
+template<typename Key, typename Value>
+IndexedAVLTree<Key, Value>::IndexedAVLTree() :
+    root_(npos)
+{
+
+}
+
+template<typename Key, typename Value>
+bool IndexedAVLTree<Key, Value>::empty() const
+{
+    return root_ == npos;
+}
+
+template<typename Key, typename Value>
+std::size_t IndexedAVLTree<Key, Value>::size() const
+{
+    return nodes_.size();
+}
+
+/**
+* Reserves room for n nodes so that inserts do not reallocate.
+*/
+template<typename Key, typename Value>
+void IndexedAVLTree<Key, Value>::reserve(std::size_t n)
+{
+    if (n > npos){
+        throw std::length_error("IndexedAVLTree is full");
+    }
+    nodes_.reserve(n);
+}
+
+/**
+* Removes all contents of the tree. Nodes hold no outgoing pointers,
+* so this is just a clear of the node vector.
+*/
+template<typename Key, typename Value>
+void IndexedAVLTree<Key, Value>::clear()
+{
+    nodes_.clear();
+    root_ = npos;
+}
+
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::iterator
+IndexedAVLTree<Key, Value>::begin() const
+{
+    return iterator(this, getSmallestNode());
+}
+
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::iterator
+IndexedAVLTree<Key, Value>::end() const
+{
+    return iterator(this, npos);
+}
+
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::iterator
+IndexedAVLTree<Key, Value>::find(const Key& key) const
+{
+    return iterator(this, internalFind(key));
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<typename Key, typename Value>
+Value& IndexedAVLTree<Key, Value>::operator[](const Key& key)
+{
+    index_type curr = internalFind(key);
+    if(curr == npos) throw std::out_of_range("Invalid key");
+    return nodes_[curr].item_.second;
+}
+
+template<typename Key, typename Value>
+Value const & IndexedAVLTree<Key, Value>::operator[](const Key& key) const
+{
+    index_type curr = internalFind(key);
+    if(curr == npos) throw std::out_of_range("Invalid key");
+    return nodes_[curr].item_.second;
+}
+
+/**
+* Inserts a key/value pair, overwriting the value if the key exists,
+* and rebalances the same way AVLTree::insert does.
+*/
+template<typename Key, typename Value>
+void IndexedAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    index_type temp = root_;
+    index_type tempParent = npos;
+
+    // traverse through tree until insertion point is found
+    while (temp != npos){
+        tempParent = temp;
+        const Key& key = nodes_[temp].item_.first;
+
+        // key already exists, replace value
+        if (keyValuePair.first == key){
+            nodes_[temp].item_.second = keyValuePair.second;
+            return;
+        }
+        else if (keyValuePair.first < key){
+            temp = nodes_[temp].left_;
+        }
+        else {
+            temp = nodes_[temp].right_;
+        }
+    }
+
+    // npos is reserved for "no node"
+    if (nodes_.size() >= npos){
+        throw std::length_error("IndexedAVLTree is full");
+    }
+    nodes_.push_back(IndexedAVLNode(keyValuePair.first, keyValuePair.second, tempParent));
+    index_type newNode = static_cast<index_type>(nodes_.size() - 1);
+
+    // tree is empty, set new node as root
+    if (tempParent == npos){
+        root_ = newNode;
+        return;
+    }
+
+    IndexedAVLNode& parent = nodes_[tempParent];
+    if (keyValuePair.first < parent.item_.first){
+        parent.left_ = newNode;
+    } else {
+        parent.right_ = newNode;
+    }
+
+    // parent was lopsided; the new node just evened it out
+    if (parent.balance_ != 0){
+        parent.balance_ = 0;
+        return;
+    }
+    parent.balance_ = (newNode == parent.left_) ? -1 : 1;
+    insertFix(tempParent, newNode);
+}
+
+/**
+* Walks up from p, whose subtree just grew taller through its child n,
+* and rotates once at the first node that goes out of balance.
+*/
+template<typename Key, typename Value>
+void IndexedAVLTree<Key, Value>::insertFix(index_type p, index_type n)
+{
+    while (p != npos && nodes_[p].parent_ != npos){
+        index_type g = nodes_[p].parent_;
+
+        // parent is left child of grandparent
+        if (p == nodes_[g].left_){
+            nodes_[g].balance_ -= 1;
+            if (nodes_[g].balance_ == 0){
+                return;
+            } else if (nodes_[g].balance_ == -1){
+                n = p;
+                p = g;
+                continue;
+            }
+            // zigzigleft
+            if (n == nodes_[p].left_){
+                rotateRight(g);
+                nodes_[p].balance_ = 0;
+                nodes_[g].balance_ = 0;
+            // zigzagleft
+            } else {
+                int8_t nb = nodes_[n].balance_;
+                rotateLeft(p);
+                rotateRight(g);
+                nodes_[p].balance_ = (nb == 1) ? -1 : 0;
+                nodes_[g].balance_ = (nb == -1) ? 1 : 0;
+                nodes_[n].balance_ = 0;
+            }
+            return;
+        }
+
+        // parent is right child of grandparent
+        nodes_[g].balance_ += 1;
+        if (nodes_[g].balance_ == 0){
+            return;
+        } else if (nodes_[g].balance_ == 1){
+            n = p;
+            p = g;
+            continue;
+        }
+        // zig zig right
+        if (n == nodes_[p].right_){
+            rotateLeft(g);
+            nodes_[p].balance_ = 0;
+            nodes_[g].balance_ = 0;
+        // zig zag right
+        } else {
+            int8_t nb = nodes_[n].balance_;
+            rotateRight(p);
+            rotateLeft(g);
+            nodes_[p].balance_ = (nb == -1) ? 1 : 0;
+            nodes_[g].balance_ = (nb == 1) ? -1 : 0;
+            nodes_[n].balance_ = 0;
+        }
+        return;
+    }
+}
+
+/**
+* Makes newChild take oldChild's place under parent, or at the root
+* if parent is npos. Does not touch newChild's parent link.
+*/
+template<typename Key, typename Value>
+void IndexedAVLTree<Key, Value>::replaceChild(index_type parent, index_type oldChild, index_type newChild)
+{
+    if (parent == npos){
+        root_ = newChild;
+    } else if (nodes_[parent].left_ == oldChild){
+        nodes_[parent].left_ = newChild;
+    } else {
+        nodes_[parent].right_ = newChild;
+    }
+}
+
+// perform right rotation on given node
+template<typename Key, typename Value>
+void IndexedAVLTree<Key, Value>::rotateRight(index_type n1)
+{
+    index_type p = nodes_[n1].left_;
+    if (p == npos){
+        return;
+    }
+    index_type moved = nodes_[p].right_;
+
+    nodes_[n1].left_ = moved;
+    if (moved != npos){
+        nodes_[moved].parent_ = n1;
+    }
+    nodes_[p].parent_ = nodes_[n1].parent_;
+    replaceChild(nodes_[n1].parent_, n1, p);
+    nodes_[n1].parent_ = p;
+    nodes_[p].right_ = n1;
+}
+
+// perform left rotation on given node
+template<typename Key, typename Value>
+void IndexedAVLTree<Key, Value>::rotateLeft(index_type n1)
+{
+    index_type p = nodes_[n1].right_;
+    if (p == npos){
+        return;
+    }
+    index_type moved = nodes_[p].left_;
+
+    nodes_[n1].right_ = moved;
+    if (moved != npos){
+        nodes_[moved].parent_ = n1;
+    }
+    nodes_[p].parent_ = nodes_[n1].parent_;
+    replaceChild(nodes_[n1].parent_, n1, p);
+    nodes_[n1].parent_ = p;
+    nodes_[p].left_ = n1;
+}
+
+/**
+* Removes the key if present. A node with two children is first swapped
+* with its predecessor, as in AVLTree::remove.
+*/
+template<typename Key, typename Value>
+void IndexedAVLTree<Key, Value>::remove(const Key& key)
+{
+    index_type badNode = internalFind(key);
+    if (badNode == npos){
+        return;
+    }
+
+    // node has two children, so must swap with its predecessor before removing
+    if (nodes_[badNode].left_ != npos && nodes_[badNode].right_ != npos){
+        nodeSwap(badNode, predecessor(badNode));
+    }
+
+    index_type p = nodes_[badNode].parent_;
+    int diff = 0;
+    if (p != npos){
+        diff = (badNode == nodes_[p].left_) ? 1 : -1;
+    }
+
+    // splice out the node, which has at most one child now
+    index_type child = nodes_[badNode].left_ != npos ? nodes_[badNode].left_ : nodes_[badNode].right_;
+    if (child != npos){
+        nodes_[child].parent_ = p;
+    }
+    replaceChild(p, badNode, child);
+
+    // the parent may be the node that gets moved into the freed slot
+    index_type moved = releaseNode(badNode);
+    if (moved != npos && p == moved){
+        p = badNode;
+    }
+
+    if (p != npos){
+        removeFix(p, diff);
+    }
+}
+
+/**
+* Frees slot n, which must already be unlinked, by moving the last node
+* of the vector into it. Returns the old index of the moved node
+* (npos if n was the last slot).
+*/
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::index_type
+IndexedAVLTree<Key, Value>::releaseNode(index_type n)
+{
+    index_type last = static_cast<index_type>(nodes_.size() - 1);
+    if (n == last){
+        nodes_.pop_back();
+        return npos;
+    }
+
+    // point everything that referenced the last node at its new slot
+    IndexedAVLNode& moving = nodes_[last];
+    replaceChild(moving.parent_, last, n);
+    if (moving.left_ != npos){
+        nodes_[moving.left_].parent_ = n;
+    }
+    if (moving.right_ != npos){
+        nodes_[moving.right_].parent_ = n;
+    }
+
+    // the key is const, so relocate by reconstructing rather than assigning
+    nodes_[n].~IndexedAVLNode();
+    new (&nodes_[n]) IndexedAVLNode(std::move(moving));
+    nodes_.pop_back();
+    return last;
+}
+
+/**
+* Walks up from n, whose subtree on one side just got shorter, the same
+* way AVLTree::removeFix does. diff is +1 if the left side shrank and -1
+* if the right side did.
+*/
+template<typename Key, typename Value>
+void IndexedAVLTree<Key, Value>::removeFix(index_type n, int diff)
+{
+    while (n != npos){
+        index_type p = nodes_[n].parent_;
+        int ndiff = 0;
+        if (p != npos){
+            ndiff = (n == nodes_[p].left_) ? 1 : -1;
+        }
+
+        nodes_[n].balance_ += diff;
+        int8_t balance = nodes_[n].balance_;
+
+        if (balance == 2 * diff){
+            // taller side is now two deeper; rotate its child up
+            index_type c = (diff == 1) ? nodes_[n].right_ : nodes_[n].left_;
+            int8_t cb = nodes_[c].balance_;
+            if (cb == diff){
+                if (diff == 1) rotateLeft(n); else rotateRight(n);
+                nodes_[n].balance_ = 0;
+                nodes_[c].balance_ = 0;
+            } else if (cb == 0){
+                if (diff == 1) rotateLeft(n); else rotateRight(n);
+                nodes_[n].balance_ = static_cast<int8_t>(diff);
+                nodes_[c].balance_ = static_cast<int8_t>(-diff);
+                return;
+            } else {
+                index_type g = (diff == 1) ? nodes_[c].left_ : nodes_[c].right_;
+                int8_t gb = nodes_[g].balance_;
+                if (diff == 1){
+                    rotateRight(c);
+                    rotateLeft(n);
+                } else {
+                    rotateLeft(c);
+                    rotateRight(n);
+                }
+                nodes_[n].balance_ = (gb == diff) ? static_cast<int8_t>(-diff) : 0;
+                nodes_[c].balance_ = (gb == -diff) ? static_cast<int8_t>(diff) : 0;
+                nodes_[g].balance_ = 0;
+            }
+        } else if (balance == diff){
+            // height of n is unchanged
+            return;
+        }
+
+        // subtree rooted here got shorter; keep going up
+        n = p;
+        diff = ndiff;
+    }
+}
+
+/**
+* Swaps the positions of two nodes in the tree (not their slots in the
+* vector), along with their balances.
+*/
+template<typename Key, typename Value>
+void IndexedAVLTree<Key, Value>::nodeSwap(index_type n1, index_type n2)
+{
+    if (n1 == n2 || n1 == npos || n2 == npos){
+        return;
+    }
+    IndexedAVLNode& a = nodes_[n1];
+    IndexedAVLNode& b = nodes_[n2];
+    index_type ap = a.parent_, al = a.left_, ar = a.right_;
+    index_type bp = b.parent_, bl = b.left_, br = b.right_;
+    bool aIsLeft = (ap != npos && nodes_[ap].left_ == n1);
+    bool bIsLeft = (bp != npos && nodes_[bp].left_ == n2);
+
+    // take over each other's links, then fix the case where they were adjacent
+    a.parent_ = bp; a.left_ = bl; a.right_ = br;
+    b.parent_ = ap; b.left_ = al; b.right_ = ar;
+    if (ar == n2){
+        b.right_ = n1;
+        a.parent_ = n2;
+    } else if (br == n1){
+        a.right_ = n2;
+        b.parent_ = n1;
+    } else if (al == n2){
+        b.left_ = n1;
+        a.parent_ = n2;
+    } else if (bl == n1){
+        a.left_ = n2;
+        b.parent_ = n1;
+    }
+
+    // update the neighbours that are not n1 or n2 themselves
+    if (ap != npos && ap != n2){
+        if (aIsLeft) nodes_[ap].left_ = n2; else nodes_[ap].right_ = n2;
+    }
+    if (ar != npos && ar != n2) nodes_[ar].parent_ = n2;
+    if (al != npos && al != n2) nodes_[al].parent_ = n2;
+    if (bp != npos && bp != n1){
+        if (bIsLeft) nodes_[bp].left_ = n1; else nodes_[bp].right_ = n1;
+    }
+    if (br != npos && br != n1) nodes_[br].parent_ = n1;
+    if (bl != npos && bl != n1) nodes_[bl].parent_ = n1;
+
+    if (root_ == n1){
+        root_ = n2;
+    } else if (root_ == n2){
+        root_ = n1;
+    }
+    std::swap(a.balance_, b.balance_);
+}
+
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::index_type
+IndexedAVLTree<Key, Value>::internalFind(const Key& key) const
+{
+    index_type temp = root_;
+    while (temp != npos){
+        const Key& k = nodes_[temp].item_.first;
+        if (k == key){
+            return temp;
+        }
+        temp = (key > k) ? nodes_[temp].right_ : nodes_[temp].left_;
+    }
+    return npos;
+}
+
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::index_type
+IndexedAVLTree<Key, Value>::getSmallestNode() const
+{
+    if (root_ == npos){
+        return npos;
+    }
+    index_type temp = root_;
+    while (nodes_[temp].left_ != npos){
+        temp = nodes_[temp].left_;
+    }
+    return temp;
+}
+
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::index_type
+IndexedAVLTree<Key, Value>::successor(index_type current) const
+{
+    // leftmost node in the right subtree
+    if (nodes_[current].right_ != npos){
+        index_type temp = nodes_[current].right_;
+        while (nodes_[temp].left_ != npos){
+            temp = nodes_[temp].left_;
+        }
+        return temp;
+    }
+    // otherwise the first ancestor we reach from its left side
+    index_type tempCurr = current;
+    index_type tempPar = nodes_[current].parent_;
+    while (tempPar != npos && tempCurr == nodes_[tempPar].right_){
+        tempCurr = tempPar;
+        tempPar = nodes_[tempPar].parent_;
+    }
+    return tempPar;
+}
+
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::index_type
+IndexedAVLTree<Key, Value>::predecessor(index_type current) const
+{
+    // rightmost node in the left subtree
+    if (nodes_[current].left_ != npos){
+        index_type temp = nodes_[current].left_;
+        while (nodes_[temp].right_ != npos){
+            temp = nodes_[temp].right_;
+        }
+        return temp;
+    }
+    // otherwise the first ancestor we reach from its right side
+    index_type tempCurr = current;
+    index_type tempPar = nodes_[current].parent_;
+    while (tempPar != npos && tempCurr == nodes_[tempPar].left_){
+        tempCurr = tempPar;
+        tempPar = nodes_[tempPar].parent_;
+    }
+    return tempPar;
+}
+
+// returns height of given node, or -1 if its subtree is out of balance
+template<typename Key, typename Value>
+int IndexedAVLTree<Key, Value>::height(index_type current) const
+{
+    if (current == npos){
+        return 0;
+    }
+    int leftHeight = height(nodes_[current].left_);
+    int rightHeight = height(nodes_[current].right_);
+    if (leftHeight == -1 || rightHeight == -1 || std::abs(rightHeight - leftHeight) > 1){
+        return -1;
+    }
+    return 1 + std::max(leftHeight, rightHeight);
+}
+
+/**
+ * Return true iff the tree is balanced.
+ */
+template<typename Key, typename Value>
+bool IndexedAVLTree<Key, Value>::isBalanced() const
+{
+    return height(root_) != -1;
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the IndexedAVLTree class.
+  -------------------------------------------------
+*/
+
+#endif
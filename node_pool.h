@@ -0,0 +1,330 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <vector>
+
+/**
+ * A slab allocator for the fixed-size nodes of a search tree.
+ * Blocks are carved out of large chunks and recycled through an
+ * intrusive free list, so insert/remove churn never reaches malloc,
+ * and release() frees every node of a tree by dropping whole chunks
+ * instead of walking the tree.
+ *
+ * Each tree owns one pool, sized for its node type when the tree is
+ * constructed. Building with -DBST_NO_POOL turns the pool into a thin
+ * wrapper around per-node new/delete (useful as a benchmark baseline
+ * and under valgrind).
+ *
+ * Chunks are reference counted, so that trees can hand nodes to each
+ * other (split, join, set operations): a chunk lives until every pool
+ * holding it has been released.
+ */
+class NodePool
+{
+public:
+    /**
+    * A reference to one chunk, which keeps it alive; empty under
+    * BST_NO_POOL, where blocks are not carved out of chunks.
+    */
+    struct Chunk
+    {
+        std::shared_ptr<char> memory;
+        std::size_t bytes;
+    };
+
+    NodePool(std::size_t blockSize, std::size_t blockAlign);
+    ~NodePool();
+
+    void* allocate();
+    void deallocate(void* block);
+    void release();
+    void absorb(NodePool& other);
+    void share(const NodePool& other);
+    Chunk chunkOf(const void* block) const;
+    void share(const Chunk& chunk);
+
+    std::size_t blockSize() const;
+    std::size_t bytesReserved() const;
+
+    // true if release() frees the storage of live blocks, so that
+    // callers only need to walk their nodes to run destructors
+#ifdef BST_NO_POOL
+    static const bool releasesBlocks = false;
+#else
+    static const bool releasesBlocks = true;
+#endif
+
+private:
+    NodePool(const NodePool&);
+    NodePool& operator=(const NodePool&);
+
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    struct ChunkDelete
+    {
+        void operator()(char* chunk) const { ::operator delete(chunk); }
+    };
+
+    void grow();
+    void dedupeChunks();
+
+    static const std::size_t firstChunkBlocks = 64;
+    static const std::size_t maxChunkBlocks = 65536;
+
+    std::vector<Chunk> chunks_;
+    FreeBlock* freeList_;
+    char* bump_;
+    char* bumpEnd_;
+    std::size_t blockSize_;
+    std::size_t blockAlign_;
+    std::size_t nextChunkBlocks_;
+    std::size_t bytesReserved_;
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the NodePool class.
+  ---------------------------------------------
+*/
+
+/**
+* Creates an empty pool handing out blocks of at least blockSize bytes,
+* aligned to blockAlign. No memory is reserved until the first allocate().
+*/
+inline NodePool::NodePool(std::size_t blockSize, std::size_t blockAlign) :
+    freeList_(NULL),
+    bump_(NULL),
+    bumpEnd_(NULL),
+    blockSize_(0),
+    blockAlign_(blockAlign < alignof(FreeBlock) ? alignof(FreeBlock) : blockAlign),
+    nextChunkBlocks_(firstChunkBlocks),
+    bytesReserved_(0)
+{
+    // every block must be able to hold a free list link, and consecutive
+    // blocks in a chunk must all stay aligned
+    if (blockSize < sizeof(FreeBlock)){
+        blockSize = sizeof(FreeBlock);
+    }
+    blockSize_ = (blockSize + blockAlign_ - 1) / blockAlign_ * blockAlign_;
+}
+
+/**
+* Frees every chunk. Destructors of objects still living in the pool
+* are NOT run; that is the owner's job.
+*/
+inline NodePool::~NodePool()
+{
+    release();
+}
+
+/**
+* Returns an uninitialized block, reusing a freed block if there is one.
+*/
+inline void* NodePool::allocate()
+{
+#ifdef BST_NO_POOL
+    bytesReserved_ += blockSize_;
+    return ::operator new(blockSize_);
+#else
+    if (freeList_ != NULL){
+        FreeBlock* block = freeList_;
+        freeList_ = block -> next;
+        return block;
+    }
+    if (bump_ == bumpEnd_){
+        grow();
+    }
+    void* block = bump_;
+    bump_ += blockSize_;
+    return block;
+#endif
+}
+
+/**
+* Returns a block obtained from allocate() to the pool. The object in it
+* must already have been destroyed.
+*/
+inline void NodePool::deallocate(void* block)
+{
+#ifdef BST_NO_POOL
+    // a block may have come from another pool through split, so this
+    // pool can hand back more than it handed out
+    bytesReserved_ -= std::min(bytesReserved_, blockSize_);
+    ::operator delete(block);
+#else
+    FreeBlock* freed = static_cast<FreeBlock*>(block);
+    freed -> next = freeList_;
+    freeList_ = freed;
+#endif
+}
+
+/**
+* Drops every chunk at once, invalidating all blocks handed out so far
+* (except those of chunks another pool still shares). The next chunk
+* reserved afterwards starts small again.
+*/
+inline void NodePool::release()
+{
+    chunks_.clear();
+    freeList_ = NULL;
+    bump_ = NULL;
+    bumpEnd_ = NULL;
+    nextChunkBlocks_ = firstChunkBlocks;
+#ifndef BST_NO_POOL
+    bytesReserved_ = 0;
+#endif
+}
+
+/**
+* Takes over everything other holds: its chunks, so blocks other handed
+* out stay valid after other is released, and its free blocks. other is
+* left empty. Both pools must have the same block size.
+*/
+inline void NodePool::absorb(NodePool& other)
+{
+    if (&other == this){
+        return;
+    }
+    share(other);
+    bytesReserved_ += other.bytesReserved_;
+#ifndef BST_NO_POOL
+    if (other.freeList_ != NULL){
+        FreeBlock* tail = other.freeList_;
+        while (tail -> next != NULL){
+            tail = tail -> next;
+        }
+        tail -> next = freeList_;
+        freeList_ = other.freeList_;
+    }
+    // keep whichever bump region has room left
+    if (bump_ == bumpEnd_){
+        bump_ = other.bump_;
+        bumpEnd_ = other.bumpEnd_;
+    }
+#endif
+    other.release();
+    other.bytesReserved_ = 0;
+}
+
+/**
+* Keeps other's chunks alive for as long as this pool is, for blocks
+* that other handed out but this pool's owner now frees.
+*/
+inline void NodePool::share(const NodePool& other)
+{
+    if (&other == this){
+        return;
+    }
+    chunks_.insert(chunks_.end(), other.chunks_.begin(), other.chunks_.end());
+    dedupeChunks();
+}
+
+/**
+* The chunk block was carved out of, for a block that changes hands on
+* its own (see BinarySearchTree::extract). Empty if no chunk of this pool
+* holds block.
+*/
+inline NodePool::Chunk NodePool::chunkOf(const void* block) const
+{
+    const char* address = static_cast<const char*>(block);
+    for (std::size_t i = 0; i < chunks_.size(); ++i){
+        const char* start = chunks_[i].memory.get();
+        if (!std::less<const char*>()(address, start) && std::less<const char*>()(address, start + chunks_[i].bytes)){
+            return chunks_[i];
+        }
+    }
+    Chunk none = {std::shared_ptr<char>(), 0};
+    return none;
+}
+
+/**
+* Keeps a single chunk alive for as long as this pool is, unless the pool
+* holds it already.
+*/
+inline void NodePool::share(const Chunk& chunk)
+{
+    if (!chunk.memory){
+        return;
+    }
+    for (std::size_t i = 0; i < chunks_.size(); ++i){
+        if (chunks_[i].memory == chunk.memory){
+            return;
+        }
+    }
+    chunks_.push_back(chunk);
+}
+
+/**
+* The size of each block after rounding up for alignment.
+*/
+inline std::size_t NodePool::blockSize() const
+{
+    return blockSize_;
+}
+
+/**
+* Total bytes currently reserved from the system for blocks.
+*/
+inline std::size_t NodePool::bytesReserved() const
+{
+    return bytesReserved_;
+}
+
+/**
+* Reserves a new chunk, twice as big as the previous one up to
+* maxChunkBlocks blocks, and makes it the current bump region.
+*/
+inline void NodePool::grow()
+{
+    std::size_t bytes = nextChunkBlocks_ * blockSize_;
+    chunks_.reserve(chunks_.size() + 1);
+
+    // over-allocate so the first block can be aligned by hand
+    std::shared_ptr<char> owner(static_cast<char*>(::operator new(bytes + blockAlign_)), ChunkDelete());
+    char* chunk = owner.get();
+    Chunk added = {owner, bytes + blockAlign_};
+    chunks_.push_back(added);
+    bytesReserved_ += bytes + blockAlign_;
+
+    std::uintptr_t start = reinterpret_cast<std::uintptr_t>(chunk);
+    start = (start + blockAlign_ - 1) / blockAlign_ * blockAlign_;
+    bump_ = reinterpret_cast<char*>(start);
+    bumpEnd_ = bump_ + bytes;
+
+    if (nextChunkBlocks_ < maxChunkBlocks){
+        nextChunkBlocks_ *= 2;
+    }
+}
+
+/**
+* Drops repeated references to the same chunk, which pile up when two
+* trees keep trading nodes.
+*/
+inline void NodePool::dedupeChunks()
+{
+    std::sort(chunks_.begin(), chunks_.end(),
+        [](const Chunk& a, const Chunk& b) {
+            return std::less<char*>()(a.memory.get(), b.memory.get());
+        });
+    chunks_.erase(std::unique(chunks_.begin(), chunks_.end(),
+        [](const Chunk& a, const Chunk& b) {
+            return a.memory == b.memory;
+        }), chunks_.end());
+}
+
+/*
+  -------------------------------------------
+  End implementations for the NodePool class.
+  -------------------------------------------
+*/
+
+#endif
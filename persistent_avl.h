@@ -0,0 +1,663 @@
+#ifndef PERSISTENT_AVL_H
+#define PERSISTENT_AVL_H
+
+#include <atomic>
+#include <exception>
+#include <stdexcept>
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+#include <type_traits>
+#include "bst.h"
+
+/**
+* An AVL tree whose versions share structure, for readers that need a
+* consistent view of the map while a writer keeps changing it.
+*
+* Nodes are reference counted and, once another version can see them,
+* never change. insert and remove copy only the nodes on the path from
+* the root to the change (and the few a rotation touches), pointing the
+* copies at the untouched subtrees of the old version. A snapshot is
+* then just another reference to the root: taking one is O(1), and the
+* memory a snapshot keeps alive is bounded by the paths changed since.
+*
+* A node whose count is one belongs to this version alone, and is
+* updated in place rather than copied, so a tree with no snapshots
+* outstanding allocates only for the keys it adds.
+*
+* Counts are atomic, so a snapshot may be handed to another thread and
+* read or dropped there while the writer goes on. The handoff itself
+* (copying the tree object) must be synchronized with the writer like
+* any other access to it. Iterators are invalidated by any change to
+* the tree they came from; iterate over a snapshot instead.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class PersistentAVLTree
+{
+protected:
+    struct Node;
+
+public:
+    PersistentAVLTree();
+    explicit PersistentAVLTree(const Compare& comp);
+    PersistentAVLTree(const PersistentAVLTree& other);
+    PersistentAVLTree& operator=(const PersistentAVLTree& other);
+    ~PersistentAVLTree();
+
+    PersistentAVLTree snapshot() const;
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    bool remove(const Key& key);
+    void clear();
+    bool isBalanced() const;
+    bool empty() const;
+    std::size_t size() const;
+
+    /**
+    * A read-only iterator over one version of the tree in key order.
+    * Nodes keep no parent links (a shared node has many parents), so
+    * the iterator carries the path to its node.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        const std::pair<const Key,Value>& operator*() const;
+        const std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class PersistentAVLTree<Key, Value, Compare>;
+        void pushLeftmost(const Node* node);
+
+        // the ancestors still to visit, ending with the current node
+        std::vector<const Node*> path_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    bool contains(const Key& key) const;
+    Value const & operator[](const Key& key) const;
+
+protected:
+    // height_ sits next to refs_ so the two share one word
+    struct Node
+    {
+        Node(const std::pair<const Key, Value>& item, Node* left, Node* right, int height);
+
+        std::pair<const Key, Value> item_;
+        Node* left_;
+        Node* right_;
+        std::atomic<unsigned> refs_;
+        int height_;
+    };
+
+    typedef ThreeWayCompare<Key, Compare> KeyOrder;
+    typedef std::integral_constant<bool, KeyOrder::descent == KeyOrder::threeWay> ThreeWay;
+
+    int order(const Key& a, const Key& b) const;
+    int order(const Key& a, const Key& b, std::true_type) const;
+    int order(const Key& a, const Key& b, std::false_type) const;
+
+    static Node* acquire(Node* node);
+    static void release(Node* node);
+    static Node* own(Node* node);
+    static int heightOf(const Node* node);
+    static void fixHeight(Node* node);
+    static Node* rotateLeft(Node* node);
+    static Node* rotateRight(Node* node);
+    static Node* rebalance(Node* node);
+
+    const Node* findNode(const Key& key) const;
+    Node* insertAt(Node* node, const std::pair<const Key, Value>& keyValuePair, bool& added);
+    Node* removeAt(Node* node, const Key& key);
+    Node* removeMin(Node* node, Node*& min);
+    int checkBalance(const Node* node) const;
+
+    Node* root_;
+    std::size_t size_;
+    Compare compare_;
+};
+
+/*
+  ------------------------------------------------------------------
+  Begin implementations for the PersistentAVLTree::iterator class.
+  ------------------------------------------------------------------
+*/
+
+template<typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::iterator::iterator()
+{
+
+}
+
+template<typename Key, typename Value, typename Compare>
+const std::pair<const Key,Value>&
+PersistentAVLTree<Key, Value, Compare>::iterator::operator*() const
+{
+    return path_.back() -> item_;
+}
+
+template<typename Key, typename Value, typename Compare>
+const std::pair<const Key,Value>*
+PersistentAVLTree<Key, Value, Compare>::iterator::operator->() const
+{
+    return &(path_.back() -> item_);
+}
+
+template<typename Key, typename Value, typename Compare>
+bool PersistentAVLTree<Key, Value, Compare>::iterator::operator==(const iterator& rhs) const
+{
+    if (path_.empty() || rhs.path_.empty()){
+        return path_.empty() == rhs.path_.empty();
+    }
+    return path_.back() == rhs.path_.back();
+}
+
+template<typename Key, typename Value, typename Compare>
+bool PersistentAVLTree<Key, Value, Compare>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Advances the iterator's location using an in-order sequencing. The
+* path holds only the ancestors the walk has yet to visit, so the next
+* node is the leftmost one under the right child, or else the nearest
+* ancestor left on the path.
+*/
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator&
+PersistentAVLTree<Key, Value, Compare>::iterator::operator++()
+{
+    if (path_.empty()){
+        return *this;
+    }
+    const Node* current = path_.back();
+    path_.pop_back();
+    pushLeftmost(current -> right_);
+    return *this;
+}
+
+template<typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::iterator::pushLeftmost(const Node* node)
+{
+    for (; node != NULL; node = node -> left_){
+        path_.push_back(node);
+    }
+}
+
+/*
+  ----------------------------------------------------------------
+  End implementations for the PersistentAVLTree::iterator class.
+  ----------------------------------------------------------------
+*/
+
+/*
+  ---------------------------------------------------------
+  Begin implementations for the PersistentAVLTree class.
+  ---------------------------------------------------------
+*/
+
+template<typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::Node::Node(const std::pair<const Key, Value>& item,
+                                                   Node* left, Node* right, int height) :
+    item_(item),
+    left_(left),
+    right_(right),
+    refs_(1),
+    height_(height)
+{
+
+}
+
+template<typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree() :
+    root_(NULL),
+    size_(0)
+{
+
+}
+
+template<typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree(const Compare& comp) :
+    root_(NULL),
+    size_(0),
+    compare_(comp)
+{
+
+}
+
+/**
+* Shares other's current version in O(1).
+*/
+template<typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree(const PersistentAVLTree& other) :
+    root_(acquire(other.root_)),
+    size_(other.size_),
+    compare_(other.compare_)
+{
+
+}
+
+template<typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>&
+PersistentAVLTree<Key, Value, Compare>::operator=(const PersistentAVLTree& other)
+{
+    Node* root = acquire(other.root_);
+    release(root_);
+    root_ = root;
+    size_ = other.size_;
+    compare_ = other.compare_;
+    return *this;
+}
+
+template<typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::~PersistentAVLTree()
+{
+    release(root_);
+}
+
+/**
+* Returns the current version, which later changes to this tree leave
+* untouched. O(1).
+*/
+template<typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>
+PersistentAVLTree<Key, Value, Compare>::snapshot() const
+{
+    return PersistentAVLTree(*this);
+}
+
+/**
+* Inserts the key/value pair, overwriting the value if the key is
+* already there. Copies the nodes on the search path that other
+* versions share.
+*/
+template<typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    bool added = false;
+    root_ = insertAt(root_, keyValuePair, added);
+    if (added){
+        ++size_;
+    }
+}
+
+/**
+* Removes key if it is there, returning whether it was. A missing key
+* copies nothing.
+*/
+template<typename Key, typename Value, typename Compare>
+bool PersistentAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    if (findNode(key) == NULL){
+        return false;
+    }
+    root_ = removeAt(root_, key);
+    --size_;
+    return true;
+}
+
+/**
+* Drops this version. Nodes that snapshots still share stay alive.
+*/
+template<typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::clear()
+{
+    release(root_);
+    root_ = NULL;
+    size_ = 0;
+}
+
+template<typename Key, typename Value, typename Compare>
+bool PersistentAVLTree<Key, Value, Compare>::isBalanced() const
+{
+    return checkBalance(root_) >= 0;
+}
+
+template<typename Key, typename Value, typename Compare>
+bool PersistentAVLTree<Key, Value, Compare>::empty() const
+{
+    return root_ == NULL;
+}
+
+template<typename Key, typename Value, typename Compare>
+std::size_t PersistentAVLTree<Key, Value, Compare>::size() const
+{
+    return size_;
+}
+
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator
+PersistentAVLTree<Key, Value, Compare>::begin() const
+{
+    iterator it;
+    it.pushLeftmost(root_);
+    return it;
+}
+
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator
+PersistentAVLTree<Key, Value, Compare>::end() const
+{
+    return iterator();
+}
+
+/**
+* Returns an iterator to key, or end() if it is not there. The path
+* keeps only the ancestors key is left of, as begin() followed by
+* increments would.
+*/
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator
+PersistentAVLTree<Key, Value, Compare>::find(const Key& key) const
+{
+    iterator it;
+    const Node* node = root_;
+    while (node != NULL){
+        int c = order(key, node -> item_.first);
+        if (c == 0){
+            it.path_.push_back(node);
+            return it;
+        }
+        if (c < 0){
+            it.path_.push_back(node);
+            node = node -> left_;
+        } else {
+            node = node -> right_;
+        }
+    }
+    return end();
+}
+
+template<typename Key, typename Value, typename Compare>
+bool PersistentAVLTree<Key, Value, Compare>::contains(const Key& key) const
+{
+    return findNode(key) != NULL;
+}
+
+/**
+ * @precondition The key exists in the tree
+ * Returns the value associated with the key
+ */
+template<typename Key, typename Value, typename Compare>
+Value const & PersistentAVLTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    const Node* node = findNode(key);
+    if(node == NULL) throw std::out_of_range("Invalid key");
+    return node -> item_.second;
+}
+
+/**
+* Returns <0, 0 or >0 as a orders before, with or after b, using the
+* key's own three-way compare where ThreeWayCompare finds one.
+*/
+template<typename Key, typename Value, typename Compare>
+int PersistentAVLTree<Key, Value, Compare>::order(const Key& a, const Key& b) const
+{
+    return order(a, b, ThreeWay());
+}
+
+template<typename Key, typename Value, typename Compare>
+int PersistentAVLTree<Key, Value, Compare>::order(const Key& a, const Key& b, std::true_type) const
+{
+    return KeyOrder::compare(a, b);
+}
+
+template<typename Key, typename Value, typename Compare>
+int PersistentAVLTree<Key, Value, Compare>::order(const Key& a, const Key& b, std::false_type) const
+{
+    if (compare_(a, b)){
+        return -1;
+    }
+    return compare_(b, a) ? 1 : 0;
+}
+
+/**
+* Adds a reference to node, if there is one, and returns it.
+*/
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::Node*
+PersistentAVLTree<Key, Value, Compare>::acquire(Node* node)
+{
+    if (node != NULL){
+        node -> refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return node;
+}
+
+/**
+* Drops a reference to node, freeing it and dropping its references to
+* its children if it was the last. The release/acquire pair orders every
+* thread's reads of a node before the thread that frees it.
+*/
+template<typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::release(Node* node)
+{
+    while (node != NULL){
+        if (node -> refs_.fetch_sub(1, std::memory_order_acq_rel) != 1){
+            return;
+        }
+        Node* left = node -> left_;
+        Node* right = node -> right_;
+        delete node;
+        release(left);
+        node = right;
+    }
+}
+
+/**
+* Takes the caller's reference to node and returns a node with the same
+* contents that only the caller references: node itself if no other
+* version holds it, else a copy sharing node's children.
+*/
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::Node*
+PersistentAVLTree<Key, Value, Compare>::own(Node* node)
+{
+    if (node -> refs_.load(std::memory_order_acquire) == 1){
+        return node;
+    }
+    Node* copy = new Node(node -> item_, acquire(node -> left_), acquire(node -> right_), node -> height_);
+    release(node);
+    return copy;
+}
+
+template<typename Key, typename Value, typename Compare>
+int PersistentAVLTree<Key, Value, Compare>::heightOf(const Node* node)
+{
+    return (node == NULL) ? 0 : node -> height_;
+}
+
+template<typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::fixHeight(Node* node)
+{
+    int left = heightOf(node -> left_);
+    int right = heightOf(node -> right_);
+    node -> height_ = 1 + (left > right ? left : right);
+}
+
+/**
+* Rotates node's right child up over it. node must be owned by the
+* caller; the child is owned here before it is relinked.
+*/
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::Node*
+PersistentAVLTree<Key, Value, Compare>::rotateLeft(Node* node)
+{
+    Node* right = own(node -> right_);
+    node -> right_ = right -> left_;
+    right -> left_ = node;
+    fixHeight(node);
+    fixHeight(right);
+    return right;
+}
+
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::Node*
+PersistentAVLTree<Key, Value, Compare>::rotateRight(Node* node)
+{
+    Node* left = own(node -> left_);
+    node -> left_ = left -> right_;
+    left -> right_ = node;
+    fixHeight(node);
+    fixHeight(left);
+    return left;
+}
+
+/**
+* Restores the AVL property at node, whose subtrees are balanced and
+* differ in height by at most two, and returns the subtree's new root.
+* node must be owned by the caller.
+*/
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::Node*
+PersistentAVLTree<Key, Value, Compare>::rebalance(Node* node)
+{
+    int balance = heightOf(node -> left_) - heightOf(node -> right_);
+    if (balance > 1){
+        if (heightOf(node -> left_ -> left_) < heightOf(node -> left_ -> right_)){
+            node -> left_ = rotateLeft(own(node -> left_));
+        }
+        return rotateRight(node);
+    }
+    if (balance < -1){
+        if (heightOf(node -> right_ -> right_) < heightOf(node -> right_ -> left_)){
+            node -> right_ = rotateRight(own(node -> right_));
+        }
+        return rotateLeft(node);
+    }
+    fixHeight(node);
+    return node;
+}
+
+template<typename Key, typename Value, typename Compare>
+const typename PersistentAVLTree<Key, Value, Compare>::Node*
+PersistentAVLTree<Key, Value, Compare>::findNode(const Key& key) const
+{
+    const Node* node = root_;
+    while (node != NULL){
+        int c = order(key, node -> item_.first);
+        if (c == 0){
+            return node;
+        }
+        node = (c < 0) ? node -> left_ : node -> right_;
+    }
+    return NULL;
+}
+
+/**
+* Inserts into the subtree at node, taking the caller's reference to it
+* and returning one to the new subtree root.
+*/
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::Node*
+PersistentAVLTree<Key, Value, Compare>::insertAt(Node* node, const std::pair<const Key, Value>& keyValuePair,
+                                                 bool& added)
+{
+    if (node == NULL){
+        added = true;
+        return new Node(keyValuePair, NULL, NULL, 1);
+    }
+    node = own(node);
+    int c = order(keyValuePair.first, node -> item_.first);
+    if (c == 0){
+        node -> item_.second = keyValuePair.second;
+        return node;
+    }
+    if (c < 0){
+        node -> left_ = insertAt(node -> left_, keyValuePair, added);
+    } else {
+        node -> right_ = insertAt(node -> right_, keyValuePair, added);
+    }
+    return rebalance(node);
+}
+
+/**
+* Removes key, which must be in the subtree at node. Takes the caller's
+* reference to node and returns one to the new subtree root.
+*/
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::Node*
+PersistentAVLTree<Key, Value, Compare>::removeAt(Node* node, const Key& key)
+{
+    node = own(node);
+    int c = order(key, node -> item_.first);
+    if (c < 0){
+        node -> left_ = removeAt(node -> left_, key);
+        return rebalance(node);
+    }
+    if (c > 0){
+        node -> right_ = removeAt(node -> right_, key);
+        return rebalance(node);
+    }
+
+    Node* replacement;
+    if (node -> left_ == NULL || node -> right_ == NULL){
+        replacement = (node -> left_ != NULL) ? node -> left_ : node -> right_;
+    } else {
+        // the successor takes node's place, with node's children
+        Node* right = removeMin(node -> right_, replacement);
+        replacement -> left_ = node -> left_;
+        replacement -> right_ = right;
+        replacement = rebalance(replacement);
+    }
+    node -> left_ = NULL;
+    node -> right_ = NULL;
+    release(node);
+    return replacement;
+}
+
+/**
+* Detaches the smallest node of the subtree at node into min, owned by
+* the caller and without children. Takes the caller's reference to node
+* and returns one to what is left.
+*/
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::Node*
+PersistentAVLTree<Key, Value, Compare>::removeMin(Node* node, Node*& min)
+{
+    node = own(node);
+    if (node -> left_ == NULL){
+        Node* right = node -> right_;
+        node -> right_ = NULL;
+        min = node;
+        return right;
+    }
+    node -> left_ = removeMin(node -> left_, min);
+    return rebalance(node);
+}
+
+/**
+* Returns the height of the subtree at node, or -1 if it is not AVL
+* balanced or its stored heights are wrong.
+*/
+template<typename Key, typename Value, typename Compare>
+int PersistentAVLTree<Key, Value, Compare>::checkBalance(const Node* node) const
+{
+    if (node == NULL){
+        return 0;
+    }
+    int left = checkBalance(node -> left_);
+    int right = checkBalance(node -> right_);
+    if (left < 0 || right < 0 || left - right > 1 || right - left > 1){
+        return -1;
+    }
+    int height = 1 + (left > right ? left : right);
+    return (height == node -> height_) ? height : -1;
+}
+
+/*
+  -------------------------------------------------------
+  End implementations for the PersistentAVLTree class.
+  -------------------------------------------------------
+*/
+
+#endif
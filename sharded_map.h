@@ -0,0 +1,572 @@
+#ifndef SHARDED_MAP_H
+#define SHARDED_MAP_H
+
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#include "avlbst.h"
+#include "concurrent_avl.h"
+
+/**
+* A map that range-partitions its keys across several AVLTrees, each
+* behind its own mutex, so writers to different key ranges do not wait
+* for each other.
+*
+* Which shard holds a key is decided by a routing table of boundary
+* keys. The table is never changed in place: moving a boundary builds a
+* new one and publishes it while the shards it affects are locked, and
+* an operation that locked a shard through an older table notices and
+* retries. A lookup pins an EpochDomain while it reads the table, and a
+* replaced table is retired to it, so old tables are freed once no
+* lookup can still be reading them.
+*
+* Boundaries follow the writes. Each shard counts its inserts and
+* removes and keeps a small sample of the keys written; when one shard
+* has taken checkWrites of them, the map looks for a shard with well
+* over its share of the writes and splits it at the middle of its
+* sample, either into a shard not yet in use or by handing part of its
+* range to its less busy neighbour. The trees are cut and spliced with
+* AVLTree::split and join, so a move costs O(log n), not a copy.
+* Writes that all land past the largest key (ascending timestamps, say)
+* stay on one shard whatever the boundaries are.
+*
+* Iteration walks the shards in key order without locking them, so it
+* must not run concurrently with writers, and a write or rebalance()
+* may invalidate every iterator.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class ShardedMap
+{
+protected:
+    struct Shard;
+    struct Routing;
+
+public:
+    explicit ShardedMap(std::size_t shards, const Compare& comp = Compare());
+    explicit ShardedMap(const std::vector<Key>& bounds, const Compare& comp = Compare());
+    ~ShardedMap();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    Value operator[](const Key& key) const;
+    bool empty() const;
+    void clear();
+    void rebalance();
+    std::size_t activeShards() const;
+
+    /**
+    * An iterator over the whole map in key order, one shard after
+    * another.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        std::pair<const Key,Value>& operator*() const;
+        std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class ShardedMap<Key, Value, Compare>;
+        iterator(const Routing* routing, std::size_t shard);
+        void skipEmpty();
+
+        const Routing* routing_;
+        std::size_t shard_;
+        typename AVLTree<Key, Value, Compare>::iterator current_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+
+protected:
+    struct Shard
+    {
+        explicit Shard(const Compare& comp);
+
+        mutable std::mutex lock_;
+        AVLTree<Key, Value, Compare> tree_;
+        // both guarded by lock_
+        std::size_t writes_;
+        std::vector<Key> sample_;
+    };
+
+    // shards_[i] holds the keys from bounds_[i - 1] up to but not
+    // including bounds_[i]
+    struct Routing
+    {
+        std::vector<Key> bounds_;
+        std::vector<Shard*> shards_;
+    };
+
+    static const std::size_t checkWrites = 1 << 14;
+    static const std::size_t sampleEvery = 16;
+    static const std::size_t sampleSize = 64;
+
+    ShardedMap(const ShardedMap&);
+    ShardedMap& operator=(const ShardedMap&);
+
+    Shard* lockShard(const Key& key, std::unique_lock<std::mutex>& lock) const;
+    void recordWrite(Shard* shard, const Key& key, std::unique_lock<std::mutex>& lock);
+    void moveBoundary();
+    void publish(Routing* routing);
+    static void destroyRouting(void* routing);
+
+    std::vector<std::unique_ptr<Shard> > shards_;
+    std::atomic<const Routing*> routing_;
+    // pinned while a table is read; tables replaced are retired to it
+    mutable EpochDomain epoch_;
+    std::mutex rebalanceLock_;
+    Compare compare_;
+};
+
+/*
+  -----------------------------------------------------------
+  Begin implementations for the ShardedMap::iterator class.
+  -----------------------------------------------------------
+*/
+
+template<typename Key, typename Value, typename Compare>
+ShardedMap<Key, Value, Compare>::iterator::iterator() :
+    routing_(NULL),
+    shard_(0)
+{
+
+}
+
+template<typename Key, typename Value, typename Compare>
+ShardedMap<Key, Value, Compare>::iterator::iterator(const Routing* routing, std::size_t shard) :
+    routing_(routing),
+    shard_(shard)
+{
+    if (shard_ < routing_ -> shards_.size()){
+        current_ = routing_ -> shards_[shard_] -> tree_.begin();
+        skipEmpty();
+    }
+}
+
+template<typename Key, typename Value, typename Compare>
+std::pair<const Key,Value>&
+ShardedMap<Key, Value, Compare>::iterator::operator*() const
+{
+    return *current_;
+}
+
+template<typename Key, typename Value, typename Compare>
+std::pair<const Key,Value>*
+ShardedMap<Key, Value, Compare>::iterator::operator->() const
+{
+    return &(*current_);
+}
+
+template<typename Key, typename Value, typename Compare>
+bool ShardedMap<Key, Value, Compare>::iterator::operator==(const iterator& rhs) const
+{
+    return shard_ == rhs.shard_ && current_ == rhs.current_;
+}
+
+template<typename Key, typename Value, typename Compare>
+bool ShardedMap<Key, Value, Compare>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Advances the iterator's location using an in-order sequencing, moving
+* on to the next shard that holds anything at the end of each one.
+*/
+template<typename Key, typename Value, typename Compare>
+typename ShardedMap<Key, Value, Compare>::iterator&
+ShardedMap<Key, Value, Compare>::iterator::operator++()
+{
+    ++current_;
+    skipEmpty();
+    return *this;
+}
+
+template<typename Key, typename Value, typename Compare>
+void ShardedMap<Key, Value, Compare>::iterator::skipEmpty()
+{
+    while (current_ == routing_ -> shards_[shard_] -> tree_.end()){
+        if (++shard_ == routing_ -> shards_.size()){
+            current_ = typename AVLTree<Key, Value, Compare>::iterator();
+            return;
+        }
+        current_ = routing_ -> shards_[shard_] -> tree_.begin();
+    }
+}
+
+/*
+  ---------------------------------------------------------
+  End implementations for the ShardedMap::iterator class.
+  ---------------------------------------------------------
+*/
+
+/*
+  --------------------------------------------------
+  Begin implementations for the ShardedMap class.
+  --------------------------------------------------
+*/
+
+template<typename Key, typename Value, typename Compare>
+ShardedMap<Key, Value, Compare>::Shard::Shard(const Compare& comp) :
+    tree_(comp),
+    writes_(0)
+{
+
+}
+
+/**
+* Creates a map that can spread over up to shards shards. It starts with
+* all keys in one and splits it as the writes show where to.
+*/
+template<typename Key, typename Value, typename Compare>
+ShardedMap<Key, Value, Compare>::ShardedMap(std::size_t shards, const Compare& comp) :
+    routing_(NULL),
+    compare_(comp)
+{
+    if (shards == 0){
+        shards = 1;
+    }
+    for (std::size_t i = 0; i < shards; ++i){
+        shards_.push_back(std::unique_ptr<Shard>(new Shard(comp)));
+    }
+    Routing* routing = new Routing;
+    routing -> shards_.push_back(shards_[0].get());
+    publish(routing);
+}
+
+/**
+* Creates a map with one shard per range between the given boundary
+* keys, which must be strictly increasing. Throws std::invalid_argument
+* if they are not.
+*/
+template<typename Key, typename Value, typename Compare>
+ShardedMap<Key, Value, Compare>::ShardedMap(const std::vector<Key>& bounds, const Compare& comp) :
+    routing_(NULL),
+    compare_(comp)
+{
+    for (std::size_t i = 1; i < bounds.size(); ++i){
+        if (!compare_(bounds[i - 1], bounds[i])){
+            throw std::invalid_argument("Shard bounds out of order");
+        }
+    }
+    Routing* routing = new Routing;
+    routing -> bounds_ = bounds;
+    for (std::size_t i = 0; i <= bounds.size(); ++i){
+        shards_.push_back(std::unique_ptr<Shard>(new Shard(comp)));
+        routing -> shards_.push_back(shards_[i].get());
+    }
+    publish(routing);
+}
+
+template<typename Key, typename Value, typename Compare>
+ShardedMap<Key, Value, Compare>::~ShardedMap()
+{
+    delete routing_.load();
+}
+
+/**
+* Inserts the key/value pair, overwriting the value if the key is
+* already there.
+*/
+template<typename Key, typename Value, typename Compare>
+void ShardedMap<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    std::unique_lock<std::mutex> lock;
+    Shard* shard = lockShard(keyValuePair.first, lock);
+    shard -> tree_.insert(keyValuePair);
+    recordWrite(shard, keyValuePair.first, lock);
+}
+
+template<typename Key, typename Value, typename Compare>
+void ShardedMap<Key, Value, Compare>::remove(const Key& key)
+{
+    std::unique_lock<std::mutex> lock;
+    Shard* shard = lockShard(key, lock);
+    shard -> tree_.remove(key);
+    recordWrite(shard, key, lock);
+}
+
+/**
+* Copies the value of key into value and returns true, or returns false
+* if key is not there.
+*/
+template<typename Key, typename Value, typename Compare>
+bool ShardedMap<Key, Value, Compare>::find(const Key& key, Value& value) const
+{
+    std::unique_lock<std::mutex> lock;
+    Shard* shard = lockShard(key, lock);
+    typename AVLTree<Key, Value, Compare>::iterator it = shard -> tree_.find(key);
+    if (it == shard -> tree_.end()){
+        return false;
+    }
+    value = it -> second;
+    return true;
+}
+
+template<typename Key, typename Value, typename Compare>
+bool ShardedMap<Key, Value, Compare>::contains(const Key& key) const
+{
+    std::unique_lock<std::mutex> lock;
+    Shard* shard = lockShard(key, lock);
+    return shard -> tree_.find(key) != shard -> tree_.end();
+}
+
+/**
+* Returns a copy of the value of key. Throws std::out_of_range if key is
+* not there. (A reference would outlive the shard's lock.)
+*/
+template<typename Key, typename Value, typename Compare>
+Value ShardedMap<Key, Value, Compare>::operator[](const Key& key) const
+{
+    Value value;
+    if (!find(key, value)){
+        throw std::out_of_range("Invalid key");
+    }
+    return value;
+}
+
+template<typename Key, typename Value, typename Compare>
+bool ShardedMap<Key, Value, Compare>::empty() const
+{
+    for (std::size_t i = 0; i < shards_.size(); ++i){
+        std::lock_guard<std::mutex> lock(shards_[i] -> lock_);
+        if (!shards_[i] -> tree_.empty()){
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+* Empties every shard. The boundaries stay where they are.
+*/
+template<typename Key, typename Value, typename Compare>
+void ShardedMap<Key, Value, Compare>::clear()
+{
+    for (std::size_t i = 0; i < shards_.size(); ++i){
+        std::lock_guard<std::mutex> lock(shards_[i] -> lock_);
+        shards_[i] -> tree_.clear();
+    }
+}
+
+template<typename Key, typename Value, typename Compare>
+std::size_t ShardedMap<Key, Value, Compare>::activeShards() const
+{
+    EpochDomain::Guard guard(epoch_);
+    return routing_.load(std::memory_order_acquire) -> shards_.size();
+}
+
+template<typename Key, typename Value, typename Compare>
+typename ShardedMap<Key, Value, Compare>::iterator
+ShardedMap<Key, Value, Compare>::begin() const
+{
+    return iterator(routing_.load(std::memory_order_acquire), 0);
+}
+
+template<typename Key, typename Value, typename Compare>
+typename ShardedMap<Key, Value, Compare>::iterator
+ShardedMap<Key, Value, Compare>::end() const
+{
+    const Routing* routing = routing_.load(std::memory_order_acquire);
+    return iterator(routing, routing -> shards_.size());
+}
+
+/**
+* Locks the shard that holds key and returns it. A table replaced after
+* it was read may have moved key elsewhere, so the lookup is redone
+* until the table is still current once the lock is held; tables are
+* only replaced under the locks of the shards they change. The table is
+* only read while the epoch is pinned; the shards themselves live as
+* long as the map.
+*/
+template<typename Key, typename Value, typename Compare>
+typename ShardedMap<Key, Value, Compare>::Shard*
+ShardedMap<Key, Value, Compare>::lockShard(const Key& key, std::unique_lock<std::mutex>& lock) const
+{
+    while (true){
+        EpochDomain::Guard guard(epoch_);
+        const Routing* routing = routing_.load(std::memory_order_acquire);
+        std::size_t i = std::upper_bound(routing -> bounds_.begin(), routing -> bounds_.end(), key, compare_) -
+                        routing -> bounds_.begin();
+        Shard* shard = routing -> shards_[i];
+        lock = std::unique_lock<std::mutex>(shard -> lock_);
+        if (routing_.load(std::memory_order_acquire) == routing){
+            return shard;
+        }
+        lock.unlock();
+    }
+}
+
+/**
+* Counts a write to shard, sampling its key, and once the shard has had
+* checkWrites of them since the last check, releases the lock and
+* rebalances unless another thread already is.
+*/
+template<typename Key, typename Value, typename Compare>
+void ShardedMap<Key, Value, Compare>::recordWrite(Shard* shard, const Key& key, std::unique_lock<std::mutex>& lock)
+{
+    std::size_t writes = ++shard -> writes_;
+    if (writes % sampleEvery == 0){
+        std::size_t slot = (writes / sampleEvery) % sampleSize;
+        if (slot < shard -> sample_.size()){
+            shard -> sample_[slot] = key;
+        } else {
+            shard -> sample_.push_back(key);
+        }
+    }
+    if (writes < checkWrites){
+        return;
+    }
+    lock.unlock();
+    if (rebalanceLock_.try_lock()){
+        std::lock_guard<std::mutex> rebalancing(rebalanceLock_, std::adopt_lock);
+        moveBoundary();
+    }
+}
+
+/**
+* Moves one shard boundary if a shard has taken more than half again its
+* share of the writes since the last check; see moveBoundary().
+*/
+template<typename Key, typename Value, typename Compare>
+void ShardedMap<Key, Value, Compare>::rebalance()
+{
+    std::lock_guard<std::mutex> rebalancing(rebalanceLock_);
+    moveBoundary();
+}
+
+/**
+* Finds the shard with the most writes since the last call, and if it has
+* had more than half again its share, splits it at the median of its
+* sampled keys: the keys past the median go to an idle shard if there
+* is one, else the keys on the side of the less busy neighbour go to
+* that neighbour. Resets the write counts. Must hold rebalanceLock_.
+* The new table is published before the shards it changes are unlocked,
+* so a writer that locked one of them through the old table retries.
+*/
+template<typename Key, typename Value, typename Compare>
+void ShardedMap<Key, Value, Compare>::moveBoundary()
+{
+    const Routing* routing = routing_.load(std::memory_order_relaxed);
+    std::size_t active = routing -> shards_.size();
+    std::vector<std::size_t> writes(active);
+    std::size_t total = 0;
+    std::size_t hot = 0;
+    for (std::size_t i = 0; i < active; ++i){
+        std::lock_guard<std::mutex> lock(routing -> shards_[i] -> lock_);
+        writes[i] = routing -> shards_[i] -> writes_;
+        routing -> shards_[i] -> writes_ = 0;
+        total += writes[i];
+        if (writes[i] > writes[hot]){
+            hot = i;
+        }
+    }
+    if (total == 0 || 2 * writes[hot] * shards_.size() <= 3 * total){
+        return;
+    }
+
+    Shard* from = routing -> shards_[hot];
+    std::vector<Key> sample;
+    {
+        std::lock_guard<std::mutex> lock(from -> lock_);
+        sample = from -> sample_;
+    }
+    if (sample.size() < 2){
+        return;
+    }
+    std::sort(sample.begin(), sample.end(), compare_);
+    std::size_t mid = sample.size() / 2;
+    const Key& split = sample[mid];
+    // both halves must keep some of the sampled keys, and the split must
+    // fall strictly inside the shard's range
+    if (!compare_(sample[mid - 1], split) ||
+        (hot > 0 && !compare_(routing -> bounds_[hot - 1], split)) ||
+        (hot + 1 < active && !compare_(split, routing -> bounds_[hot]))){
+        return;
+    }
+
+    std::unique_ptr<Routing> next(new Routing(*routing));
+    if (active < shards_.size()){
+        Shard* to = shards_[active].get();
+        next -> bounds_.insert(next -> bounds_.begin() + hot, split);
+        next -> shards_.insert(next -> shards_.begin() + hot + 1, to);
+        std::lock_guard<std::mutex> fromLock(from -> lock_);
+        std::lock_guard<std::mutex> toLock(to -> lock_);
+        from -> tree_.split(split, to -> tree_);
+        from -> sample_.clear();
+        publish(next.release());
+        return;
+    }
+    if (active == 1){
+        return;
+    }
+
+    bool toRight = (hot == 0) || (hot + 1 < active && writes[hot + 1] < writes[hot - 1]);
+    if (toRight){
+        Shard* right = routing -> shards_[hot + 1];
+        next -> bounds_[hot] = split;
+        std::lock_guard<std::mutex> fromLock(from -> lock_);
+        std::lock_guard<std::mutex> rightLock(right -> lock_);
+        AVLTree<Key, Value, Compare> moved(compare_);
+        from -> tree_.split(split, moved);
+        moved.join(right -> tree_);
+        right -> tree_.join(moved);
+        from -> sample_.clear();
+        right -> sample_.clear();
+        publish(next.release());
+    } else {
+        Shard* left = routing -> shards_[hot - 1];
+        next -> bounds_[hot - 1] = split;
+        std::lock_guard<std::mutex> leftLock(left -> lock_);
+        std::lock_guard<std::mutex> fromLock(from -> lock_);
+        AVLTree<Key, Value, Compare> kept(compare_);
+        from -> tree_.split(split, kept);
+        left -> tree_.join(from -> tree_);
+        from -> tree_.join(kept);
+        left -> sample_.clear();
+        from -> sample_.clear();
+        publish(next.release());
+    }
+}
+
+/**
+* Makes routing the current table and retires the one it replaces.
+*/
+template<typename Key, typename Value, typename Compare>
+void ShardedMap<Key, Value, Compare>::publish(Routing* routing)
+{
+    const Routing* old = routing_.exchange(routing, std::memory_order_acq_rel);
+    if (old != NULL){
+        EpochDomain::Guard guard(epoch_);
+        guard.retire(const_cast<Routing*>(old), &destroyRouting);
+    }
+}
+
+template<typename Key, typename Value, typename Compare>
+void ShardedMap<Key, Value, Compare>::destroyRouting(void* routing)
+{
+    delete static_cast<Routing*>(routing);
+}
+
+/*
+  ------------------------------------------------
+  End implementations for the ShardedMap class.
+  ------------------------------------------------
+*/
+
+#endif